@@ -35,7 +35,30 @@ SOURCES += \
     src/Logger.cpp \
     src/main.cpp \
     src/mainwindow.cpp \
-    src/VRWorker.cpp \
+    src/FrameSource.cpp \
+    src/SyntheticFrameSource.cpp \
+    src/ReplayFrameSource.cpp \
+    src/FramePool.cpp \
+    src/FrameRing.cpp \
+    src/SpoolFile.cpp \
+    src/FramePacer.cpp \
+    src/ColorConverter.cpp \
+    src/FrameConverter.cpp \
+    src/FrameChecksum.cpp \
+    src/FrameTimingLog.cpp \
+    src/LatencyHistogram.cpp \
+    src/Benchmark.cpp \
+    src/WorkerPool.cpp \
+    src/SliceScaler.cpp \
+    src/EncoderTuner.cpp \
+    src/EncodeBudget.cpp \
+    src/DropCounter.cpp \
+    src/StaticFrameDetector.cpp \
+    src/OutputFile.cpp \
+    src/MuxThread.cpp \
+    src/TeeOutput.cpp \
+    src/RecordingPipeline.cpp \
+    src/RecordingSession.cpp \
     src/XVideoWriter.cpp \
     src/SettingsWindow.cpp \
     src/SettingsHolder.cpp
@@ -43,11 +66,41 @@ SOURCES += \
 HEADERS += \            
     src/Logger.h \
     src/mainwindow.h \
-    src/VRWorker.h \
+    src/FrameSource.h \
+    src/SyntheticFrameSource.h \
+    src/ReplayFrameSource.h \
+    src/FramePool.h \
+    src/FrameRing.h \
+    src/SpoolFile.h \
+    src/FramePacer.h \
+    src/ColorConverter.h \
+    src/FrameConverter.h \
+    src/FrameChecksum.h \
+    src/FrameTimingLog.h \
+    src/LatencyHistogram.h \
+    src/Benchmark.h \
+    src/WorkerPool.h \
+    src/SliceScaler.h \
+    src/EncoderTuner.h \
+    src/EncodeBudget.h \
+    src/DropCounter.h \
+    src/StaticFrameDetector.h \
+    src/OutputFile.h \
+    src/MuxThread.h \
+    src/TeeOutput.h \
+    src/RecordingPipeline.h \
+    src/RecordingSession.h \
     src/XVideoWriter.h \
     src/SettingsWindow.h \
     src/SettingsHolder.h
 
+# The VR mirror capture needs D3D11 and SteamVR; other platforms record from
+# the synthetic or replay frame sources
+win32 {
+    SOURCES += src/VRWorker.cpp
+    HEADERS += src/VRWorker.h
+}
+
 FORMS += \
         ui/mainwindow.ui \
 	ui/settingswindow.ui
@@ -0,0 +1,90 @@
+#-------------------------------------------------
+#
+# Headless recorder: the same session as the window, driven from the
+# command line
+#
+#-------------------------------------------------
+
+QT       += core network
+# Logger can also write to a QPlainTextEdit
+QT       += gui widgets
+
+TARGET = XTgnRecord
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+DEFINES += \
+	WIN32_LEAN_AND_MEAN \
+	BOOST_DATE_TIME_NO_LIB \
+	BOOST_REGEX_NO_LIB
+
+SOURCES += \
+    src/Logger.cpp \
+    src/recordmain.cpp \
+    src/RecordingSession.cpp \
+    src/FrameSource.cpp \
+    src/SyntheticFrameSource.cpp \
+    src/ReplayFrameSource.cpp \
+    src/FramePool.cpp \
+    src/FrameRing.cpp \
+    src/SpoolFile.cpp \
+    src/FramePacer.cpp \
+    src/ColorConverter.cpp \
+    src/FrameConverter.cpp \
+    src/FrameChecksum.cpp \
+    src/FrameTimingLog.cpp \
+    src/LatencyHistogram.cpp \
+    src/WorkerPool.cpp \
+    src/SliceScaler.cpp \
+    src/EncoderTuner.cpp \
+    src/EncodeBudget.cpp \
+    src/DropCounter.cpp \
+    src/StaticFrameDetector.cpp \
+    src/OutputFile.cpp \
+    src/MuxThread.cpp \
+    src/TeeOutput.cpp \
+    src/RecordingPipeline.cpp \
+    src/XVideoWriter.cpp \
+    src/SettingsHolder.cpp
+
+HEADERS += \
+    src/Logger.h \
+    src/RecordingSession.h \
+    src/FrameSource.h \
+    src/SyntheticFrameSource.h \
+    src/ReplayFrameSource.h \
+    src/FramePool.h \
+    src/FrameRing.h \
+    src/SpoolFile.h \
+    src/FramePacer.h \
+    src/ColorConverter.h \
+    src/FrameConverter.h \
+    src/FrameChecksum.h \
+    src/FrameTimingLog.h \
+    src/LatencyHistogram.h \
+    src/WorkerPool.h \
+    src/SliceScaler.h \
+    src/EncoderTuner.h \
+    src/EncodeBudget.h \
+    src/DropCounter.h \
+    src/StaticFrameDetector.h \
+    src/OutputFile.h \
+    src/MuxThread.h \
+    src/TeeOutput.h \
+    src/RecordingPipeline.h \
+    src/XVideoWriter.h \
+    src/SettingsHolder.h
+
+win32 {
+    SOURCES += src/VRWorker.cpp
+    HEADERS += src/VRWorker.h
+}
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
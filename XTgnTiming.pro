@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Reader of the per-frame timing sidecar, exports it as CSV
+#
+#-------------------------------------------------
+
+QT       += core
+
+TARGET = XTgnTiming
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+DEFINES += \
+	WIN32_LEAN_AND_MEAN
+
+SOURCES += \
+    src/timingmain.cpp \
+    src/FrameTimingLog.cpp \
+    src/DropCounter.cpp
+
+HEADERS += \
+    src/FrameTimingLog.h \
+    src/FrameSource.h \
+    src/DropCounter.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,64 @@
+#-------------------------------------------------
+#
+# Offline chunked transcoder, built from the recorder's encoding code
+#
+#-------------------------------------------------
+
+QT       += core
+# Logger can also write to a QPlainTextEdit
+QT       += gui widgets
+
+TARGET = XTgnTranscode
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+DEFINES += \
+	WIN32_LEAN_AND_MEAN
+
+SOURCES += \
+    src/Logger.cpp \
+    src/transcodemain.cpp \
+    src/ChunkedTranscoder.cpp \
+    src/FramePool.cpp \
+    src/FrameRing.cpp \
+    src/SpoolFile.cpp \
+    src/ColorConverter.cpp \
+    src/FrameConverter.cpp \
+    src/FrameChecksum.cpp \
+    src/FrameTimingLog.cpp \
+    src/LatencyHistogram.cpp \
+    src/DropCounter.cpp \
+    src/WorkerPool.cpp \
+    src/SliceScaler.cpp \
+    src/EncodeBudget.cpp \
+    src/OutputFile.cpp \
+    src/MuxThread.cpp \
+    src/XVideoWriter.cpp
+
+HEADERS += \
+    src/Logger.h \
+    src/ChunkedTranscoder.h \
+    src/FramePool.h \
+    src/FrameRing.h \
+    src/SpoolFile.h \
+    src/ColorConverter.h \
+    src/FrameConverter.h \
+    src/FrameChecksum.h \
+    src/FrameTimingLog.h \
+    src/LatencyHistogram.h \
+    src/DropCounter.h \
+    src/WorkerPool.h \
+    src/SliceScaler.h \
+    src/EncodeBudget.h \
+    src/OutputFile.h \
+    src/MuxThread.h \
+    src/XVideoWriter.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
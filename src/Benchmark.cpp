@@ -0,0 +1,510 @@
+#include "Benchmark.h"
+#include "ColorConverter.h"
+#include "FrameConverter.h"
+#include "SyntheticFrameSource.h"
+#include "SliceScaler.h"
+#include "WorkerPool.h"
+#include "XVideoWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libswscale/swscale.h>
+#ifdef __cplusplus
+}
+#endif
+
+namespace
+{
+	struct resolution
+	{
+		int width;
+		int height;
+		const char* name;
+	};
+
+	const resolution Resolutions[] =
+	{
+		{ 1512, 1680, "Vive/Rift eye" },
+		{ 2016, 2240, "Vive Pro eye" },
+		{ 2160, 1200, "Vive mirror" },
+		{ 2880, 1600, "Vive Pro mirror" }
+	};
+
+	typedef std::chrono::steady_clock clock;
+
+	AVFrame* AllocFrame(const AVPixelFormat format, const int width, const int height)
+	{
+		auto frame = av_frame_alloc();
+		if (!frame)
+			return nullptr;
+
+		frame->format = format;
+		frame->width = width;
+		frame->height = height;
+		if (av_frame_get_buffer(frame, 64) < 0)
+			av_frame_free(&frame);
+
+		return frame;
+	}
+
+	double Milliseconds(const clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	//User and kernel time of the whole process, encoder threads included
+	double ProcessCpuSeconds()
+	{
+#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+		if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+			return 0.0;
+
+		const auto seconds = [](const FILETIME& time)
+		{
+			return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+		};
+		return seconds(kernel) + seconds(user);
+#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0.0;
+
+		return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+	}
+
+	int64_t FileSize(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		return file ? static_cast<int64_t>(file.tellg()) : 0;
+	}
+
+	int MaxLumaDifference(const AVFrame* a, const AVFrame* b)
+	{
+		int result = 0;
+		for (int y = 0; y < a->height; ++y)
+		{
+			const uint8_t* ra = a->data[0] + y * a->linesize[0];
+			const uint8_t* rb = b->data[0] + y * b->linesize[0];
+			for (int x = 0; x < a->width; ++x)
+				result = std::max(result, std::abs(ra[x] - rb[x]));
+		}
+
+		return result;
+	}
+}
+
+Benchmark::Benchmark(Logger* logger)
+	: m_logger(logger)
+{
+}
+
+void Benchmark::RunColorConversion(const int iterations)
+{
+	const auto detected = ColorConverter::DetectSimdLevel();
+	m_logger->WriteInfo(QString("Colour conversion benchmark, %1 iterations, CPU supports %2\r\n")
+		.arg(iterations).arg(ColorConverter::GetSimdLevelName(detected)));
+
+	for (const auto& res : Resolutions)
+	{
+		SyntheticFrameSource source(m_logger);
+		source.Initialize(res.width, res.height);
+
+		auto src = AllocFrame(AV_PIX_FMT_RGBA, res.width, res.height);
+		auto reference = AllocFrame(AV_PIX_FMT_YUV420P, res.width, res.height);
+		auto dst = AllocFrame(AV_PIX_FMT_YUV420P, res.width, res.height);
+		const auto sws = sws_getContext(res.width, res.height, AV_PIX_FMT_RGBA,
+			res.width, res.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+
+		if (!source.IsInitialized() || !src || !reference || !dst || !sws || !source.CaptureFrame(src))
+		{
+			m_logger->WriteError(QString("Benchmark setup failed at %1x%2\r\n").arg(res.width).arg(res.height));
+			av_frame_free(&src);
+			av_frame_free(&reference);
+			av_frame_free(&dst);
+			sws_freeContext(sws);
+			continue;
+		}
+
+		//Same settings as the writer's sws path
+		sws_setColorspaceDetails(sws, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+			sws_getCoefficients(SWS_CS_ITU601), 0, 0, 1 << 16, 1 << 16);
+
+		sws_scale(sws, src->data, src->linesize, 0, res.height, reference->data, reference->linesize);
+
+		auto start = clock::now();
+		for (int i = 0; i < iterations; ++i)
+			sws_scale(sws, src->data, src->linesize, 0, res.height, reference->data, reference->linesize);
+		const double swsTime = Milliseconds(clock::now() - start) / iterations;
+
+		const double megapixels = static_cast<double>(res.width) * res.height / 1e6;
+		m_logger->WriteInfo(QString("%1x%2 (%3): sws_scale %4 ms/frame, %5 MP/s\r\n")
+			.arg(res.width).arg(res.height).arg(res.name)
+			.arg(swsTime, 0, 'f', 3).arg(megapixels * 1000.0 / swsTime, 0, 'f', 0));
+
+		for (auto level = SimdLevel::Scalar; level <= detected; level = static_cast<SimdLevel>(static_cast<int>(level) + 1))
+		{
+			ColorConverter converter;
+			converter.Initialize(AV_PIX_FMT_RGBA, res.width, YuvMatrix::BT601, YuvRange::Limited, 1, 1, level);
+			converter.Convert(src, dst);
+
+			start = clock::now();
+			for (int i = 0; i < iterations; ++i)
+				converter.Convert(src, dst);
+			const double time = Milliseconds(clock::now() - start) / iterations;
+
+			//sws rounds differently, a couple of levels is expected
+			m_logger->WriteInfo(QString("    %1: %2 ms/frame, %3 MP/s, x%4 vs sws, max luma difference %5\r\n")
+				.arg(ColorConverter::GetSimdLevelName(level))
+				.arg(time, 0, 'f', 3).arg(megapixels * 1000.0 / time, 0, 'f', 0)
+				.arg(swsTime / time, 0, 'f', 2)
+				.arg(MaxLumaDifference(reference, dst)));
+		}
+
+		av_frame_free(&src);
+		av_frame_free(&reference);
+		av_frame_free(&dst);
+		sws_freeContext(sws);
+	}
+
+	RunBoxDownscale(iterations);
+}
+
+void Benchmark::RunBoxDownscale(const int iterations)
+{
+	const auto& res = Resolutions[1];
+
+	SyntheticFrameSource source(m_logger);
+	source.Initialize(res.width, res.height);
+
+	auto src = AllocFrame(AV_PIX_FMT_RGBA, res.width, res.height);
+	if (!source.IsInitialized() || !src || !source.CaptureFrame(src))
+	{
+		m_logger->WriteError("Benchmark setup failed\r\n");
+		av_frame_free(&src);
+		return;
+	}
+
+	for (const int factor : { 2, 4 })
+	{
+		const int width = res.width / factor;
+		const int height = res.height / factor;
+
+		auto reference = AllocFrame(AV_PIX_FMT_YUV420P, width, height);
+		auto dst = AllocFrame(AV_PIX_FMT_YUV420P, width, height);
+		const auto sws = sws_getContext(res.width, res.height, AV_PIX_FMT_RGBA,
+			width, height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+
+		ColorConverter converter;
+		if (!reference || !dst || !sws || !converter.Initialize(AV_PIX_FMT_RGBA, res.width, YuvMatrix::BT601, YuvRange::Limited, factor))
+		{
+			m_logger->WriteError(QString("Benchmark setup failed at %1x%2\r\n").arg(width).arg(height));
+			av_frame_free(&reference);
+			av_frame_free(&dst);
+			sws_freeContext(sws);
+			continue;
+		}
+
+		sws_setColorspaceDetails(sws, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+			sws_getCoefficients(SWS_CS_ITU601), 0, 0, 1 << 16, 1 << 16);
+
+		sws_scale(sws, src->data, src->linesize, 0, res.height, reference->data, reference->linesize);
+		converter.Convert(src, dst);
+
+		auto start = clock::now();
+		for (int i = 0; i < iterations; ++i)
+			sws_scale(sws, src->data, src->linesize, 0, res.height, reference->data, reference->linesize);
+		const double swsTime = Milliseconds(clock::now() - start) / iterations;
+
+		start = clock::now();
+		for (int i = 0; i < iterations; ++i)
+			converter.Convert(src, dst);
+		const double time = Milliseconds(clock::now() - start) / iterations;
+
+		//sws bilinear and the box filter differ on sharp edges
+		m_logger->WriteInfo(QString("%1x%2 -> %3x%4: sws_scale %5 ms/frame, %6x box %7 %8 ms/frame, x%9 vs sws, max luma difference %10\r\n")
+			.arg(res.width).arg(res.height).arg(width).arg(height)
+			.arg(swsTime, 0, 'f', 3).arg(factor)
+			.arg(ColorConverter::GetSimdLevelName(converter.GetSimdLevel()))
+			.arg(time, 0, 'f', 3).arg(swsTime / time, 0, 'f', 2)
+			.arg(MaxLumaDifference(reference, dst)));
+
+		av_frame_free(&reference);
+		av_frame_free(&dst);
+		sws_freeContext(sws);
+	}
+
+	av_frame_free(&src);
+}
+
+void Benchmark::RunBandedScaling(const int iterations)
+{
+	const int srcWidth = 2016, srcHeight = 2240;
+	const int dstWidth = 800, dstHeight = 600;
+	const int cores = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+
+	m_logger->WriteInfo(QString("Banded scaling benchmark %1x%2 RGBA -> %3x%4 YUV420P, %5 iterations, %6 cores\r\n")
+		.arg(srcWidth).arg(srcHeight).arg(dstWidth).arg(dstHeight).arg(iterations).arg(cores));
+
+	SyntheticFrameSource source(m_logger);
+	source.Initialize(srcWidth, srcHeight);
+
+	auto src = AllocFrame(AV_PIX_FMT_RGBA, srcWidth, srcHeight);
+	auto dst = AllocFrame(AV_PIX_FMT_YUV420P, dstWidth, dstHeight);
+	if (!source.IsInitialized() || !src || !dst || !source.CaptureFrame(src))
+	{
+		m_logger->WriteError("Benchmark setup failed\r\n");
+		av_frame_free(&src);
+		av_frame_free(&dst);
+		return;
+	}
+
+	double singleTime = 0.0;
+	for (int bands = 1; bands <= cores; bands *= 2)
+	{
+		SliceScaler scaler;
+		WorkerPool workers;
+		if (!scaler.Initialize(srcWidth, srcHeight, AV_PIX_FMT_RGBA, dstWidth, dstHeight, AV_PIX_FMT_YUV420P,
+			bands, SWS_FAST_BILINEAR, YuvMatrix::BT601, YuvRange::Limited))
+		{
+			m_logger->WriteError(QString("Could not set up %1 bands\r\n").arg(bands));
+			break;
+		}
+
+		workers.Start(bands);
+
+		const auto scale = [&]()
+		{
+			workers.Run(scaler.GetBandCount(), [&](const int band) { scaler.Scale(src, dst, band); });
+		};
+
+		scale();
+
+		const auto start = clock::now();
+		for (int i = 0; i < iterations; ++i)
+			scale();
+		const double time = Milliseconds(clock::now() - start) / iterations;
+
+		if (bands == 1)
+			singleTime = time;
+
+		m_logger->WriteInfo(QString("    %1 bands: %2 ms/frame, x%3 vs one band\r\n")
+			.arg(scaler.GetBandCount()).arg(time, 0, 'f', 3).arg(singleTime / time, 0, 'f', 2));
+	}
+
+	av_frame_free(&src);
+	av_frame_free(&dst);
+}
+
+void Benchmark::RunStereoCapture(const int iterations)
+{
+	const int eyeWidth = 800, eyeHeight = 600;
+
+	m_logger->WriteInfo(QString("Stereo capture benchmark, RGBA -> %1x%2 YUV420P per eye, %3 iterations\r\n")
+		.arg(eyeWidth).arg(eyeHeight).arg(iterations));
+
+	for (const auto& res : { Resolutions[0], Resolutions[1] })
+	{
+		double monoTime = 0.0;
+		for (const bool stereo : { false, true })
+		{
+			const int eyes = stereo ? 2 : 1;
+
+			SyntheticFrameSource source(m_logger);
+			source.Initialize(res.width, res.height, stereo);
+
+			FrameConverter converter(m_logger);
+			auto src = AllocFrame(AV_PIX_FMT_RGBA, source.GetWidth(), source.GetHeight());
+			auto dst = av_frame_alloc();
+			if (!source.IsInitialized() || !src || !dst
+				|| !converter.Initialize(AV_PIX_FMT_RGBA, source.GetWidth(), source.GetHeight(),
+					AV_PIX_FMT_YUV420P, eyeWidth * eyes, eyeHeight, YuvMatrix::BT601, YuvRange::Limited, 0))
+			{
+				m_logger->WriteError(QString("Benchmark setup failed at %1x%2\r\n").arg(source.GetWidth()).arg(res.height));
+				av_frame_free(&src);
+				av_frame_free(&dst);
+				continue;
+			}
+
+			dst->format = AV_PIX_FMT_YUV420P;
+			dst->width = eyeWidth * eyes;
+			dst->height = eyeHeight;
+
+			//Warm up the pool and the workers
+			source.CaptureFrame(src);
+			converter.Convert(src, dst);
+
+			clock::duration captureTime(0), convertTime(0);
+			for (int i = 0; i < iterations; ++i)
+			{
+				const auto start = clock::now();
+				source.CaptureFrame(src);
+				const auto captured = clock::now();
+				converter.Convert(src, dst);
+				convertTime += clock::now() - captured;
+				captureTime += captured - start;
+			}
+
+			const double capture = Milliseconds(captureTime) / iterations;
+			const double convert = Milliseconds(convertTime) / iterations;
+			const double total = capture + convert;
+			const double megabytes = static_cast<double>(source.GetBufferRowPitch()) * res.height / (1024.0 * 1024.0);
+
+			if (!stereo)
+			{
+				monoTime = total;
+				m_logger->WriteInfo(QString("%1x%2 (%3), one eye: capture %4 ms, convert %5 ms, %6 fps, %7 MB/s\r\n")
+					.arg(res.width).arg(res.height).arg(res.name)
+					.arg(capture, 0, 'f', 3).arg(convert, 0, 'f', 3)
+					.arg(1000.0 / total, 0, 'f', 1).arg(megabytes * 1000.0 / total, 0, 'f', 0));
+			}
+			else
+			{
+				//Against recording each eye in a session of its own
+				m_logger->WriteInfo(QString("    both eyes: capture %1 ms, convert %2 ms, %3 fps, %4 MB/s, x%5 vs two sessions\r\n")
+					.arg(capture, 0, 'f', 3).arg(convert, 0, 'f', 3)
+					.arg(1000.0 / total, 0, 'f', 1).arg(megabytes * 1000.0 / total, 0, 'f', 0)
+					.arg(monoTime > 0 ? 2 * monoTime / total : 0.0, 0, 'f', 2));
+			}
+
+			av_frame_free(&src);
+			av_frame_free(&dst);
+		}
+	}
+}
+
+void Benchmark::RunLosslessRecording(const std::string& directory, const int frames)
+{
+	const auto& res = Resolutions[1];
+	const int cores = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+	const int patternFrames = 8;
+
+	m_logger->WriteInfo(QString("Lossless recording benchmark %1x%2 (%3), %4 frames, %5 cores\r\n")
+		.arg(res.width).arg(res.height).arg(res.name).arg(frames).arg(cores));
+
+	//Captured up front so the writer alone is measured
+	SyntheticFrameSource source(m_logger);
+	source.Initialize(res.width, res.height);
+
+	std::vector<AVFrame*> input;
+	for (int i = 0; i < patternFrames && source.IsInitialized(); ++i)
+	{
+		auto frame = AllocFrame(AV_PIX_FMT_RGBA, res.width, res.height);
+		if (!frame || !source.CaptureFrame(frame))
+		{
+			av_frame_free(&frame);
+			break;
+		}
+		input.push_back(frame);
+	}
+
+	if (input.size() != patternFrames)
+	{
+		m_logger->WriteError("Benchmark setup failed\r\n");
+		for (auto& frame : input)
+			av_frame_free(&frame);
+		return;
+	}
+
+	VideoWriterConfig config;
+	config.container = VideoContainer::Matroska;
+	config.bitrate = 0;
+	config.width = res.width;
+	config.height = res.height;
+	config.framerate = 90;
+	config.variable_frame_rate = false;
+	config.color_matrix = YuvMatrix::BT601;
+	config.color_range = YuvRange::Full;
+	config.conversion_bands = 0;
+	config.threading = EncoderThreading::Auto;
+	config.thread_count = 0;
+	config.row_mt = false;
+	config.preset = "ultrafast";
+	config.crf = -1;
+	config.encode_budget = false;
+	config.max_crf = -1;
+	config.min_bitrate = 0;
+	config.comment_size = 0;
+	config.segment_minutes = 0;
+	config.segment_bytes = 0;
+	config.write_buffer = 4 * 1024 * 1024;
+	config.mux_queue_bytes = 256 * 1024 * 1024;
+	config.sync_interval = 0;
+	config.expected_minutes = 0;
+	config.lossless = true;
+	config.frame_timing = false;
+
+	const double rawMegabytes = static_cast<double>(res.width) * res.height * 3 / (1024.0 * 1024.0);
+
+	for (const auto& codec : XVideoWriter::GetLosslessEncoders())
+	{
+		if (!avcodec_find_encoder_by_name(codec.c_str()))
+		{
+			m_logger->WriteInfo(QString("    %1: not in this build\r\n").arg(codec.c_str()));
+			continue;
+		}
+
+		for (const std::string hash : { "", "CRC32" })
+		{
+			config.codec_name = codec;
+			config.fastest_preset = config.preset;
+			config.frame_hash = hash;
+			config.filename = directory + "/xtgn_lossless_benchmark.mkv";
+
+			const auto start = std::chrono::steady_clock::now();
+			const double cpuStart = ProcessCpuSeconds();
+
+			XVideoWriter writer(m_logger);
+			writer.Initialize(config, AV_PIX_FMT_RGBA, res.width, res.height);
+			for (int i = 0; i < frames && writer.IsInitialized(); ++i)
+			{
+				input[i % patternFrames]->pts = i;
+				writer.WriteFrame(input[i % patternFrames]);
+			}
+			const bool complete = writer.IsInitialized() && writer.CloseFile();
+
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			const double cpu = ProcessCpuSeconds() - cpuStart;
+			const double megabytes = FileSize(config.filename) / (1024.0 * 1024.0);
+
+			std::remove(config.filename.c_str());
+			std::remove((directory + "/xtgn_lossless_benchmark.framehash").c_str());
+
+			if (!complete)
+			{
+				m_logger->WriteError(QString("    %1: recording failed\r\n").arg(codec.c_str()));
+				break;
+			}
+
+			//The bars compress far better than headset content; MB/s to disk
+			//is the lower bound, MB/s of RGB in the upper one
+			m_logger->WriteInfo(QString("    %1%2: %3 fps, %4 MB/s to disk, %5 MB/s RGB in, %6:1, CPU %7% of all cores\r\n")
+				.arg(codec.c_str()).arg(hash.empty() ? "" : QString(" + %1").arg(hash.c_str()))
+				.arg(frames / seconds, 0, 'f', 1)
+				.arg(megabytes / seconds, 0, 'f', 1)
+				.arg(rawMegabytes * frames / seconds, 0, 'f', 0)
+				.arg(megabytes > 0 ? rawMegabytes * frames / megabytes : 0.0, 0, 'f', 1)
+				.arg(cpu * 100 / (seconds * cores), 0, 'f', 0));
+		}
+	}
+
+	for (auto& frame : input)
+		av_frame_free(&frame);
+}
@@ -0,0 +1,39 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include "Logger.h"
+
+#include <string>
+
+//Micro-benchmarks of the recording hot paths on synthetic frames, run from
+//the Tools menu. Results are written to the log.
+class Benchmark
+{
+public:
+	Benchmark(Logger* logger);
+
+	//SIMD RGBA -> YUV420P kernels against sws_scale at headset mirror sizes,
+	//then the fused 2x/4x box downscale against sws
+	void RunColorConversion(int iterations = 50);
+
+	//Banded sws_scale on a worker pool, mirror texture down to the default
+	//800x600, from one band up to one per core
+	void RunBandedScaling(int iterations = 50);
+
+	//Capture and conversion to the default 800x600 per eye, one eye against
+	//both side by side, at headset eye sizes; checks that both halves of
+	//every stereo frame carry the same frame number
+	void RunStereoCapture(int iterations = 100);
+
+	//Lossless recording of a headset eye with each lossless encoder, with and
+	//without frame checksums: frames per second, MB/s reaching the disk and
+	//CPU use. Files go to directory and are removed afterwards
+	void RunLosslessRecording(const std::string& directory, int frames = 180);
+
+private:
+	Logger* m_logger;
+
+	void RunBoxDownscale(int iterations);
+};
+
+#endif	//__BENCHMARK_H__
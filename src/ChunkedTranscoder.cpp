@@ -0,0 +1,515 @@
+#include "ChunkedTranscoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+	//More chunks than jobs, so a slow chunk near the end does not leave
+	//every other core waiting for it
+	const int ChunksPerJob = 4;
+	//Shortest chunk when none is given; every chunk start costs a keyframe
+	//the encoder would not have placed there
+	const int DefaultChunkSeconds = 2;
+
+	double SecondsSince(const std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+ChunkedTranscoder::ChunkedTranscoder(Logger* logger)
+	: m_logger(logger), m_spool(false), m_time_base{ 0, 1 }, m_first_pts(0), m_format(AV_PIX_FMT_NONE),
+	m_width(0), m_height(0), m_framerate(0)
+{
+}
+
+bool ChunkedTranscoder::Run(const TranscodeConfig& config, TranscodeReport& report)
+{
+	report = TranscodeReport{};
+
+	const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	int jobs = config.jobs > 0 ? config.jobs : cores;
+
+	std::vector<TranscodeChunk> chunks;
+	if (!Plan(config, jobs, chunks))
+		return false;
+
+	//Short inputs give fewer chunks than cores; the encoders get the rest
+	jobs = std::min(jobs, static_cast<int>(chunks.size()));
+	const int threads = std::max(1, cores / jobs);
+
+	m_logger->WriteInfo(QString("Transcoding %1 in %2 chunks, %3 at once with %4 encoder threads each\r\n")
+		.arg(config.input.c_str()).arg(chunks.size()).arg(jobs).arg(threads));
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < jobs; ++i)
+	{
+		workers.emplace_back([&]()
+		{
+			for (auto index = next++; index < chunks.size(); index = next++)
+				EncodeChunk(config, threads, chunks[index]);
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+
+	bool complete = true;
+	for (const auto& chunk : chunks)
+	{
+		m_logger->WriteInfo(QString("Chunk %1: %2 frames in %3 s, %4 fps\r\n")
+			.arg(chunk.filename.c_str()).arg(static_cast<qlonglong>(chunk.encoded))
+			.arg(chunk.seconds, 0, 'f', 2).arg(chunk.seconds > 0 ? chunk.encoded / chunk.seconds : 0.0, 0, 'f', 1));
+		complete = complete && chunk.ok;
+		report.frames += chunk.encoded;
+	}
+
+	int64_t packets = 0;
+	if (complete)
+		complete = Stitch(chunks, config, packets);
+	else
+		m_logger->WriteError("Not every chunk was encoded, nothing is stitched\r\n");
+
+	report.seconds = SecondsSince(start);
+
+	if (complete && packets != report.frames)
+	{
+		m_logger->WriteError(QString("Stitched %1 packets of %2 encoded frames\r\n")
+			.arg(static_cast<qlonglong>(packets)).arg(static_cast<qlonglong>(report.frames)));
+		complete = false;
+	}
+
+	if (!config.keep_chunks)
+	{
+		for (const auto& chunk : chunks)
+			std::remove(chunk.filename.c_str());
+	}
+
+	report.chunks = static_cast<int>(chunks.size());
+	report.jobs = jobs;
+	report.fps = report.seconds > 0 ? report.frames / report.seconds : 0;
+
+	//The same first chunk with one encoder given every core, as a recording
+	//would be encoded without chunking
+	if (complete && config.baseline)
+	{
+		auto baseline = chunks.front();
+		baseline.filename = config.output + ".baseline.mkv";
+		if (EncodeChunk(config, 0, baseline) && baseline.seconds > 0)
+		{
+			report.baseline_fps = baseline.encoded / baseline.seconds;
+			report.speedup = report.fps / report.baseline_fps;
+		}
+		std::remove(baseline.filename.c_str());
+	}
+
+	m_logger->WriteInfo(QString("Transcoded %1 frames in %2 s: %3 fps with %4 jobs\r\n")
+		.arg(static_cast<qlonglong>(report.frames)).arg(report.seconds, 0, 'f', 2)
+		.arg(report.fps, 0, 'f', 1).arg(jobs));
+	if (report.baseline_fps > 0)
+	{
+		m_logger->WriteInfo(QString("Single encoder: %1 fps, speedup %2x\r\n")
+			.arg(report.baseline_fps, 0, 'f', 1).arg(report.speedup, 0, 'f', 2));
+	}
+
+	return complete;
+}
+
+bool ChunkedTranscoder::Plan(const TranscodeConfig& config, const int jobs, std::vector<TranscodeChunk>& chunks)
+{
+	chunks.clear();
+
+	//A spool is known by its header, anything else goes to libavformat
+	m_spool = m_spool_file.Open(config.input);
+
+	const int parts = jobs * ChunksPerJob;
+	const bool planned = m_spool
+		? PlanSpool(config.chunk_frames, parts, chunks)
+		: PlanFile(config.input, config.chunk_frames, parts, chunks);
+	if (!planned)
+		return false;
+
+	if (chunks.empty())
+	{
+		m_logger->WriteError(QString("Nothing to transcode in %1\r\n").arg(config.input.c_str()));
+		return false;
+	}
+
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		char name[16];
+		std::snprintf(name, sizeof(name), ".part%03d.mkv", static_cast<int>(i));
+		chunks[i].filename = config.output + name;
+	}
+
+	return true;
+}
+
+bool ChunkedTranscoder::PlanFile(const std::string& filename, int64_t minFrames, const int parts, std::vector<TranscodeChunk>& chunks)
+{
+	AVFormatContext* ftx = nullptr;
+	if (avformat_open_input(&ftx, filename.c_str(), nullptr, nullptr) < 0)
+	{
+		m_logger->WriteError(QString("Could not open %1\r\n").arg(filename.c_str()));
+		return false;
+	}
+
+	AVCodec* codec = nullptr;
+	const int index = avformat_find_stream_info(ftx, nullptr) < 0 ? -1
+		: av_find_best_stream(ftx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+	if (index < 0 || !codec)
+	{
+		m_logger->WriteError(QString("No video stream to transcode in %1\r\n").arg(filename.c_str()));
+		avformat_close_input(&ftx);
+		return false;
+	}
+
+	const auto stream = ftx->streams[index];
+	m_time_base = stream->time_base;
+	m_format = static_cast<AVPixelFormat>(stream->codecpar->format);
+	m_width = stream->codecpar->width;
+	m_height = stream->codecpar->height;
+	m_framerate = stream->avg_frame_rate.den > 0
+		? std::max(1, static_cast<int>(av_q2d(stream->avg_frame_rate) + 0.5)) : 30;
+
+	//Only packets are read here: where the keyframes are and how many frames
+	//follow each of them
+	std::vector<std::pair<int64_t, int64_t>> gops;
+	m_first_pts = AV_NOPTS_VALUE;
+	AVPacket pkt;
+	av_init_packet(&pkt);
+	while (av_read_frame(ftx, &pkt) >= 0)
+	{
+		const auto pts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+		if (pkt.stream_index == index && pts != AV_NOPTS_VALUE)
+		{
+			if (pkt.flags & AV_PKT_FLAG_KEY)
+				gops.emplace_back(pts, 0);
+			if (!gops.empty())
+				++gops.back().second;
+			if (m_first_pts == AV_NOPTS_VALUE || pts < m_first_pts)
+				m_first_pts = pts;
+		}
+		av_packet_unref(&pkt);
+	}
+	avformat_close_input(&ftx);
+
+	int64_t total = 0;
+	for (const auto& gop : gops)
+		total += gop.second;
+
+	if (minFrames <= 0)
+		minFrames = static_cast<int64_t>(m_framerate) * DefaultChunkSeconds;
+	const auto target = std::max(minFrames, total / std::max(1, parts));
+
+	//Whole GOPs until the chunk is long enough; it ends where the next
+	//keyframe starts the next chunk
+	for (size_t i = 0; i < gops.size(); ++i)
+	{
+		if (chunks.empty() || chunks.back().frames >= target)
+			chunks.push_back(TranscodeChunk{ gops[i].first, AV_NOPTS_VALUE, 0, std::string(), 0, 0, false });
+
+		chunks.back().frames += gops[i].second;
+		chunks.back().end = i + 1 < gops.size() ? gops[i + 1].first : AV_NOPTS_VALUE;
+	}
+
+	if (!chunks.empty() && m_first_pts < chunks.front().start)
+	{
+		m_logger->WriteInfo(QString("%1 does not start with a keyframe, frames before the first one are left out\r\n")
+			.arg(filename.c_str()));
+		m_first_pts = chunks.front().start;
+	}
+
+	m_logger->WriteInfo(QString("%1: %2 frames in %3 GOPs, %4x%5 at %6 fps\r\n")
+		.arg(filename.c_str()).arg(static_cast<qlonglong>(total)).arg(gops.size())
+		.arg(m_width).arg(m_height).arg(m_framerate));
+	return true;
+}
+
+bool ChunkedTranscoder::PlanSpool(int64_t minFrames, const int parts, std::vector<TranscodeChunk>& chunks)
+{
+	const auto& format = m_spool_file.GetFormat();
+	m_time_base = AVRational{ format.time_base_num, format.time_base_den };
+	m_format = static_cast<AVPixelFormat>(format.format);
+	m_width = format.width;
+	m_height = format.height;
+	m_framerate = std::max(1, static_cast<int>(format.framerate));
+
+	const auto first = m_spool_file.GetFirstFrame();
+	const auto count = m_spool_file.GetFrameCount();
+
+	AVFrame frame = {};
+	int64_t timestamp;
+	if (first >= count || !m_spool_file.GetFrame(first, &frame, m_first_pts, timestamp))
+	{
+		m_logger->WriteError(QString("Spool %1 holds no frames\r\n").arg(m_spool_file.GetFilename().c_str()));
+		return false;
+	}
+
+	if (first > 0)
+	{
+		m_logger->WriteInfo(QString("Spool %1 went round, its first %2 frames were overwritten\r\n")
+			.arg(m_spool_file.GetFilename().c_str()).arg(static_cast<qulonglong>(first)));
+	}
+
+	//Every spooled frame is a picture of its own, so chunks can start anywhere
+	const auto total = static_cast<int64_t>(count - first);
+	if (minFrames <= 0)
+		minFrames = static_cast<int64_t>(m_framerate) * DefaultChunkSeconds;
+	const auto target = std::max(minFrames, total / std::max(1, parts));
+
+	for (auto start = static_cast<int64_t>(first); start < static_cast<int64_t>(count); start += target)
+	{
+		const auto end = std::min(start + target, static_cast<int64_t>(count));
+		chunks.push_back(TranscodeChunk{ start, end, end - start, std::string(), 0, 0, false });
+	}
+
+	m_logger->WriteInfo(QString("%1: %2 spooled frames, %3x%4 at %5 fps\r\n")
+		.arg(m_spool_file.GetFilename().c_str()).arg(static_cast<qlonglong>(total))
+		.arg(m_width).arg(m_height).arg(m_framerate));
+	return true;
+}
+
+bool ChunkedTranscoder::EncodeChunk(const TranscodeConfig& config, const int threads, TranscodeChunk& chunk)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	chunk.encoded = 0;
+	chunk.ok = m_spool ? EncodeSpoolChunk(config, threads, chunk) : EncodeFileChunk(config, threads, chunk);
+	chunk.seconds = SecondsSince(start);
+
+	if (!chunk.ok)
+		m_logger->WriteError(QString("Chunk %1 failed\r\n").arg(chunk.filename.c_str()));
+	return chunk.ok;
+}
+
+VideoWriterConfig ChunkedTranscoder::GetChunkConfig(const TranscodeConfig& config, const int threads, const std::string& filename) const
+{
+	auto writer = config.writer;
+	writer.filename = filename;
+	writer.container = VideoContainer::Matroska;
+	writer.width = writer.width > 0 ? writer.width : m_width;
+	writer.height = writer.height > 0 ? writer.height : m_height;
+	writer.framerate = writer.framerate > 0 ? writer.framerate : m_framerate;
+	writer.variable_frame_rate = true;
+
+	//Parallel chunks share the cores between them; the baseline takes them all
+	if (writer.threading == EncoderThreading::AutoTune)
+		writer.threading = EncoderThreading::Auto;
+	writer.thread_count = threads;
+	writer.conversion_bands = threads;
+
+	//Every chunk has to come out of the same settings to be joined
+	writer.encode_budget = false;
+	writer.comment_size = 0;
+	writer.segment_minutes = 0;
+	writer.segment_bytes = 0;
+	writer.sync_interval = 0;
+	writer.expected_minutes = 0;
+	//One sidecar for the joined file would need the chunks in order
+	writer.frame_hash.clear();
+	writer.frame_timing = false;
+	return writer;
+}
+
+bool ChunkedTranscoder::EncodeFileChunk(const TranscodeConfig& config, const int threads, TranscodeChunk& chunk)
+{
+	AVFormatContext* ftx = nullptr;
+	if (avformat_open_input(&ftx, config.input.c_str(), nullptr, nullptr) < 0)
+		return false;
+
+	AVCodec* codec = nullptr;
+	AVCodecContext* ctx = nullptr;
+	const int index = avformat_find_stream_info(ftx, nullptr) < 0 ? -1
+		: av_find_best_stream(ftx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+	if (index >= 0 && codec)
+		ctx = avcodec_alloc_context3(codec);
+	if (ctx && avcodec_parameters_to_context(ctx, ftx->streams[index]->codecpar) < 0)
+		avcodec_free_context(&ctx);
+
+	//Decoding is cheap next to encoding; the decoder gets one thread
+	if (ctx)
+		ctx->thread_count = 1;
+
+	if (!ctx || avcodec_open2(ctx, codec, nullptr) < 0
+		|| av_seek_frame(ftx, index, chunk.start, AVSEEK_FLAG_BACKWARD) < 0)
+	{
+		m_logger->WriteError(QString("Could not decode %1 from %2\r\n")
+			.arg(config.input.c_str()).arg(static_cast<qlonglong>(chunk.start)));
+		avcodec_free_context(&ctx);
+		avformat_close_input(&ftx);
+		return false;
+	}
+
+	XVideoWriter writer(m_logger);
+	writer.Initialize(GetChunkConfig(config, threads, chunk.filename), ctx->pix_fmt, ctx->width, ctx->height);
+
+	auto frame = av_frame_alloc();
+	AVPacket pkt;
+	av_init_packet(&pkt);
+
+	//The seek may land on an earlier keyframe, and frames are kept by pts
+	//alone. With open GOPs the leading B-frames of the next keyframe belong
+	//here but are decoded after it, so decoding goes on past the keyframe at
+	//the end until a frame later than it comes out. The next chunk cannot
+	//decode them and leaves them out, being before its start
+	bool done = !writer.IsInitialized() || !frame;
+	while (!done)
+	{
+		const bool eof = av_read_frame(ftx, &pkt) < 0;
+		if (!eof && pkt.stream_index != index)
+		{
+			av_packet_unref(&pkt);
+			continue;
+		}
+
+		avcodec_send_packet(ctx, eof ? nullptr : &pkt);
+		av_packet_unref(&pkt);
+
+		while (!done && avcodec_receive_frame(ctx, frame) == 0)
+		{
+			const auto pts = frame->best_effort_timestamp;
+			if (chunk.end != AV_NOPTS_VALUE && pts > chunk.end)
+				done = true;
+			else if (pts != AV_NOPTS_VALUE && pts >= chunk.start
+				&& (chunk.end == AV_NOPTS_VALUE || pts < chunk.end))
+			{
+				frame->pts = av_rescale_q(pts - m_first_pts, m_time_base, XVideoWriter::VfrTimeBase);
+				writer.WriteFrame(frame);
+				++chunk.encoded;
+			}
+			av_frame_unref(frame);
+		}
+
+		done = done || eof || !writer.IsInitialized();
+	}
+
+	const bool ok = writer.IsInitialized() && writer.CloseFile();
+
+	av_frame_free(&frame);
+	avcodec_free_context(&ctx);
+	avformat_close_input(&ftx);
+	return ok;
+}
+
+bool ChunkedTranscoder::EncodeSpoolChunk(const TranscodeConfig& config, const int threads, TranscodeChunk& chunk)
+{
+	XVideoWriter writer(m_logger);
+	writer.Initialize(GetChunkConfig(config, threads, chunk.filename), m_format, m_width, m_height);
+	if (!writer.IsInitialized())
+		return false;
+
+	//Frames point into the mapping, nothing is copied before conversion
+	int64_t missing = 0;
+	for (auto index = chunk.start; index < chunk.end && writer.IsInitialized(); ++index)
+	{
+		AVFrame frame = {};
+		int64_t pts, timestamp;
+		if (!m_spool_file.GetFrame(static_cast<uint64_t>(index), &frame, pts, timestamp))
+		{
+			++missing;
+			continue;
+		}
+
+		frame.pts = av_rescale_q(pts - m_first_pts, m_time_base, XVideoWriter::VfrTimeBase);
+		writer.WriteFrame(&frame);
+		++chunk.encoded;
+	}
+
+	if (missing)
+	{
+		m_logger->WriteError(QString("Chunk %1: %2 spooled frames were never completely written\r\n")
+			.arg(chunk.filename.c_str()).arg(static_cast<qlonglong>(missing)));
+	}
+
+	return writer.IsInitialized() && writer.CloseFile();
+}
+
+bool ChunkedTranscoder::Stitch(const std::vector<TranscodeChunk>& chunks, const TranscodeConfig& config, int64_t& packets)
+{
+	packets = 0;
+
+	//Chunk timestamps are variable, which AVI cannot hold
+	auto container = config.writer.container;
+	if (container == VideoContainer::Avi)
+	{
+		m_logger->WriteInfo("AVI cannot hold variable frame rate, writing Matroska\r\n");
+		container = VideoContainer::Matroska;
+	}
+
+	OutputFile output(m_logger);
+	int64_t lastDts = AV_NOPTS_VALUE;
+	int64_t overlaps = 0;
+	bool ok = true;
+
+	AVPacket pkt;
+	av_init_packet(&pkt);
+
+	for (const auto& chunk : chunks)
+	{
+		AVFormatContext* ftx = nullptr;
+		if (avformat_open_input(&ftx, chunk.filename.c_str(), nullptr, nullptr) < 0 || ftx->nb_streams < 1)
+		{
+			m_logger->WriteError(QString("Could not open chunk %1\r\n").arg(chunk.filename.c_str()));
+			avformat_close_input(&ftx);
+			ok = false;
+			break;
+		}
+
+		const auto stream = ftx->streams[0];
+
+		//Every chunk starts with the same parameter sets, the first one's go
+		//in the header
+		if (!output.IsOpen())
+		{
+			const OutputFileConfig outputConfig{ 0, 4 * 1024 * 1024, 0 };
+			if (!output.Open(config.output, container, stream->codecpar, XVideoWriter::VfrTimeBase,
+				AVRational{ GetChunkConfig(config, 0, std::string()).framerate, 1 }, outputConfig))
+			{
+				avformat_close_input(&ftx);
+				ok = false;
+				break;
+			}
+		}
+
+		//Chunks carry input timestamps, so they are copied as they are.
+		//Anything going back in time would be an overlap between chunks
+		while (ok && av_read_frame(ftx, &pkt) >= 0)
+		{
+			const auto dts = av_rescale_q(pkt.dts, stream->time_base, XVideoWriter::VfrTimeBase);
+			if (pkt.dts != AV_NOPTS_VALUE && lastDts != AV_NOPTS_VALUE && dts <= lastDts)
+			{
+				++overlaps;
+				av_packet_unref(&pkt);
+				continue;
+			}
+			if (pkt.dts != AV_NOPTS_VALUE)
+				lastDts = dts;
+
+			ok = output.WritePacket(&pkt, stream->time_base);
+			av_packet_unref(&pkt);
+			++packets;
+		}
+
+		avformat_close_input(&ftx);
+		if (!ok)
+			break;
+	}
+
+	if (overlaps)
+	{
+		m_logger->WriteError(QString("Stitching dropped %1 packets that overlapped the chunk before\r\n")
+			.arg(static_cast<qlonglong>(overlaps)));
+	}
+
+	ok = output.Close(std::string()) && ok;
+	if (!ok)
+		m_logger->WriteError(QString("Could not stitch %1\r\n").arg(config.output.c_str()));
+	return ok;
+}
@@ -0,0 +1,87 @@
+#ifndef __CHUNKED_TRANSCODER_H__
+#define __CHUNKED_TRANSCODER_H__
+
+#include "Logger.h"
+#include "XVideoWriter.h"
+#include "SpoolFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TranscodeConfig
+{
+	std::string input;	//Any recording ffmpeg reads, or a kept .spool file
+	std::string output;
+	//Encoder settings of every chunk. filename is set per chunk and the frame
+	//rate is always variable, so chunks keep the input's timestamps
+	VideoWriterConfig writer;
+	int jobs;			//Chunks encoded at once, 0 - one per core
+	int chunk_frames;	//Smallest chunk, 0 - picked from the input length
+	bool baseline;		//Encode the first chunk again with one full encoder to compare
+	bool keep_chunks;
+};
+
+struct TranscodeChunk
+{
+	//Input pts of the first frame and of the first frame of the next chunk,
+	//AV_NOPTS_VALUE at the end. Spool chunks count frames instead
+	int64_t start;
+	int64_t end;
+	int64_t frames;		//Frames the plan expects, exact for spools
+	std::string filename;
+	int64_t encoded;
+	double seconds;
+	bool ok;
+};
+
+struct TranscodeReport
+{
+	int64_t frames;
+	int chunks;
+	int jobs;
+	double seconds;			//Wall time of the parallel encode and the stitching
+	double fps;
+	double baseline_fps;	//0 - not measured
+	double speedup;
+};
+
+//Cuts a recording into chunks starting at keyframes, encodes them at once
+//with one XVideoWriter each and joins them with stream copy. Every chunk is
+//encoded with input timestamps, so the joined file has neither gaps nor
+//overlaps
+class ChunkedTranscoder
+{
+public:
+	ChunkedTranscoder(Logger* logger);
+
+	bool Run(const TranscodeConfig& config, TranscodeReport& report);
+
+private:
+	Logger* m_logger;
+
+	//Input as found by Plan()
+	bool m_spool;
+	SpoolFile m_spool_file;	//Mapped once, read by every chunk
+	AVRational m_time_base;	//Of the input pts chunks are cut at
+	int64_t m_first_pts;	//Becomes 0 in the output
+	AVPixelFormat m_format;
+	int m_width;
+	int m_height;
+	int m_framerate;
+
+	//Cuts the input into about jobs * ChunksPerJob chunks of whole GOPs
+	bool Plan(const TranscodeConfig& config, int jobs, std::vector<TranscodeChunk>& chunks);
+	bool PlanFile(const std::string& filename, int64_t minFrames, int parts, std::vector<TranscodeChunk>& chunks);
+	bool PlanSpool(int64_t minFrames, int parts, std::vector<TranscodeChunk>& chunks);
+
+	//threads is the encoder's own thread count, 0 - codec default
+	bool EncodeChunk(const TranscodeConfig& config, int threads, TranscodeChunk& chunk);
+	bool EncodeFileChunk(const TranscodeConfig& config, int threads, TranscodeChunk& chunk);
+	bool EncodeSpoolChunk(const TranscodeConfig& config, int threads, TranscodeChunk& chunk);
+	VideoWriterConfig GetChunkConfig(const TranscodeConfig& config, int threads, const std::string& filename) const;
+
+	bool Stitch(const std::vector<TranscodeChunk>& chunks, const TranscodeConfig& config, int64_t& packets);
+};
+
+#endif	//__CHUNKED_TRANSCODER_H__
@@ -0,0 +1,711 @@
+#include "ColorConverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define XTGN_X86
+#endif
+
+#ifdef XTGN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//MSVC compiles any intrinsic without /arch flags, GCC and Clang need every
+//function that uses them marked with its instruction set
+#if defined(XTGN_X86) && defined(__GNUC__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+namespace
+{
+	const int Shift = 15;
+	const int ChromaShift = Shift + 2;	//2x2 sum
+
+	inline uint8_t Clamp(const int value)
+	{
+		return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+	}
+
+	//Pixels are either 8-bit RGBA or the 16-bit channel sums of a box, the
+	//coefficient shifts account for the box size
+	template <typename T>
+	inline uint8_t Luma(const yuv_coefficients& c, const T* p)
+	{
+		return Clamp((c.y[0] * p[0] + c.y[1] * p[1] + c.y[2] * p[2] + c.y[3] * p[3] + c.y_bias) >> c.y_shift);
+	}
+
+	inline uint8_t Chroma(const yuv_coefficients& c, const int16_t* w, const int* sum)
+	{
+		return Clamp((w[0] * sum[0] + w[1] * sum[1] + w[2] * sum[2] + w[3] * sum[3] + c.uv_bias) >> c.uv_shift);
+	}
+
+	//Pixels [x, width) of a row pair; an odd last column is paired with itself
+	template <typename T>
+	void ConvertTail(const yuv_coefficients& c, const T* src0, const T* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int x, const int width)
+	{
+		for (; x < width; x += 2)
+		{
+			const int x1 = x + 1 < width ? x + 1 : x;
+			const T* p00 = src0 + 4 * x;
+			const T* p01 = src0 + 4 * x1;
+			const T* p10 = src1 + 4 * x;
+			const T* p11 = src1 + 4 * x1;
+
+			y0[x] = Luma(c, p00);
+			y1[x] = Luma(c, p10);
+			if (x1 != x)
+			{
+				y0[x1] = Luma(c, p01);
+				y1[x1] = Luma(c, p11);
+			}
+
+			int sum[4];
+			for (int i = 0; i < 4; ++i)
+				sum[i] = p00[i] + p01[i] + p10[i] + p11[i];
+
+			u[x / 2] = Chroma(c, c.u, sum);
+			v[x / 2] = Chroma(c, c.v, sum);
+		}
+	}
+
+	void ConvertRowsScalar(const yuv_coefficients& c, const uint8_t* src0, const uint8_t* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, const int width)
+	{
+		ConvertTail(c, src0, src1, y0, y1, u, v, 0, width);
+	}
+
+	void ConvertSumRowsScalar(const yuv_coefficients& c, const uint16_t* src0, const uint16_t* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, const int width)
+	{
+		ConvertTail(c, src0, src1, y0, y1, u, v, 0, width);
+	}
+
+	//Channel sums of factor x factor blocks for output pixels [x, width); at
+	//most 16 * 255, so they stay in 16 bits all the way into pmaddwd
+	void BoxSumTail(const uint8_t* src, const ptrdiff_t pitch, const int factor, int x, const int width, uint16_t* sums)
+	{
+		for (; x < width; ++x)
+		{
+			int sum[4] = {};
+			for (int r = 0; r < factor; ++r)
+			{
+				const uint8_t* p = src + r * pitch + 4 * x * factor;
+				for (int k = 0; k < factor; ++k, p += 4)
+				{
+					for (int i = 0; i < 4; ++i)
+						sum[i] += p[i];
+				}
+			}
+
+			for (int i = 0; i < 4; ++i)
+				sums[4 * x + i] = static_cast<uint16_t>(sum[i]);
+		}
+	}
+
+	void BoxSumScalar(const uint8_t* src, const ptrdiff_t pitch, const int factor, const int width, uint16_t* sums)
+	{
+		BoxSumTail(src, pitch, factor, 0, width, sums);
+	}
+
+#ifdef XTGN_X86
+	//All kernels share one scheme: widen bytes to words, pmaddwd against the
+	//per-channel weights, and add the two halves of each pixel. Chroma sums
+	//the two rows as words first and then neighbouring pixels as dwords.
+
+	TARGET_SSE41 inline __m128i Weights128(const int16_t* w)
+	{
+		return _mm_setr_epi16(w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3]);
+	}
+
+	//Four pixels as words in two registers -> four dword sums in pixel order
+	TARGET_SSE41 inline __m128i Dot4(const __m128i lo, const __m128i hi, const __m128i w)
+	{
+		return _mm_hadd_epi32(_mm_madd_epi16(lo, w), _mm_madd_epi16(hi, w));
+	}
+
+	struct sse_constants
+	{
+		__m128i wy, wu, wv;
+		__m128i y_bias, uv_bias;
+		__m128i y_shift, uv_shift;
+	};
+
+	TARGET_SSE41 inline sse_constants Constants128(const yuv_coefficients& c)
+	{
+		sse_constants k;
+		k.wy = Weights128(c.y);
+		k.wu = Weights128(c.u);
+		k.wv = Weights128(c.v);
+		k.y_bias = _mm_set1_epi32(c.y_bias);
+		k.uv_bias = _mm_set1_epi32(c.uv_bias);
+		k.y_shift = _mm_cvtsi32_si128(c.y_shift);
+		k.uv_shift = _mm_cvtsi32_si128(c.uv_shift);
+		return k;
+	}
+
+	//Eight pixels of a row pair as words, two pixels per register:
+	//a = pixels 0..3, b = 4..7; row 0 and row 1
+	TARGET_SSE41 inline void ConvertPixels8(const sse_constants& k,
+		const __m128i a0l, const __m128i a0h, const __m128i b0l, const __m128i b0h,
+		const __m128i a1l, const __m128i a1h, const __m128i b1l, const __m128i b1h,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+	{
+		__m128i ya = _mm_sra_epi32(_mm_add_epi32(Dot4(a0l, a0h, k.wy), k.y_bias), k.y_shift);
+		__m128i yb = _mm_sra_epi32(_mm_add_epi32(Dot4(b0l, b0h, k.wy), k.y_bias), k.y_shift);
+		__m128i w16 = _mm_packs_epi32(ya, yb);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(y0), _mm_packus_epi16(w16, w16));
+
+		ya = _mm_sra_epi32(_mm_add_epi32(Dot4(a1l, a1h, k.wy), k.y_bias), k.y_shift);
+		yb = _mm_sra_epi32(_mm_add_epi32(Dot4(b1l, b1h, k.wy), k.y_bias), k.y_shift);
+		w16 = _mm_packs_epi32(ya, yb);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(y1), _mm_packus_epi16(w16, w16));
+
+		const __m128i sal = _mm_add_epi16(a0l, a1l), sah = _mm_add_epi16(a0h, a1h);
+		const __m128i sbl = _mm_add_epi16(b0l, b1l), sbh = _mm_add_epi16(b0h, b1h);
+
+		__m128i cu = _mm_hadd_epi32(Dot4(sal, sah, k.wu), Dot4(sbl, sbh, k.wu));
+		__m128i cv = _mm_hadd_epi32(Dot4(sal, sah, k.wv), Dot4(sbl, sbh, k.wv));
+		cu = _mm_sra_epi32(_mm_add_epi32(cu, k.uv_bias), k.uv_shift);
+		cv = _mm_sra_epi32(_mm_add_epi32(cv, k.uv_bias), k.uv_shift);
+
+		w16 = _mm_packs_epi32(cu, cv);
+		const __m128i packed = _mm_packus_epi16(w16, w16);
+		*reinterpret_cast<int32_t*>(u) = _mm_cvtsi128_si32(packed);
+		*reinterpret_cast<int32_t*>(v) = _mm_extract_epi32(packed, 1);
+	}
+
+	TARGET_SSE41 void ConvertRowsSSE41(const yuv_coefficients& c, const uint8_t* src0, const uint8_t* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, const int width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const auto k = Constants128(c);
+
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + 4 * x));
+			const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + 4 * x + 16));
+			const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + 4 * x));
+			const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + 4 * x + 16));
+
+			ConvertPixels8(k,
+				_mm_cvtepu8_epi16(a0), _mm_unpackhi_epi8(a0, zero),
+				_mm_cvtepu8_epi16(b0), _mm_unpackhi_epi8(b0, zero),
+				_mm_cvtepu8_epi16(a1), _mm_unpackhi_epi8(a1, zero),
+				_mm_cvtepu8_epi16(b1), _mm_unpackhi_epi8(b1, zero),
+				y0 + x, y1 + x, u + x / 2, v + x / 2);
+		}
+
+		ConvertTail(c, src0, src1, y0, y1, u, v, x, width);
+	}
+
+	//Same as above on box sums, which already are words
+	TARGET_SSE41 void ConvertSumRowsSSE41(const yuv_coefficients& c, const uint16_t* src0, const uint16_t* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, const int width)
+	{
+		const auto k = Constants128(c);
+
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			const auto p0 = reinterpret_cast<const __m128i*>(src0 + 4 * x);
+			const auto p1 = reinterpret_cast<const __m128i*>(src1 + 4 * x);
+
+			ConvertPixels8(k,
+				_mm_loadu_si128(p0), _mm_loadu_si128(p0 + 1), _mm_loadu_si128(p0 + 2), _mm_loadu_si128(p0 + 3),
+				_mm_loadu_si128(p1), _mm_loadu_si128(p1 + 1), _mm_loadu_si128(p1 + 2), _mm_loadu_si128(p1 + 3),
+				y0 + x, y1 + x, u + x / 2, v + x / 2);
+		}
+
+		ConvertTail(c, src0, src1, y0, y1, u, v, x, width);
+	}
+
+	//Eight source pixels per row, factor rows summed as words:
+	//a = pixels 0,1  b = 2,3  c = 4,5  d = 6,7
+	TARGET_SSE41 inline void SumRows8(const uint8_t* src, const ptrdiff_t pitch, const int rows,
+		__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		a = b = c = d = zero;
+		for (int r = 0; r < rows; ++r, src += pitch)
+		{
+			const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+			a = _mm_add_epi16(a, _mm_cvtepu8_epi16(v0));
+			b = _mm_add_epi16(b, _mm_unpackhi_epi8(v0, zero));
+			c = _mm_add_epi16(c, _mm_cvtepu8_epi16(v1));
+			d = _mm_add_epi16(d, _mm_unpackhi_epi8(v1, zero));
+		}
+	}
+
+	TARGET_SSE41 void BoxSumSSE41(const uint8_t* src, const ptrdiff_t pitch, const int factor, const int width, uint16_t* sums)
+	{
+		__m128i a, b, c, d;
+
+		int x = 0;
+		if (factor == 2)
+		{
+			for (; x + 4 <= width; x += 4)
+			{
+				SumRows8(src + 8 * x, pitch, 2, a, b, c, d);
+				//[p0 p2] + [p1 p3] -> two output pixels per register
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + 4 * x),
+					_mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + 4 * x + 8),
+					_mm_add_epi16(_mm_unpacklo_epi64(c, d), _mm_unpackhi_epi64(c, d)));
+			}
+		}
+		else if (factor == 4)
+		{
+			for (; x + 2 <= width; x += 2)
+			{
+				SumRows8(src + 16 * x, pitch, 4, a, b, c, d);
+				const __m128i first = _mm_add_epi16(a, b);
+				const __m128i second = _mm_add_epi16(c, d);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + 4 * x),
+					_mm_add_epi16(_mm_unpacklo_epi64(first, second), _mm_unpackhi_epi64(first, second)));
+			}
+		}
+
+		BoxSumTail(src, pitch, factor, x, width, sums);
+	}
+
+	TARGET_AVX2 inline __m256i Weights256(const int16_t* w)
+	{
+		return _mm256_setr_epi16(w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3],
+			w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3]);
+	}
+
+	//Works per 128-bit lane: eight pixels -> [p0..p3 | p4..p7]
+	TARGET_AVX2 inline __m256i Dot8(const __m256i lo, const __m256i hi, const __m256i w)
+	{
+		return _mm256_hadd_epi32(_mm256_madd_epi16(lo, w), _mm256_madd_epi16(hi, w));
+	}
+
+	//Two dword vectors of consecutive values -> bytes in order
+	TARGET_AVX2 inline __m128i PackBytes(const __m256i a, const __m256i b)
+	{
+		const __m256i w16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+		return _mm_packus_epi16(_mm256_castsi256_si128(w16), _mm256_extracti128_si256(w16, 1));
+	}
+
+	TARGET_AVX2 void ConvertRowsAVX2(const yuv_coefficients& c, const uint8_t* src0, const uint8_t* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, const int width)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i wy = Weights256(c.y);
+		const __m256i wu = Weights256(c.u);
+		const __m256i wv = Weights256(c.v);
+		const __m256i yBias = _mm256_set1_epi32(c.y_bias);
+		const __m256i uvBias = _mm256_set1_epi32(c.uv_bias);
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src0 + 4 * x));
+			const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src0 + 4 * x + 32));
+			const __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src1 + 4 * x));
+			const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src1 + 4 * x + 32));
+
+			//Lane-wise unpack: lo holds pixels 0,1,4,5 and hi 2,3,6,7
+			const __m256i a0l = _mm256_unpacklo_epi8(a0, zero), a0h = _mm256_unpackhi_epi8(a0, zero);
+			const __m256i b0l = _mm256_unpacklo_epi8(b0, zero), b0h = _mm256_unpackhi_epi8(b0, zero);
+			const __m256i a1l = _mm256_unpacklo_epi8(a1, zero), a1h = _mm256_unpackhi_epi8(a1, zero);
+			const __m256i b1l = _mm256_unpacklo_epi8(b1, zero), b1h = _mm256_unpackhi_epi8(b1, zero);
+
+			__m256i ya = _mm256_srai_epi32(_mm256_add_epi32(Dot8(a0l, a0h, wy), yBias), Shift);
+			__m256i yb = _mm256_srai_epi32(_mm256_add_epi32(Dot8(b0l, b0h, wy), yBias), Shift);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), PackBytes(ya, yb));
+
+			ya = _mm256_srai_epi32(_mm256_add_epi32(Dot8(a1l, a1h, wy), yBias), Shift);
+			yb = _mm256_srai_epi32(_mm256_add_epi32(Dot8(b1l, b1h, wy), yBias), Shift);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), PackBytes(ya, yb));
+
+			const __m256i sal = _mm256_add_epi16(a0l, a1l), sah = _mm256_add_epi16(a0h, a1h);
+			const __m256i sbl = _mm256_add_epi16(b0l, b1l), sbh = _mm256_add_epi16(b0h, b1h);
+
+			//Pair sums come out as [c0 c1 c4 c5 | c2 c3 c6 c7], the permute puts them in order
+			__m256i cu = _mm256_hadd_epi32(Dot8(sal, sah, wu), Dot8(sbl, sbh, wu));
+			__m256i cv = _mm256_hadd_epi32(Dot8(sal, sah, wv), Dot8(sbl, sbh, wv));
+			cu = _mm256_srai_epi32(_mm256_add_epi32(_mm256_permute4x64_epi64(cu, 0xD8), uvBias), ChromaShift);
+			cv = _mm256_srai_epi32(_mm256_add_epi32(_mm256_permute4x64_epi64(cv, 0xD8), uvBias), ChromaShift);
+
+			const __m128i packed = PackBytes(cu, cv);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), packed);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_unpackhi_epi64(packed, packed));
+		}
+
+		ConvertTail(c, src0, src1, y0, y1, u, v, x, width);
+	}
+
+	TARGET_AVX512 inline __m512i Weights512(const int16_t* w)
+	{
+		const int32_t pair0 = static_cast<uint16_t>(w[0]) | static_cast<uint32_t>(static_cast<uint16_t>(w[1])) << 16;
+		const int32_t pair1 = static_cast<uint16_t>(w[2]) | static_cast<uint32_t>(static_cast<uint16_t>(w[3])) << 16;
+		return _mm512_set_epi32(pair1, pair0, pair1, pair0, pair1, pair0, pair1, pair0,
+			pair1, pair0, pair1, pair0, pair1, pair0, pair1, pair0);
+	}
+
+	//No lane-crossing hadd here: pmaddwd leaves two partial sums per pixel,
+	//the even/odd gathers line them up in pixel order for one add
+	TARGET_AVX512 inline __m512i Dot16(const __m512i lo, const __m512i hi, const __m512i w)
+	{
+		const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+		const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+		const __m512i ml = _mm512_madd_epi16(lo, w);
+		const __m512i mh = _mm512_madd_epi16(hi, w);
+		return _mm512_add_epi32(_mm512_permutex2var_epi32(ml, even, mh), _mm512_permutex2var_epi32(ml, odd, mh));
+	}
+
+	//Sixteen dword pixel sums -> eight sums of neighbouring pairs
+	TARGET_AVX512 inline __m256i PairSums(const __m512i sums)
+	{
+		return _mm512_cvtepi64_epi32(_mm512_add_epi32(sums, _mm512_srli_epi64(sums, 32)));
+	}
+
+	TARGET_AVX512 void ConvertRowsAVX512(const yuv_coefficients& c, const uint8_t* src0, const uint8_t* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, const int width)
+	{
+		const __m512i zero = _mm512_setzero_si512();
+		const __m512i wy = Weights512(c.y);
+		const __m512i wu = Weights512(c.u);
+		const __m512i wv = Weights512(c.v);
+		const __m512i yBias = _mm512_set1_epi32(c.y_bias);
+		const __m256i uvBias = _mm256_set1_epi32(c.uv_bias);
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			const __m512i p0 = _mm512_loadu_si512(src0 + 4 * x);
+			const __m512i p1 = _mm512_loadu_si512(src1 + 4 * x);
+
+			const __m512i p0l = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(p0));
+			const __m512i p0h = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(p0, 1));
+			const __m512i p1l = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(p1));
+			const __m512i p1h = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(p1, 1));
+
+			__m512i y = _mm512_srai_epi32(_mm512_add_epi32(Dot16(p0l, p0h, wy), yBias), Shift);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm512_cvtusepi32_epi8(_mm512_max_epi32(y, zero)));
+
+			y = _mm512_srai_epi32(_mm512_add_epi32(Dot16(p1l, p1h, wy), yBias), Shift);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm512_cvtusepi32_epi8(_mm512_max_epi32(y, zero)));
+
+			const __m512i sl = _mm512_add_epi16(p0l, p1l);
+			const __m512i sh = _mm512_add_epi16(p0h, p1h);
+
+			const __m256i cu = _mm256_srai_epi32(_mm256_add_epi32(PairSums(Dot16(sl, sh, wu)), uvBias), ChromaShift);
+			const __m256i cv = _mm256_srai_epi32(_mm256_add_epi32(PairSums(Dot16(sl, sh, wv)), uvBias), ChromaShift);
+
+			const __m128i pu = _mm_packs_epi32(_mm256_castsi256_si128(cu), _mm256_extracti128_si256(cu, 1));
+			const __m128i pv = _mm_packs_epi32(_mm256_castsi256_si128(cv), _mm256_extracti128_si256(cv, 1));
+			const __m128i packed = _mm_packus_epi16(pu, pv);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), packed);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_unpackhi_epi64(packed, packed));
+		}
+
+		ConvertTail(c, src0, src1, y0, y1, u, v, x, width);
+	}
+
+	void Cpuid(unsigned int regs[4], const unsigned int leaf, const unsigned int subleaf)
+	{
+#ifdef _MSC_VER
+		int r[4];
+		__cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+		for (int i = 0; i < 4; ++i)
+			regs[i] = static_cast<unsigned int>(r[i]);
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	uint64_t ReadXcr0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return static_cast<uint64_t>(edx) << 32 | eax;
+#endif
+	}
+#endif	//XTGN_X86
+}
+
+SimdLevel ColorConverter::DetectSimdLevel()
+{
+#ifdef XTGN_X86
+	unsigned int regs[4];
+	Cpuid(regs, 0, 0);
+	const auto maxLeaf = regs[0];
+
+	Cpuid(regs, 1, 0);
+	const bool sse41 = (regs[2] & (1u << 19)) != 0;
+	const bool osxsave = (regs[2] & (1u << 27)) != 0;
+	const bool avx = (regs[2] & (1u << 28)) != 0;
+
+	if (!sse41)
+		return SimdLevel::Scalar;
+
+	//The wide registers are only usable if the OS saves them on context switch
+	if (!osxsave || !avx || maxLeaf < 7)
+		return SimdLevel::SSE41;
+
+	const auto xcr0 = ReadXcr0();
+	if ((xcr0 & 0x6) != 0x6)
+		return SimdLevel::SSE41;
+
+	Cpuid(regs, 7, 0);
+	const bool avx2 = (regs[1] & (1u << 5)) != 0;
+	const bool avx512f = (regs[1] & (1u << 16)) != 0;
+	const bool avx512bw = (regs[1] & (1u << 30)) != 0;
+
+	if (!avx2)
+		return SimdLevel::SSE41;
+
+	if (avx512f && avx512bw && (xcr0 & 0xE6) == 0xE6)
+		return SimdLevel::AVX512;
+
+	return SimdLevel::AVX2;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+const char* ColorConverter::GetSimdLevelName(const SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::SSE41:
+		return "SSE4.1";
+	case SimdLevel::AVX2:
+		return "AVX2";
+	case SimdLevel::AVX512:
+		return "AVX-512";
+	case SimdLevel::Scalar:
+	default:
+		return "scalar";
+	}
+}
+
+bool ColorConverter::IsSupported(const AVPixelFormat src, const AVPixelFormat dst)
+{
+	return (src == AV_PIX_FMT_RGBA || src == AV_PIX_FMT_BGRA) && dst == AV_PIX_FMT_YUV420P;
+}
+
+AVColorSpace ColorConverter::GetColorSpace(const YuvMatrix matrix)
+{
+	return matrix == YuvMatrix::BT709 ? AVCOL_SPC_BT709 : AVCOL_SPC_SMPTE170M;
+}
+
+AVColorRange ColorConverter::GetColorRange(const YuvRange range)
+{
+	return range == YuvRange::Full ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+}
+
+int ColorConverter::GetScaleFactor(const int srcWidth, const int srcHeight, const int dstWidth, const int dstHeight)
+{
+	//A few leftover source columns or rows are cropped from the right and bottom
+	for (const int factor : { 1, 2, 4 })
+	{
+		if (dstWidth * factor <= srcWidth && srcWidth < (dstWidth + 1) * factor
+			&& dstHeight * factor <= srcHeight && srcHeight < (dstHeight + 1) * factor)
+			return factor;
+	}
+
+	return 0;
+}
+
+ColorConverter::ColorConverter()
+	: m_coefficients(), m_kernel(nullptr), m_sum_kernel(nullptr), m_box(nullptr), m_factor(1), m_level(SimdLevel::Scalar),
+	m_sums_width(0)
+{
+}
+
+bool ColorConverter::Initialize(const AVPixelFormat format, const int width, const YuvMatrix matrix,
+	const YuvRange range, const int factor, const int bands, const SimdLevel level)
+{
+	Release();
+
+	if (!IsSupported(format, AV_PIX_FMT_YUV420P) || (factor != 1 && factor != 2 && factor != 4)
+		|| width < factor || bands < 1)
+		return false;
+
+	const double kr = matrix == YuvMatrix::BT709 ? 0.2126 : 0.299;
+	const double kb = matrix == YuvMatrix::BT709 ? 0.0722 : 0.114;
+	const double yScale = range == YuvRange::Full ? 1.0 : 219.0 / 255.0;
+	const double uvScale = range == YuvRange::Full ? 1.0 : 224.0 / 255.0;
+	const int yOffset = range == YuvRange::Full ? 0 : 16;
+
+	const auto q15 = [](const double value) { return static_cast<int>(std::lround(value * (1 << Shift))); };
+
+	//Green takes the rounding error so white and grey land exactly
+	const int yr = q15(kr * yScale);
+	const int yb = q15(kb * yScale);
+	const int yg = q15(yScale) - yr - yb;
+
+	const int ub = q15(0.5 * uvScale);
+	const int ur = q15(-0.5 * uvScale * kr / (1.0 - kb));
+	const int ug = -ub - ur;
+
+	const int vr = q15(0.5 * uvScale);
+	const int vb = q15(-0.5 * uvScale * kb / (1.0 - kr));
+	const int vg = -vr - vb;
+
+	//Byte positions of R, G, B in the source pixel; alpha gets a zero weight
+	const int r = format == AV_PIX_FMT_BGRA ? 2 : 0;
+	const int g = 1;
+	const int b = format == AV_PIX_FMT_BGRA ? 0 : 2;
+
+	m_coefficients = yuv_coefficients();
+	m_coefficients.y[r] = static_cast<int16_t>(yr);
+	m_coefficients.y[g] = static_cast<int16_t>(yg);
+	m_coefficients.y[b] = static_cast<int16_t>(yb);
+	m_coefficients.u[r] = static_cast<int16_t>(ur);
+	m_coefficients.u[g] = static_cast<int16_t>(ug);
+	m_coefficients.u[b] = static_cast<int16_t>(ub);
+	m_coefficients.v[r] = static_cast<int16_t>(vr);
+	m_coefficients.v[g] = static_cast<int16_t>(vg);
+	m_coefficients.v[b] = static_cast<int16_t>(vb);
+
+	//A box sums factor^2 pixels, which the shift divides back out
+	const int boxShift = factor == 4 ? 4 : factor == 2 ? 2 : 0;
+	m_coefficients.y_shift = Shift + boxShift;
+	m_coefficients.uv_shift = ChromaShift + boxShift;
+	m_coefficients.y_bias = (yOffset << m_coefficients.y_shift) + (1 << (m_coefficients.y_shift - 1));
+	m_coefficients.uv_bias = (128 << m_coefficients.uv_shift) + (1 << (m_coefficients.uv_shift - 1));
+
+	m_factor = factor;
+	m_level = std::min(level, DetectSimdLevel());
+
+	//Box sums go through L1, SSE4.1 already keeps up with memory there
+	if (factor != 1)
+	{
+		//Allocated once here, the conversions only reuse it
+		m_sums_width = width / factor;
+		m_sums.assign(8 * static_cast<size_t>(m_sums_width) * bands, 0);
+
+#ifdef XTGN_X86
+		if (m_level >= SimdLevel::SSE41)
+		{
+			m_level = SimdLevel::SSE41;
+			m_box = &BoxSumSSE41;
+			m_sum_kernel = &ConvertSumRowsSSE41;
+			return true;
+		}
+#endif
+		m_level = SimdLevel::Scalar;
+		m_box = &BoxSumScalar;
+		m_sum_kernel = &ConvertSumRowsScalar;
+		return true;
+	}
+
+	switch (m_level)
+	{
+#ifdef XTGN_X86
+	case SimdLevel::AVX512:
+		m_kernel = &ConvertRowsAVX512;
+		break;
+	case SimdLevel::AVX2:
+		m_kernel = &ConvertRowsAVX2;
+		break;
+	case SimdLevel::SSE41:
+		m_kernel = &ConvertRowsSSE41;
+		break;
+#endif
+	default:
+		m_level = SimdLevel::Scalar;
+		m_kernel = &ConvertRowsScalar;
+		break;
+	}
+
+	return true;
+}
+
+void ColorConverter::Release()
+{
+	m_kernel = nullptr;
+	m_sum_kernel = nullptr;
+	m_box = nullptr;
+	m_factor = 1;
+	m_level = SimdLevel::Scalar;
+	m_sums_width = 0;
+	m_sums.clear();
+	m_sums.shrink_to_fit();
+}
+
+void ColorConverter::Convert(const AVFrame* src, AVFrame* dst) const
+{
+	Convert(src, dst, 0, dst->height, 0);
+}
+
+void ColorConverter::Convert(const AVFrame* src, AVFrame* dst, const int row, const int rowCount, const int band) const
+{
+	if (m_sum_kernel)
+	{
+		ConvertBox(src, dst, row, rowCount, band);
+		return;
+	}
+
+	if (!m_kernel)
+		return;
+
+	const int width = std::min(src->width, dst->width);
+	const int end = std::min(row + rowCount, std::min(src->height, dst->height));
+
+	for (int y = row; y < end; y += 2)
+	{
+		//An odd last row pairs with itself for chroma and writes its luma twice
+		const int y1 = y + 1 < end ? y + 1 : y;
+
+		m_kernel(m_coefficients,
+			src->data[0] + static_cast<ptrdiff_t>(y) * src->linesize[0],
+			src->data[0] + static_cast<ptrdiff_t>(y1) * src->linesize[0],
+			dst->data[0] + static_cast<ptrdiff_t>(y) * dst->linesize[0],
+			dst->data[0] + static_cast<ptrdiff_t>(y1) * dst->linesize[0],
+			dst->data[1] + static_cast<ptrdiff_t>(y / 2) * dst->linesize[1],
+			dst->data[2] + static_cast<ptrdiff_t>(y / 2) * dst->linesize[2],
+			width);
+	}
+}
+
+void ColorConverter::ConvertBox(const AVFrame* src, AVFrame* dst, const int row, const int rowCount, const int band) const
+{
+	const int width = std::min({ src->width / m_factor, dst->width, m_sums_width });
+	const int end = std::min(row + rowCount, std::min(src->height / m_factor, dst->height));
+	const ptrdiff_t pitch = src->linesize[0];
+
+	//Two output rows of box sums, small enough to stay in L1 between the passes
+	uint16_t* sums0 = m_sums.data() + 8 * static_cast<size_t>(m_sums_width) * band;
+	uint16_t* sums1 = sums0 + 4 * m_sums_width;
+
+	for (int y = row; y < end; y += 2)
+	{
+		const int y1 = y + 1 < end ? y + 1 : y;
+
+		m_box(src->data[0] + y * m_factor * pitch, pitch, m_factor, width, sums0);
+		if (y1 != y)
+			m_box(src->data[0] + y1 * m_factor * pitch, pitch, m_factor, width, sums1);
+
+		m_sum_kernel(m_coefficients, sums0, y1 != y ? sums1 : sums0,
+			dst->data[0] + static_cast<ptrdiff_t>(y) * dst->linesize[0],
+			dst->data[0] + static_cast<ptrdiff_t>(y1) * dst->linesize[0],
+			dst->data[1] + static_cast<ptrdiff_t>(y / 2) * dst->linesize[1],
+			dst->data[2] + static_cast<ptrdiff_t>(y / 2) * dst->linesize[2],
+			width);
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef __COLOR_CONVERTER_H__
+#define __COLOR_CONVERTER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#ifdef __cplusplus
+}
+#endif
+
+enum class YuvMatrix
+{
+	BT601,
+	BT709
+};
+
+enum class YuvRange
+{
+	Limited,	//Y 16..235, UV 16..240
+	Full		//Y, UV 0..255
+};
+
+enum class SimdLevel
+{
+	Scalar,
+	SSE41,
+	AVX2,
+	AVX512
+};
+
+//Fixed-point Q15 weights laid out in the byte order of the source pixel, so
+//the kernels never have to shuffle channels. Chroma weights apply to the sum
+//of a 2x2 block; the biases carry the plane offset and rounding
+struct yuv_coefficients
+{
+	int16_t y[4];
+	int16_t u[4];
+	int16_t v[4];
+	int32_t y_bias;
+	int32_t uv_bias;
+	int32_t y_shift;
+	int32_t uv_shift;
+};
+
+//Converts packed 8-bit RGBA or BGRA straight into YUV420P planes, optionally
+//box-filtering 2x2 or 4x4 source blocks on the way in the same pass. Chroma is
+//the average of each 2x2 output block. The widest kernel the CPU and OS
+//support is picked at Initialize()
+class ColorConverter
+{
+public:
+	static SimdLevel DetectSimdLevel();
+	static const char* GetSimdLevelName(SimdLevel level);
+
+	static bool IsSupported(AVPixelFormat src, AVPixelFormat dst);
+
+	static AVColorSpace GetColorSpace(YuvMatrix matrix);
+	static AVColorRange GetColorRange(YuvRange range);
+
+	//Box factor (1, 2 or 4) that maps the source onto the output, 0 if none does
+	static int GetScaleFactor(int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+public:
+	ColorConverter();
+
+	//width is that of the source, bands the most Convert() calls running at
+	//once. level caps the kernel, mainly so the benchmark can compare them
+	bool Initialize(AVPixelFormat format, int width, YuvMatrix matrix, YuvRange range,
+		int factor = 1, int bands = 1, SimdLevel level = SimdLevel::AVX512);
+
+	void Release();
+
+	bool IsInitialized() const { return m_kernel != nullptr || m_sum_kernel != nullptr; }
+
+	SimdLevel GetSimdLevel() const { return m_level; }
+	int GetScaleFactor() const { return m_factor; }
+
+	//Output rows [row, row + rowCount) of dst; row and rowCount must be even
+	//unless the band reaches the bottom of the frame. Calls running at once
+	//each pass a band of their own below the count given to Initialize()
+	void Convert(const AVFrame* src, AVFrame* dst) const;
+	void Convert(const AVFrame* src, AVFrame* dst, int row, int rowCount, int band) const;
+
+private:
+	typedef void(*kernel_func)(const yuv_coefficients& c, const uint8_t* src0, const uint8_t* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width);
+
+	typedef void(*sum_kernel_func)(const yuv_coefficients& c, const uint16_t* src0, const uint16_t* src1,
+		uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width);
+	typedef void(*box_func)(const uint8_t* src, ptrdiff_t pitch, int factor, int width, uint16_t* sums);
+
+	yuv_coefficients m_coefficients;
+	kernel_func m_kernel;
+	sum_kernel_func m_sum_kernel;
+	box_func m_box;
+	int m_factor;
+	SimdLevel m_level;
+
+	//Two output rows of box sums per band, each band only touches its own
+	int m_sums_width;
+	mutable std::vector<uint16_t> m_sums;
+
+	void ConvertBox(const AVFrame* src, AVFrame* dst, int row, int rowCount, int band) const;
+};
+
+#endif	//__COLOR_CONVERTER_H__
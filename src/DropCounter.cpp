@@ -0,0 +1,107 @@
+#include "DropCounter.h"
+
+const char* DropCounter::GetReasonName(const DropReason reason)
+{
+	switch (reason)
+	{
+	case DropReason::QueueFull:
+		return "queue full";
+	case DropReason::PacerSkip:
+		return "late tick";
+	case DropReason::Overload:
+		return "overload policy";
+	default:
+		return "unknown";
+	}
+}
+
+DropCounter::DropCounter()
+{
+	Reset();
+}
+
+void DropCounter::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_seconds.clear();
+	for (auto& count : m_reasons)
+		count = 0;
+	m_reported = 0;
+}
+
+void DropCounter::Add(int64_t second, const DropReason reason, const uint64_t count)
+{
+	if (count == 0)
+		return;
+
+	if (second < 0)
+		second = 0;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (static_cast<size_t>(second) >= m_seconds.size())
+		m_seconds.resize(static_cast<size_t>(second) + 1, 0);
+
+	m_seconds[static_cast<size_t>(second)] += count;
+	m_reasons[static_cast<int>(reason)] += count;
+
+	//Encoder-side drops may land in a second already reported
+	if (static_cast<size_t>(second) < m_reported)
+		m_reported = static_cast<size_t>(second);
+}
+
+uint64_t DropCounter::GetTotal() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	uint64_t total = 0;
+	for (const auto count : m_reasons)
+		total += count;
+	return total;
+}
+
+uint64_t DropCounter::GetTotal(const DropReason reason) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_reasons[static_cast<int>(reason)];
+}
+
+std::vector<std::pair<int64_t, uint64_t>> DropCounter::GetSeconds() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::vector<std::pair<int64_t, uint64_t>> seconds;
+	for (size_t i = 0; i < m_seconds.size(); ++i)
+	{
+		if (m_seconds[i])
+			seconds.emplace_back(static_cast<int64_t>(i), m_seconds[i]);
+	}
+	return seconds;
+}
+
+std::vector<std::pair<int64_t, uint64_t>> DropCounter::TakeNew()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::vector<std::pair<int64_t, uint64_t>> seconds;
+	for (size_t i = m_reported; i < m_seconds.size(); ++i)
+	{
+		if (m_seconds[i])
+			seconds.emplace_back(static_cast<int64_t>(i), m_seconds[i]);
+	}
+	m_reported = m_seconds.size();
+	return seconds;
+}
+
+std::string DropCounter::Format(const std::vector<std::pair<int64_t, uint64_t>>& seconds)
+{
+	std::string text;
+	for (const auto& second : seconds)
+	{
+		if (!text.empty())
+			text += ' ';
+		text += std::to_string(second.first) + ':' + std::to_string(second.second);
+	}
+	return text;
+}
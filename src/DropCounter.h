@@ -0,0 +1,51 @@
+#ifndef __DROP_COUNTER_H__
+#define __DROP_COUNTER_H__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class DropReason
+{
+	QueueFull,	//Captured tick had no free queue slot, or the main output's was full
+	PacerSkip,	//Capture woke up too late and the pacer skipped ticks
+	Overload,	//Discarded by the overload policy before encoding
+	Count
+};
+
+//Dropped frames per second of recording time. Capture and encode threads
+//both add to it; drops are rare, so a mutex is fine
+class DropCounter
+{
+public:
+	static const char* GetReasonName(DropReason reason);
+
+public:
+	DropCounter();
+
+	void Reset();
+
+	void Add(int64_t second, DropReason reason, uint64_t count = 1);
+
+	uint64_t GetTotal() const;
+	uint64_t GetTotal(DropReason reason) const;
+
+	//Seconds with at least one drop, in order
+	std::vector<std::pair<int64_t, uint64_t>> GetSeconds() const;
+
+	//Seconds added since the last call, for the periodic log line
+	std::vector<std::pair<int64_t, uint64_t>> TakeNew();
+
+	//"second:count second:count ..." for metadata and logs
+	static std::string Format(const std::vector<std::pair<int64_t, uint64_t>>& seconds);
+
+private:
+	mutable std::mutex m_mutex;
+	std::vector<uint64_t> m_seconds;
+	uint64_t m_reasons[static_cast<int>(DropReason::Count)];
+	size_t m_reported;
+};
+
+#endif	//__DROP_COUNTER_H__
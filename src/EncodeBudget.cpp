@@ -0,0 +1,182 @@
+#include "EncodeBudget.h"
+
+#include <algorithm>
+
+namespace
+{
+	const char* const Presets[] =
+	{
+		"ultrafast", "superfast", "veryfast", "faster", "fast",
+		"medium", "slow", "slower", "veryslow", "placebo"
+	};
+
+	const int PresetCount = sizeof(Presets) / sizeof(Presets[0]);
+
+	//Above this fraction of the interval there is no room left for spikes
+	const double HighLoad = 0.9;
+	//Below this a slower step is likely to still fit
+	const double LowLoad = 0.6;
+
+	//Quiet windows needed before stepping back up; doubled each time a step
+	//up has to be taken back straight away
+	const int CalmWindows = 3;
+	const int MaxCalmWindows = 60;
+
+	const int CrfStep = 2;
+	//Bitrate steps are multiplicative
+	const double BitrateStep = 0.8;
+}
+
+int EncodeBudget::GetPresetCount()
+{
+	return PresetCount;
+}
+
+const char* EncodeBudget::GetPresetName(const int index)
+{
+	return index >= 0 && index < PresetCount ? Presets[index] : "";
+}
+
+int EncodeBudget::FindPreset(const std::string& name)
+{
+	for (int i = 0; i < PresetCount; ++i)
+	{
+		if (name == Presets[i])
+			return i;
+	}
+
+	return -1;
+}
+
+EncodeBudget::EncodeBudget()
+	: m_initial{ -1, -1, 0 }, m_current{ -1, -1, 0 }, m_limits{ -1, -1, 0 }, m_started(false),
+	m_interval(0.0), m_window(0), m_total(0.0), m_frames(0), m_settle(0),
+	m_calm(0), m_calm_needed(CalmWindows), m_stepped_up(false)
+{
+}
+
+void EncodeBudget::Start(const EncodeSettings& initial, const EncodeBudgetLimits& limits, const int framerate)
+{
+	m_initial = initial;
+	m_current = initial;
+	m_limits = limits;
+
+	m_interval = 1.0 / std::max(framerate, 1);
+	m_window = std::max(framerate, 1);
+
+	m_total = 0.0;
+	m_frames = 0;
+	//The first window includes encoder start-up
+	m_settle = 1;
+	m_calm = 0;
+	m_calm_needed = CalmWindows;
+	m_stepped_up = false;
+
+	m_started = true;
+}
+
+void EncodeBudget::Stop()
+{
+	m_started = false;
+}
+
+void EncodeBudget::AddFrame(const double seconds)
+{
+	if (!m_started)
+		return;
+
+	m_total += seconds;
+	++m_frames;
+}
+
+bool EncodeBudget::Update(EncodeSettings& settings, double& load)
+{
+	if (!m_started || m_frames < m_window)
+		return false;
+
+	load = m_total / m_frames / m_interval;
+	m_total = 0.0;
+	m_frames = 0;
+
+	if (m_settle > 0)
+	{
+		--m_settle;
+		return false;
+	}
+
+	bool changed = false;
+	if (load > HighLoad)
+	{
+		m_calm = 0;
+		//A step up that did not fit makes the next attempt wait longer
+		if (m_stepped_up)
+			m_calm_needed = std::min(m_calm_needed * 2, MaxCalmWindows);
+
+		changed = StepDown();
+		m_stepped_up = false;
+	}
+	else
+	{
+		m_stepped_up = false;
+		if (load < LowLoad && ++m_calm >= m_calm_needed)
+		{
+			m_calm = 0;
+			changed = StepUp();
+			m_stepped_up = changed;
+		}
+	}
+
+	if (!changed)
+		return false;
+
+	m_settle = 1;
+	settings = m_current;
+	return true;
+}
+
+bool EncodeBudget::StepDown()
+{
+	if (m_current.preset > m_limits.fastest_preset && m_current.preset > 0)
+	{
+		--m_current.preset;
+		return true;
+	}
+
+	if (m_current.crf >= 0 && m_current.crf < m_limits.max_crf)
+	{
+		m_current.crf = std::min(m_current.crf + CrfStep, m_limits.max_crf);
+		return true;
+	}
+
+	if (m_current.crf < 0 && m_limits.min_bitrate > 0 && m_current.bitrate > m_limits.min_bitrate)
+	{
+		m_current.bitrate = std::max(static_cast<int64_t>(m_current.bitrate * BitrateStep), m_limits.min_bitrate);
+		return true;
+	}
+
+	return false;
+}
+
+bool EncodeBudget::StepUp()
+{
+	//Quality first, it was the last thing given up
+	if (m_current.crf > m_initial.crf)
+	{
+		m_current.crf = std::max(m_current.crf - CrfStep, m_initial.crf);
+		return true;
+	}
+
+	if (m_current.crf < 0 && m_current.bitrate < m_initial.bitrate)
+	{
+		m_current.bitrate = std::min(static_cast<int64_t>(m_current.bitrate / BitrateStep), m_initial.bitrate);
+		return true;
+	}
+
+	if (m_current.preset < m_initial.preset)
+	{
+		++m_current.preset;
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,75 @@
+#ifndef __ENCODE_BUDGET_H__
+#define __ENCODE_BUDGET_H__
+
+#include <cstdint>
+#include <string>
+
+//What the controller may change. preset indexes EncodeBudget::GetPresetName,
+//-1 if the codec has no presets from that ladder; crf is -1 in bitrate mode
+struct EncodeSettings
+{
+	int preset;
+	int crf;
+	int64_t bitrate;	//b/s
+};
+
+struct EncodeBudgetLimits
+{
+	int fastest_preset;	//Lowest preset index the controller may step down to
+	int max_crf;
+	int64_t min_bitrate;	//b/s, 0 keeps the bitrate fixed
+};
+
+//Keeps encoding real-time by comparing the mean time spent on each frame with
+//the frame interval. Over budget it first moves to a faster preset, then gives
+//up quality (higher CRF or lower bitrate); with headroom for several windows in
+//a row it undoes the steps in reverse order, never past the starting settings.
+//Decisions are made once per window of about a second and only after the
+//previous change has had a window to settle.
+class EncodeBudget
+{
+public:
+	//x264/x265 presets from fastest to slowest
+	static int GetPresetCount();
+	static const char* GetPresetName(int index);
+	static int FindPreset(const std::string& name);
+
+public:
+	EncodeBudget();
+
+	void Start(const EncodeSettings& initial, const EncodeBudgetLimits& limits, int framerate);
+	void Stop();
+
+	bool IsStarted() const { return m_started; }
+
+	//Wall time spent on one frame, seconds
+	void AddFrame(double seconds);
+
+	//True when a window has completed and settings changed; the caller applies
+	//them starting with a keyframe. load is the mean fraction of the frame
+	//interval the finished window used
+	bool Update(EncodeSettings& settings, double& load);
+
+	const EncodeSettings& GetSettings() const { return m_current; }
+
+private:
+	EncodeSettings m_initial;
+	EncodeSettings m_current;
+	EncodeBudgetLimits m_limits;
+	bool m_started;
+
+	double m_interval;
+	int m_window;
+
+	double m_total;
+	int m_frames;
+	int m_settle;
+	int m_calm;
+	int m_calm_needed;
+	bool m_stepped_up;
+
+	bool StepDown();
+	bool StepUp();
+};
+
+#endif	//__ENCODE_BUDGET_H__
@@ -0,0 +1,331 @@
+#include "EncoderTuner.h"
+#include "FrameConverter.h"
+#include "SyntheticFrameSource.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/opt.h>
+#ifdef __cplusplus
+}
+#endif
+
+namespace
+{
+	//Distinct frames cycled through during a run, enough for motion search
+	//to have something to do
+	const int PatternFrames = 8;
+
+	//Candidates within this fraction of the best throughput count as equal
+	const double Tolerance = 0.05;
+
+	const char* ThreadingName(const EncoderThreading threading)
+	{
+		switch (threading)
+		{
+		case EncoderThreading::Frame:
+			return "frame";
+		case EncoderThreading::Slice:
+			return "slice";
+		default:
+			return "auto";
+		}
+	}
+
+	void FreeFrames(std::vector<AVFrame*>& frames)
+	{
+		for (auto& frame : frames)
+			av_frame_free(&frame);
+		frames.clear();
+	}
+
+	//Winners of earlier runs in this process, so arming the next session with
+	//the same encoder settings does not measure again
+	std::mutex TuneCacheMutex;
+	std::map<std::string, EncoderTuneResult> TuneCache;
+
+	std::string GetCacheKey(const VideoWriterConfig& config)
+	{
+		return config.codec_name + " " + std::to_string(config.width) + "x" + std::to_string(config.height)
+			+ " " + std::to_string(config.framerate) + " fps " + config.preset + " crf " + std::to_string(config.crf)
+			+ " " + std::to_string(config.bitrate) + " b/s" + (config.lossless ? " lossless" : "");
+	}
+}
+
+EncoderTuner::EncoderTuner(Logger* logger)
+	: m_logger(logger)
+{
+}
+
+bool EncoderTuner::Tune(VideoWriterConfig& config, const int frames)
+{
+	const auto key = GetCacheKey(config);
+	{
+		std::lock_guard<std::mutex> lock(TuneCacheMutex);
+		const auto cached = TuneCache.find(key);
+		if (cached != TuneCache.end())
+		{
+			const auto& result = cached->second;
+			config.threading = result.threading;
+			config.thread_count = result.thread_count;
+			config.row_mt = result.row_mt;
+			m_logger->WriteInfo(QString("Encoder tuned earlier for %1: %2 x%3%4, %5 fps, %6 frames delay\r\n")
+				.arg(key.c_str()).arg(ThreadingName(result.threading)).arg(result.thread_count).arg(result.row_mt ? " row-mt" : "")
+				.arg(result.fps, 0, 'f', 1).arg(result.delay));
+			return true;
+		}
+	}
+
+	const auto codec = avcodec_find_encoder_by_name(config.codec_name.c_str());
+	if (!codec)
+	{
+		m_logger->WriteError(QString("Encoder tuning: codec %1 not found\r\n").arg(config.codec_name.c_str()));
+		return false;
+	}
+
+	const int width = config.width % 2 == 0 ? config.width : config.width + 1;
+	const int height = config.height % 2 == 0 ? config.height : config.height + 1;
+
+	//Input prepared up front so only the encoder is timed
+	SyntheticFrameSource source(m_logger);
+	source.Initialize(width, height);
+
+	//In the format the writer would pick for the same capture
+	const auto format = XVideoWriter::GetEncoderFormat(config, AV_PIX_FMT_RGBA);
+	FrameConverter converter(m_logger);
+	converter.Initialize(AV_PIX_FMT_RGBA, width, height, format, width, height,
+		config.color_matrix, config.color_range, config.conversion_bands);
+
+	std::vector<AVFrame*> input;
+	auto rgba = av_frame_alloc();
+	if (rgba)
+	{
+		rgba->format = AV_PIX_FMT_RGBA;
+		rgba->width = width;
+		rgba->height = height;
+	}
+
+	if (!rgba || av_frame_get_buffer(rgba, FramePool::Alignment) < 0 || !source.IsInitialized())
+	{
+		m_logger->WriteError("Encoder tuning: could not prepare frames\r\n");
+		av_frame_free(&rgba);
+		return false;
+	}
+
+	for (int i = 0; i < PatternFrames; ++i)
+	{
+		if (!source.CaptureFrame(rgba))
+			break;
+
+		auto frame = av_frame_alloc();
+		if (!frame)
+			break;
+
+		//A frame the encoder takes as captured is only copied, since rgba is
+		//drawn over for the next one
+		bool prepared;
+		if (converter.IsInitialized())
+		{
+			frame->format = format;
+			frame->width = width;
+			frame->height = height;
+			prepared = converter.Convert(rgba, frame);
+		}
+		else
+		{
+			prepared = av_frame_ref(frame, rgba) == 0 && av_frame_make_writable(frame) == 0;
+			frame->format = format;
+		}
+
+		if (!prepared)
+		{
+			av_frame_free(&frame);
+			break;
+		}
+		input.push_back(frame);
+	}
+
+	av_frame_free(&rgba);
+
+	if (input.size() != PatternFrames)
+	{
+		m_logger->WriteError("Encoder tuning: could not prepare frames\r\n");
+		FreeFrames(input);
+		return false;
+	}
+
+	//Thread counts: powers of two up to the core count, and the core count
+	const int cores = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+	std::vector<int> counts;
+	for (int count = 1; count < cores; count *= 2)
+		counts.push_back(count);
+	counts.push_back(cores);
+
+	std::vector<EncoderThreading> modes;
+	if (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)
+		modes.push_back(EncoderThreading::Frame);
+	if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)
+		modes.push_back(EncoderThreading::Slice);
+	//Wrapped libraries such as x264 thread internally and only take a count
+	if (modes.empty())
+		modes.push_back(EncoderThreading::Auto);
+
+	bool hasRowMt = false;
+	if (codec->priv_class)
+	{
+		const AVClass* priv = codec->priv_class;
+		hasRowMt = av_opt_find(&priv, "row-mt", nullptr, 0, AV_OPT_SEARCH_FAKE_OBJ) != nullptr;
+	}
+
+	m_logger->WriteInfo(QString("Tuning %1 threading at %2x%3, %4 fps, %5 frames per candidate\r\n")
+		.arg(codec->name).arg(width).arg(height).arg(config.framerate).arg(frames));
+
+	std::vector<EncoderTuneResult> results;
+	for (const auto mode : modes)
+	{
+		for (const int count : counts)
+		{
+			//One thread is the same in every mode, measured with the first
+			if (count == 1 && mode != modes.front())
+				continue;
+
+			for (int rowMt = 0; rowMt <= (hasRowMt ? 1 : 0); ++rowMt)
+			{
+				auto candidate = config;
+				candidate.threading = mode;
+				candidate.thread_count = count;
+				candidate.row_mt = rowMt != 0;
+				candidate.variable_frame_rate = false;
+
+				EncoderTuneResult result;
+				if (!Measure(candidate, codec, input, frames, result))
+				{
+					m_logger->WriteInfo(QString("    %1 x%2%3: could not open\r\n")
+						.arg(ThreadingName(mode)).arg(count).arg(rowMt ? " row-mt" : ""));
+					continue;
+				}
+
+				m_logger->WriteInfo(QString("    %1 x%2%3: %4 fps, %5 frames delay\r\n")
+					.arg(ThreadingName(mode)).arg(count).arg(rowMt ? " row-mt" : "")
+					.arg(result.fps, 0, 'f', 1).arg(result.delay));
+
+				results.push_back(result);
+			}
+		}
+	}
+
+	FreeFrames(input);
+
+	if (results.empty())
+	{
+		m_logger->WriteError("Encoder tuning: no candidate could be opened\r\n");
+		return false;
+	}
+
+	//Real-time candidates first, then the fastest; near-ties go to the lowest delay
+	const double budget = config.framerate;
+	const auto best = std::max_element(results.begin(), results.end(),
+		[](const EncoderTuneResult& a, const EncoderTuneResult& b) { return a.fps < b.fps; });
+	const bool realtime = best->fps >= budget;
+
+	const EncoderTuneResult* chosen = nullptr;
+	for (const auto& result : results)
+	{
+		if (result.fps < best->fps * (1.0 - Tolerance) || (realtime && result.fps < budget))
+			continue;
+
+		if (!chosen || result.delay < chosen->delay || (result.delay == chosen->delay && result.fps > chosen->fps))
+			chosen = &result;
+	}
+
+	config.threading = chosen->threading;
+	config.thread_count = chosen->thread_count;
+	config.row_mt = chosen->row_mt;
+
+	{
+		std::lock_guard<std::mutex> lock(TuneCacheMutex);
+		TuneCache[key] = *chosen;
+	}
+
+	if (realtime)
+	{
+		m_logger->WriteInfo(QString("Encoder tuned: %1 x%2%3, %4 fps, %5 frames delay\r\n")
+			.arg(ThreadingName(chosen->threading)).arg(chosen->thread_count).arg(chosen->row_mt ? " row-mt" : "")
+			.arg(chosen->fps, 0, 'f', 1).arg(chosen->delay));
+	}
+	else
+	{
+		m_logger->WriteError(QString("Encoder tuning: best is %1 x%2%3 at %4 fps, below the %5 fps needed\r\n")
+			.arg(ThreadingName(chosen->threading)).arg(chosen->thread_count).arg(chosen->row_mt ? " row-mt" : "")
+			.arg(chosen->fps, 0, 'f', 1).arg(config.framerate));
+	}
+
+	return true;
+}
+
+bool EncoderTuner::Measure(const VideoWriterConfig& config, const AVCodec* codec,
+	const std::vector<AVFrame*>& frames, const int count, EncoderTuneResult& result) const
+{
+	auto ctx = avcodec_alloc_context3(codec);
+	auto pkt = av_packet_alloc();
+	if (!ctx || !pkt)
+	{
+		avcodec_free_context(&ctx);
+		av_packet_free(&pkt);
+		return false;
+	}
+
+	XVideoWriter::SetupCodecContext(ctx, codec, config, static_cast<AVPixelFormat>(frames.front()->format));
+
+	if (avcodec_open2(ctx, codec, nullptr) < 0)
+	{
+		avcodec_free_context(&ctx);
+		av_packet_free(&pkt);
+		return false;
+	}
+
+	result.threading = config.threading;
+	result.thread_count = config.thread_count;
+	result.row_mt = config.row_mt;
+	result.delay = -1;
+
+	int packets = 0;
+	const auto drain = [&](const int sent)
+	{
+		while (avcodec_receive_packet(ctx, pkt) >= 0)
+		{
+			if (packets++ == 0)
+				result.delay = sent;
+			av_packet_unref(pkt);
+		}
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+
+	bool ok = true;
+	for (int i = 0; i < count && ok; ++i)
+	{
+		const auto frame = frames[i % frames.size()];
+		frame->pts = i;
+		ok = avcodec_send_frame(ctx, frame) >= 0;
+		drain(i);
+	}
+
+	if (ok && avcodec_send_frame(ctx, nullptr) >= 0)
+		drain(count);
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.fps = seconds > 0.0 ? count / seconds : 0.0;
+
+	avcodec_free_context(&ctx);
+	av_packet_free(&pkt);
+
+	return ok && packets > 0;
+}
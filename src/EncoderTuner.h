@@ -0,0 +1,39 @@
+#ifndef __ENCODER_TUNER_H__
+#define __ENCODER_TUNER_H__
+
+#include "Logger.h"
+#include "XVideoWriter.h"
+
+#include <vector>
+
+struct EncoderTuneResult
+{
+	EncoderThreading threading;
+	int thread_count;
+	bool row_mt;
+	double fps;
+	int delay;		//Frames sent before the first packet came out
+};
+
+//Picks the encoder threading for a writer configuration by encoding a short
+//run of synthetic frames with each candidate. The fastest candidate that
+//keeps up with the frame rate wins; when several are about as fast the one
+//with the least delay is taken. Winners are kept for the rest of the process
+//and reused for the same codec, size, frame rate and quality settings.
+class EncoderTuner
+{
+public:
+	EncoderTuner(Logger* logger);
+
+	//Writes the winner into config; false and config untouched if no
+	//candidate could be opened
+	bool Tune(VideoWriterConfig& config, int frames = 90);
+
+private:
+	Logger* m_logger;
+
+	bool Measure(const VideoWriterConfig& config, const AVCodec* codec,
+		const std::vector<AVFrame*>& frames, int count, EncoderTuneResult& result) const;
+};
+
+#endif	//__ENCODER_TUNER_H__
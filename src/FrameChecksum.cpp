@@ -0,0 +1,276 @@
+#include "FrameChecksum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/hash.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#ifdef __cplusplus
+}
+#endif
+
+namespace
+{
+	//Twice the largest digest, SHA512, plus the terminator
+	const int MaxHexSize = 2 * 64 + 1;
+
+	//Same bytes as the picture packed without padding, which is what the
+	//framehash muxer hashes from rawvideo
+	int HashFrame(AVHashContext* ctx, const AVFrame* frame, char* hex)
+	{
+		const auto format = static_cast<AVPixelFormat>(frame->format);
+		const auto desc = av_pix_fmt_desc_get(format);
+		if (!desc)
+			return -1;
+
+		av_hash_init(ctx);
+
+		int size = 0;
+		for (int plane = 0; plane < av_pix_fmt_count_planes(format); ++plane)
+		{
+			const int bytes = av_image_get_linesize(format, frame->width, plane);
+			const int rows = plane == 1 || plane == 2 ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+			if (bytes < 0)
+				return -1;
+
+			const uint8_t* row = frame->data[plane];
+			for (int y = 0; y < rows; ++y, row += frame->linesize[plane])
+				av_hash_update(ctx, row, bytes);
+			size += bytes * rows;
+		}
+
+		av_hash_final_hex(ctx, reinterpret_cast<uint8_t*>(hex), MaxHexSize);
+		return size;
+	}
+}
+
+bool FrameChecksum::IsHashSupported(const std::string& name)
+{
+	for (int i = 0; av_hash_names(i); ++i)
+	{
+		if (av_strcasecmp(av_hash_names(i), name.c_str()) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+FrameChecksum::FrameChecksum(Logger* logger)
+	: m_logger(logger), m_file(nullptr), m_next_sequence(0), m_next_line(0), m_capacity(0),
+	m_stopping(false), m_failed(false), m_last_size(0), m_stats()
+{
+}
+
+FrameChecksum::~FrameChecksum()
+{
+	Close();
+}
+
+bool FrameChecksum::Open(const std::string& filename, const std::string& hash, const AVPixelFormat format,
+	const int width, const int height, const AVRational timeBase, const int threads, const size_t capacity)
+{
+	Close();
+
+	if (!IsHashSupported(hash))
+	{
+		m_logger->WriteError(QString("Unknown frame hash %1\r\n").arg(hash.c_str()));
+		return false;
+	}
+
+	m_file = fopen(filename.c_str(), "w");
+	if (!m_file)
+	{
+		m_logger->WriteError(QString("Could not create the checksum file %1\r\n").arg(filename.c_str()));
+		return false;
+	}
+
+	//av_hash_get_name() gives the canonical spelling ffmpeg prints
+	AVHashContext* ctx = nullptr;
+	if (av_hash_alloc(&ctx, hash.c_str()) < 0)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+		return false;
+	}
+	m_hash = av_hash_get_name(ctx);
+	av_hash_freep(&ctx);
+
+	fprintf(m_file, "#format: frame checksums\n#version: 2\n#hash: %s\n", m_hash.c_str());
+	fprintf(m_file, "#tb 0: %d/%d\n#media_type 0: video\n#codec_id 0: rawvideo\n", timeBase.num, timeBase.den);
+	fprintf(m_file, "#dimensions 0: %dx%d\n#pix_fmt 0: %s\n", width, height, av_get_pix_fmt_name(format));
+	fprintf(m_file, "#stream#, dts,        pts, duration,     size, hash\n");
+
+	m_filename = filename;
+	m_next_sequence = 0;
+	m_next_line = 0;
+	m_capacity = std::max<size_t>(capacity, 1);
+	m_stopping = false;
+	m_failed = false;
+	m_last_size = 0;
+	m_last_hash.clear();
+	m_stats = FrameChecksumStats();
+
+	for (int i = 0; i < std::max(threads, 1); ++i)
+		m_threads.emplace_back(&FrameChecksum::HashLoop, this);
+
+	m_logger->WriteInfo(QString("Frame checksums: %1 on %2 threads to %3\r\n")
+		.arg(m_hash.c_str()).arg(m_threads.size()).arg(filename.c_str()));
+	return true;
+}
+
+void FrameChecksum::Push(const AVFrame* frame, const int64_t pts)
+{
+	if (!m_file)
+		return;
+
+	auto ref = av_frame_clone(frame);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_next_sequence - m_next_line >= m_capacity)
+	{
+		++m_stats.waits;
+		m_written.wait(lock, [this]() { return m_next_sequence - m_next_line < m_capacity; });
+	}
+
+	if (!ref)
+	{
+		//Keeps the line so the rest still lines up with the recording
+		m_failed = true;
+		m_done[m_next_sequence++] = checksum_line{ pts, 0, "-" };
+		WriteReady();
+		return;
+	}
+
+	m_queue.push_back(checksum_entry{ m_next_sequence++, ref, pts });
+	m_stats.high_water = std::max<size_t>(m_stats.high_water, m_next_sequence - m_next_line);
+	m_queued.notify_one();
+}
+
+void FrameChecksum::PushDuplicate(const int64_t pts)
+{
+	if (!m_file)
+		return;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_next_sequence - m_next_line >= m_capacity)
+	{
+		++m_stats.waits;
+		m_written.wait(lock, [this]() { return m_next_sequence - m_next_line < m_capacity; });
+	}
+
+	m_done[m_next_sequence++] = checksum_line{ pts, 0, std::string() };
+	WriteReady();
+}
+
+bool FrameChecksum::Close()
+{
+	if (!m_file)
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_queued.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+
+	bool complete = !m_failed && m_next_line == m_next_sequence;
+	if (fclose(m_file) != 0)
+		complete = false;
+	m_file = nullptr;
+
+	m_logger->WriteInfo(QString("Frame checksums: %1 frames, %2 MB hashed in %3 s, queue high-water %4, encoder waited %5 times\r\n")
+		.arg(static_cast<qulonglong>(m_stats.frames))
+		.arg(m_stats.megabytes, 0, 'f', 0)
+		.arg(m_stats.seconds, 0, 'f', 2)
+		.arg(m_stats.high_water)
+		.arg(static_cast<qulonglong>(m_stats.waits)));
+	if (!complete)
+		m_logger->WriteError(QString("Frame checksums in %1 are incomplete\r\n").arg(m_filename.c_str()));
+
+	return complete;
+}
+
+FrameChecksumStats FrameChecksum::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void FrameChecksum::HashLoop()
+{
+	AVHashContext* ctx = nullptr;
+	av_hash_alloc(&ctx, m_hash.c_str());
+
+	char hex[MaxHexSize];
+	while (true)
+	{
+		checksum_entry entry;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queued.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+			if (m_queue.empty())
+				break;
+
+			entry = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		const int size = ctx ? HashFrame(ctx, entry.frame, hex) : -1;
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		av_frame_free(&entry.frame);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.seconds += seconds;
+		if (size < 0)
+		{
+			m_failed = true;
+			m_done[entry.sequence] = checksum_line{ entry.pts, 0, "-" };
+		}
+		else
+		{
+			m_stats.megabytes += size / (1024.0 * 1024.0);
+			m_done[entry.sequence] = checksum_line{ entry.pts, size, hex };
+		}
+		WriteReady();
+	}
+
+	av_hash_freep(&ctx);
+}
+
+void FrameChecksum::WriteReady()
+{
+	bool written = false;
+	for (auto it = m_done.begin(); it != m_done.end() && it->first == m_next_line; it = m_done.erase(it))
+	{
+		auto& line = it->second;
+		if (line.hash.empty())
+		{
+			line.size = m_last_size;
+			line.hash = m_last_hash.empty() ? "-" : m_last_hash;
+		}
+
+		if (fprintf(m_file, "0, %10" PRId64 ", %10" PRId64 ", %8d, %8d, %s\n", line.pts, line.pts, 1, line.size, line.hash.c_str()) < 0)
+			m_failed = true;
+
+		m_last_size = line.size;
+		m_last_hash = line.hash;
+		++m_next_line;
+		++m_stats.frames;
+		written = true;
+	}
+
+	if (written)
+		m_written.notify_all();
+}
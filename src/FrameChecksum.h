@@ -0,0 +1,109 @@
+#ifndef __FRAME_CHECKSUM_H__
+#define __FRAME_CHECKSUM_H__
+
+#include "Logger.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/frame.h>
+#ifdef __cplusplus
+}
+#endif
+
+struct FrameChecksumStats
+{
+	uint64_t frames;	//Lines written to the sidecar
+	uint64_t waits;		//Times the encoder waited for a helper
+	size_t high_water;
+	double seconds;		//Spent hashing, all helpers together
+	double megabytes;	//Picture data hashed
+};
+
+//Checksums of every picture given to the encoder, hashed on helper threads
+//and written in order to a sidecar laid out like ffmpeg's framehash output:
+//one line per frame with the packed picture size and its hash. A lossless
+//recording checks out when the hash column matches that of
+//	ffmpeg -i <file> -pix_fmt <pix_fmt> -f framehash -hash <hash> -
+//Frames are held by reference until hashed, so a pooled buffer is never
+//written over while a helper still reads it
+class FrameChecksum
+{
+public:
+	//Any av_hash name: CRC32, adler32, murmur3, MD5, SHA256...
+	static bool IsHashSupported(const std::string& name);
+
+public:
+	FrameChecksum(Logger* logger);
+	~FrameChecksum();
+
+	bool Open(const std::string& filename, const std::string& hash, AVPixelFormat format,
+		int width, int height, AVRational timeBase, int threads = 2, size_t capacity = 8);
+	bool IsOpen() const { return m_file != nullptr; }
+
+	//pts in the time base given to Open(). Waits while capacity frames are
+	//still being hashed
+	void Push(const AVFrame* frame, int64_t pts);
+	//The picture of the last Push() sent again; not hashed twice
+	void PushDuplicate(int64_t pts);
+
+	//Hashes what is queued and closes the sidecar; false if a line was lost
+	bool Close();
+
+	FrameChecksumStats GetStats() const;
+
+private:
+	struct checksum_entry
+	{
+		uint64_t sequence;
+		AVFrame* frame;		//nullptr for a duplicate
+		int64_t pts;
+	};
+
+	struct checksum_line
+	{
+		int64_t pts;
+		int size;
+		std::string hash;	//Empty for a duplicate
+	};
+
+	Logger* m_logger;
+
+	std::string m_filename;
+	std::string m_hash;
+	FILE* m_file;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_queued;
+	std::condition_variable m_written;
+	std::deque<checksum_entry> m_queue;
+	//Hashed out of order by the helpers, written once the gap before is closed
+	std::map<uint64_t, checksum_line> m_done;
+	uint64_t m_next_sequence;
+	uint64_t m_next_line;
+	size_t m_capacity;
+	bool m_stopping;
+	bool m_failed;
+
+	//Repeated for duplicates
+	int m_last_size;
+	std::string m_last_hash;
+
+	FrameChecksumStats m_stats;
+	std::vector<std::thread> m_threads;
+
+	void HashLoop();
+	//Under m_mutex
+	void WriteReady();
+};
+
+#endif	//__FRAME_CHECKSUM_H__
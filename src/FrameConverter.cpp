@@ -0,0 +1,147 @@
+#include "FrameConverter.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#ifdef __cplusplus
+}
+#endif
+
+namespace
+{
+	//Beyond this the bands get too short to be worth a thread
+	const unsigned int MaxAutoBands = 8;
+}
+
+bool FrameConverter::IsSameLayout(const AVPixelFormat src, const AVPixelFormat dst)
+{
+	switch (src)
+	{
+	case AV_PIX_FMT_RGBA:
+		return dst == AV_PIX_FMT_RGBA || dst == AV_PIX_FMT_RGB0;
+	case AV_PIX_FMT_BGRA:
+		return dst == AV_PIX_FMT_BGRA || dst == AV_PIX_FMT_BGR0;
+	case AV_PIX_FMT_ARGB:
+		return dst == AV_PIX_FMT_ARGB || dst == AV_PIX_FMT_0RGB;
+	case AV_PIX_FMT_ABGR:
+		return dst == AV_PIX_FMT_ABGR || dst == AV_PIX_FMT_0BGR;
+	default:
+		return src == dst;
+	}
+}
+
+FrameConverter::FrameConverter(Logger* logger)
+	: m_logger(logger), m_buffer_size(0), m_bands(1)
+{
+}
+
+FrameConverter::~FrameConverter()
+{
+	Release();
+}
+
+bool FrameConverter::Initialize(const AVPixelFormat srcFormat, const int srcWidth, const int srcHeight,
+	const AVPixelFormat dstFormat, const int dstWidth, const int dstHeight,
+	const YuvMatrix matrix, const YuvRange range, const int bands)
+{
+	Release();
+
+	if (IsSameLayout(srcFormat, dstFormat) && srcWidth == dstWidth && srcHeight == dstHeight)
+		return true;
+
+	m_bands = bands > 0 ? bands
+		: static_cast<int>(std::min(std::max(std::thread::hardware_concurrency(), 1u), MaxAutoBands));
+	m_workers.Start(m_bands);
+
+	const auto frameSize = av_image_get_buffer_size(dstFormat, dstWidth, dstHeight, FramePool::Alignment);
+	if (frameSize < 0 || !m_pool.Initialize(frameSize, 2, false))
+	{
+		m_logger->WriteError("Could not allocate the video frame data\r\n");
+		return false;
+	}
+	m_buffer_size = static_cast<size_t>(frameSize);
+
+	//Same size or a 2x/4x downscale is a single pass of the SIMD kernels;
+	//sws is kept for other ratios and formats they do not know
+	const int factor = ColorConverter::GetScaleFactor(srcWidth, srcHeight, dstWidth, dstHeight);
+	if (factor && ColorConverter::IsSupported(srcFormat, dstFormat)
+		&& m_converter.Initialize(srcFormat, srcWidth, matrix, range, factor, m_bands))
+	{
+		m_logger->WriteInfo(QString("Converting %1 to %2 with the %3 kernel, %4x box downscale, in %5 bands\r\n")
+			.arg(av_get_pix_fmt_name(srcFormat))
+			.arg(av_get_pix_fmt_name(dstFormat))
+			.arg(ColorConverter::GetSimdLevelName(m_converter.GetSimdLevel()))
+			.arg(factor)
+			.arg(m_bands));
+		return true;
+	}
+
+	if (!m_scaler.Initialize(srcWidth, srcHeight, srcFormat, dstWidth, dstHeight, dstFormat,
+		m_bands, SWS_FAST_BILINEAR, matrix, range))
+	{
+		m_logger->WriteError("Could not allocate the sws context\r\n");
+		return false;
+	}
+
+	m_logger->WriteInfo(QString("Scaling %1x%2 %3 to %4x%5 %6 with sws in %7 bands\r\n")
+		.arg(srcWidth).arg(srcHeight).arg(av_get_pix_fmt_name(srcFormat))
+		.arg(dstWidth).arg(dstHeight).arg(av_get_pix_fmt_name(dstFormat))
+		.arg(m_scaler.GetBandCount()));
+	return true;
+}
+
+void FrameConverter::Release()
+{
+	m_scaler.Release();
+	m_workers.Stop();
+	m_pool.Release();
+	m_converter.Release();
+	m_buffer_size = 0;
+}
+
+bool FrameConverter::AcquireBuffer(AVFrame* frame)
+{
+	av_buffer_unref(&frame->buf[0]);
+	frame->buf[0] = m_pool.Get();
+	if (!frame->buf[0])
+		return false;
+
+	frame->extended_data = frame->data;
+	return av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data,
+		static_cast<AVPixelFormat>(frame->format), frame->width, frame->height, FramePool::Alignment) >= 0;
+}
+
+bool FrameConverter::Convert(const AVFrame* src, AVFrame* dst)
+{
+	if (!IsInitialized())
+		return false;
+
+	//A buffer from before a size change, or one an encoder still holds, is
+	//swapped for another from the pool rather than copied
+	if ((!dst->buf[0] || dst->buf[0]->size != static_cast<int>(m_buffer_size) || !av_frame_is_writable(dst))
+		&& !AcquireBuffer(dst))
+		return false;
+
+	if (m_converter.IsInitialized())
+	{
+		//Even band heights keep each chroma row inside one band
+		const int bandRows = ((dst->height + m_bands - 1) / m_bands + 1) & ~1;
+		const int bands = (dst->height + bandRows - 1) / bandRows;
+		m_workers.Run(bands, [&](const int band)
+		{
+			m_converter.Convert(src, dst, band * bandRows, bandRows, band);
+		});
+		return true;
+	}
+
+	m_workers.Run(m_scaler.GetBandCount(), [&](const int band)
+	{
+		m_scaler.Scale(src, dst, band);
+	});
+	return true;
+}
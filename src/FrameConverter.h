@@ -0,0 +1,59 @@
+#ifndef __FRAME_CONVERTER_H__
+#define __FRAME_CONVERTER_H__
+
+#include "Logger.h"
+#include "FramePool.h"
+#include "ColorConverter.h"
+#include "SliceScaler.h"
+#include "WorkerPool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/frame.h>
+#ifdef __cplusplus
+}
+#endif
+
+//Captured frames to the encoder's format and size, in bands across a worker
+//pool: the SIMD kernels for same size and 2x/4x box downscales, sws for the
+//rest. Converted pictures go into pooled buffers, so a frame still held by
+//an encoder is never written over
+class FrameConverter
+{
+public:
+	//dst holds the very bytes of src: the same format, or src with its alpha
+	//taken as padding (rgba as rgb0 and the like)
+	static bool IsSameLayout(AVPixelFormat src, AVPixelFormat dst);
+
+public:
+	FrameConverter(Logger* logger);
+	~FrameConverter();
+
+	//Same layout and size needs nothing done: IsInitialized() stays false and
+	//frames go on as they are. bands 0 picks one per core
+	bool Initialize(AVPixelFormat srcFormat, int srcWidth, int srcHeight,
+		AVPixelFormat dstFormat, int dstWidth, int dstHeight,
+		YuvMatrix matrix, YuvRange range, int bands);
+	void Release();
+
+	bool IsInitialized() const { return m_scaler.IsInitialized() || m_converter.IsInitialized(); }
+
+	//dst has the format and size given to Initialize(). It gets a buffer of
+	//its own from the pool unless it holds one nobody else references
+	bool Convert(const AVFrame* src, AVFrame* dst);
+
+private:
+	Logger* m_logger;
+
+	FramePool m_pool;
+	size_t m_buffer_size;
+	ColorConverter m_converter;
+	SliceScaler m_scaler;
+	WorkerPool m_workers;
+	int m_bands;
+
+	bool AcquireBuffer(AVFrame* frame);
+};
+
+#endif	//__FRAME_CONVERTER_H__
@@ -0,0 +1,134 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+namespace
+{
+	//The last stretch before a deadline is spent yielding, sleep is too coarse for it
+	const auto SpinWindow = std::chrono::microseconds(1500);
+}
+
+FramePacer::FramePacer()
+	: m_framerate(0), m_policy(LateTickPolicy::Skip), m_started(false), m_next(0),
+	m_ticks(0), m_late(0), m_skipped(0), m_duplicated(0), m_max_jitter(0), m_total_jitter(0)
+{
+}
+
+FramePacer::~FramePacer()
+{
+	Stop();
+}
+
+void FramePacer::Start(const int framerate, const LateTickPolicy policy)
+{
+	Stop();
+
+#ifdef _WIN32
+	//Default 15.6 ms scheduler tick is coarser than a 90 Hz frame
+	timeBeginPeriod(1);
+#endif
+
+	m_framerate = framerate > 0 ? framerate : 1;
+	m_policy = policy;
+	m_origin = clock::now();
+	m_next = 0;
+
+	m_ticks = 0;
+	m_late = 0;
+	m_skipped = 0;
+	m_duplicated = 0;
+	m_max_jitter = 0;
+	m_total_jitter = 0;
+
+	m_started = true;
+}
+
+void FramePacer::Stop()
+{
+	if (!m_started)
+		return;
+
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+
+	m_started = false;
+}
+
+FramePacer::clock::time_point FramePacer::Deadline(const int64_t tick) const
+{
+	//Computed from the origin every time so rounding never accumulates
+	return m_origin + std::chrono::nanoseconds(tick * 1000000000LL / m_framerate);
+}
+
+FrameTick FramePacer::WaitNextTick()
+{
+	FrameTick tick = { m_next, 0, 0 };
+
+	const auto deadline = Deadline(m_next);
+	auto now = clock::now();
+	if (now < deadline)
+	{
+		if (deadline - now > SpinWindow)
+			std::this_thread::sleep_until(deadline - SpinWindow);
+
+		while ((now = clock::now()) < deadline)
+			std::this_thread::yield();
+	}
+
+	//Tick whose interval we are in now
+	const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_origin).count();
+	const int64_t current = elapsed * m_framerate / 1000000000LL;
+	const int64_t missed = std::max<int64_t>(current - m_next, 0);
+
+	if (missed > 0)
+	{
+		++m_late;
+
+		switch (m_policy)
+		{
+		case LateTickPolicy::Duplicate:
+			tick.repeat = static_cast<int>(missed);
+			m_duplicated += missed;
+			break;
+		case LateTickPolicy::CatchUp:
+			//More than a second behind will not be caught up, skip instead
+			if (missed <= m_framerate)
+				break;
+			//fall through
+		case LateTickPolicy::Skip:
+		default:
+			tick.index = current;
+			m_skipped += missed;
+			break;
+		}
+	}
+
+	tick.jitter = std::chrono::duration_cast<std::chrono::microseconds>(now - Deadline(tick.index)).count();
+
+	++m_ticks;
+	m_total_jitter += tick.jitter;
+	m_max_jitter = std::max(m_max_jitter, tick.jitter);
+
+	m_next = tick.index + 1 + tick.repeat;
+
+	return tick;
+}
+
+FramePacerStats FramePacer::GetStats() const
+{
+	FramePacerStats stats;
+	stats.ticks = m_ticks;
+	stats.late = m_late;
+	stats.skipped = m_skipped;
+	stats.duplicated = m_duplicated;
+	stats.max_jitter = m_max_jitter;
+	stats.mean_jitter = m_ticks ? static_cast<double>(m_total_jitter) / m_ticks : 0.0;
+	return stats;
+}
@@ -0,0 +1,70 @@
+#ifndef __FRAME_PACER_H__
+#define __FRAME_PACER_H__
+
+#include <chrono>
+#include <cstdint>
+
+//What to do when the capture loop wakes up after one or more whole frame
+//intervals have already passed
+enum class LateTickPolicy
+{
+	Skip,		//Drop the missed ticks; their pts are left as a gap
+	Duplicate,	//Repeat the next captured frame for every missed tick
+	CatchUp		//Capture the missed ticks back to back without sleeping
+};
+
+struct FrameTick
+{
+	int64_t index;		//Tick number since Start(), usable as CFR pts
+	int repeat;			//Extra copies of this frame for missed ticks (Duplicate)
+	int64_t jitter;		//Wake-up time minus deadline, microseconds
+};
+
+struct FramePacerStats
+{
+	uint64_t ticks;
+	uint64_t late;
+	uint64_t skipped;
+	uint64_t duplicated;
+	int64_t max_jitter;
+	double mean_jitter;
+};
+
+//Schedules capture ticks against absolute deadlines origin + k / framerate on
+//the steady clock, so a slow frame is paid back by a shorter wait on the next
+//one instead of shifting every following frame
+class FramePacer
+{
+public:
+	FramePacer();
+	~FramePacer();
+
+	void Start(int framerate, LateTickPolicy policy);
+	void Stop();
+
+	//Blocks until the next deadline and says which tick it is
+	FrameTick WaitNextTick();
+
+	FramePacerStats GetStats() const;
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	clock::time_point m_origin;
+	int m_framerate;
+	LateTickPolicy m_policy;
+	bool m_started;
+
+	int64_t m_next;
+
+	uint64_t m_ticks;
+	uint64_t m_late;
+	uint64_t m_skipped;
+	uint64_t m_duplicated;
+	int64_t m_max_jitter;
+	int64_t m_total_jitter;
+
+	clock::time_point Deadline(int64_t tick) const;
+};
+
+#endif	//__FRAME_PACER_H__
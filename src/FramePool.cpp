@@ -0,0 +1,264 @@
+#include "FramePool.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+struct frame_pool_state
+{
+	//One reference for the pool itself plus one per outstanding buffer
+	std::atomic<int> refs;
+	std::atomic<size_t> allocated;
+	std::atomic<size_t> outstanding;
+	std::atomic<size_t> peak;
+	std::atomic<bool> huge_pages_used;
+	size_t buffer_size;
+	bool huge_pages;
+};
+
+namespace
+{
+	const size_t HeaderSize = FramePool::Alignment;
+	const size_t PageSize = 4096;
+	const size_t LargePageSize = 2 * 1024 * 1024;
+
+	//Lives in the first Alignment bytes of every allocation, data follows it
+	struct buffer_header
+	{
+		frame_pool_state* state;
+		AVBufferRef* pooled;
+		bool large;
+	};
+
+	static_assert(sizeof(buffer_header) <= HeaderSize, "Frame buffer header does not fit in front of the data");
+
+	uint8_t* AllocateMemory(const size_t size, const bool hugePages, bool& large)
+	{
+		large = false;
+#ifdef _WIN32
+		//Needs SeLockMemoryPrivilege, silently falls back to normal pages without it
+		const size_t largePage = hugePages ? GetLargePageMinimum() : 0;
+		if (largePage)
+		{
+			const size_t rounded = (size + largePage - 1) / largePage * largePage;
+			const auto ptr = VirtualAlloc(nullptr, rounded, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (ptr)
+			{
+				large = true;
+				return static_cast<uint8_t*>(ptr);
+			}
+		}
+
+		return static_cast<uint8_t*>(_aligned_malloc(size, FramePool::Alignment));
+#else
+		const size_t alignment = hugePages ? LargePageSize : FramePool::Alignment;
+		const size_t rounded = hugePages ? (size + LargePageSize - 1) / LargePageSize * LargePageSize : size;
+
+		void* ptr = nullptr;
+		if (posix_memalign(&ptr, alignment, rounded) != 0)
+			return nullptr;
+
+		if (hugePages && madvise(ptr, rounded, MADV_HUGEPAGE) == 0)
+			large = true;
+
+		return static_cast<uint8_t*>(ptr);
+#endif
+	}
+
+	void FreeMemory(uint8_t* ptr, const bool large)
+	{
+#ifdef _WIN32
+		if (large)
+			VirtualFree(ptr, 0, MEM_RELEASE);
+		else
+			_aligned_free(ptr);
+#else
+		(void)large;
+		free(ptr);
+#endif
+	}
+}
+
+FramePool::FramePool()
+	: m_pool(nullptr), m_state(nullptr)
+{
+}
+
+FramePool::~FramePool()
+{
+	Release();
+}
+
+bool FramePool::Initialize(const size_t bufferSize, const size_t prefill, const bool hugePages)
+{
+	Release();
+
+	if (bufferSize == 0)
+		return false;
+
+	m_state = new frame_pool_state();
+	m_state->refs = 1;
+	m_state->allocated = 0;
+	m_state->outstanding = 0;
+	m_state->peak = 0;
+	m_state->huge_pages_used = false;
+	m_state->buffer_size = bufferSize;
+	m_state->huge_pages = hugePages;
+
+	m_pool = av_buffer_pool_init2(static_cast<int>(bufferSize), m_state, &FramePool::AllocBuffer, nullptr);
+	if (!m_pool)
+	{
+		Release();
+		return false;
+	}
+
+	//Take everything we expect to need now, so page faults happen here and
+	//not on the first frames of a recording
+	std::vector<AVBufferRef*> buffers;
+	for (size_t i = 0; i < prefill; ++i)
+	{
+		const auto buf = Get();
+		if (!buf)
+			break;
+		buffers.push_back(buf);
+	}
+
+	const bool complete = buffers.size() == prefill;
+	for (auto& buf : buffers)
+		av_buffer_unref(&buf);
+
+	m_state->peak = 0;
+
+	if (!complete)
+	{
+		Release();
+		return false;
+	}
+
+	return true;
+}
+
+void FramePool::Release()
+{
+	//Buffers still out keep the pool alive, AVBufferPool frees it with the last one
+	if (m_pool)
+		av_buffer_pool_uninit(&m_pool);
+
+	if (m_state)
+	{
+		ReleaseState(m_state);
+		m_state = nullptr;
+	}
+}
+
+AVBufferRef* FramePool::Get()
+{
+	if (!m_pool)
+		return nullptr;
+
+	auto pooled = av_buffer_pool_get(m_pool);
+	if (!pooled)
+		return nullptr;
+
+	//Hand out a wrapper so the pool learns when the buffer comes back
+	const auto header = reinterpret_cast<buffer_header*>(pooled->data - HeaderSize);
+	header->pooled = pooled;
+
+	const auto buf = av_buffer_create(pooled->data, pooled->size, &FramePool::ReturnBuffer, header, 0);
+	if (!buf)
+	{
+		header->pooled = nullptr;
+		av_buffer_unref(&pooled);
+		return nullptr;
+	}
+
+	++m_state->refs;
+	const auto outstanding = ++m_state->outstanding;
+	auto peak = m_state->peak.load();
+	while (outstanding > peak && !m_state->peak.compare_exchange_weak(peak, outstanding))
+	{
+	}
+
+	return buf;
+}
+
+FramePoolStats FramePool::GetStats() const
+{
+	FramePoolStats stats = {};
+	if (m_state)
+	{
+		stats.buffer_size = m_state->buffer_size;
+		stats.allocated = m_state->allocated;
+		stats.outstanding = m_state->outstanding;
+		stats.peak = m_state->peak;
+		stats.huge_pages = m_state->huge_pages_used;
+	}
+
+	return stats;
+}
+
+AVBufferRef* FramePool::AllocBuffer(void* opaque, const int size)
+{
+	const auto state = static_cast<frame_pool_state*>(opaque);
+	const size_t total = HeaderSize + static_cast<size_t>(size);
+
+	bool large = false;
+	const auto base = AllocateMemory(total, state->huge_pages, large);
+	if (!base)
+		return nullptr;
+
+	//Pre-fault every page
+	for (size_t offset = 0; offset < total; offset += PageSize)
+		base[offset] = 0;
+
+	const auto header = reinterpret_cast<buffer_header*>(base);
+	header->state = state;
+	header->pooled = nullptr;
+	header->large = large;
+
+	const auto buf = av_buffer_create(base + HeaderSize, size, &FramePool::FreeBuffer, nullptr, 0);
+	if (!buf)
+	{
+		FreeMemory(base, large);
+		return nullptr;
+	}
+
+	++state->allocated;
+	if (large)
+		state->huge_pages_used = true;
+
+	return buf;
+}
+
+void FramePool::FreeBuffer(void* opaque, uint8_t* data)
+{
+	(void)opaque;
+	const auto base = data - HeaderSize;
+	FreeMemory(base, reinterpret_cast<buffer_header*>(base)->large);
+}
+
+void FramePool::ReturnBuffer(void* opaque, uint8_t* data)
+{
+	(void)data;
+	const auto header = static_cast<buffer_header*>(opaque);
+	const auto state = header->state;
+	auto pooled = header->pooled;
+	header->pooled = nullptr;
+
+	--state->outstanding;
+	av_buffer_unref(&pooled);
+	ReleaseState(state);
+}
+
+void FramePool::ReleaseState(frame_pool_state* state)
+{
+	if (--state->refs == 0)
+		delete state;
+}
@@ -0,0 +1,59 @@
+#ifndef __FRAME_POOL_H__
+#define __FRAME_POOL_H__
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/buffer.h>
+#ifdef __cplusplus
+}
+#endif
+
+struct frame_pool_state;
+
+struct FramePoolStats
+{
+	size_t buffer_size;
+	size_t allocated;
+	size_t outstanding;
+	size_t peak;
+	bool huge_pages;
+};
+
+//Recycling allocator for frame buffers built on AVBufferPool. Buffers are
+//64-byte aligned, pre-faulted when first allocated and optionally backed by
+//large pages; they return to the pool when their last AVBufferRef goes away.
+//Buffers may outlive the pool, the memory is freed with the last of them.
+class FramePool
+{
+public:
+	static const size_t Alignment = 64;
+
+public:
+	FramePool();
+	~FramePool();
+
+	//Allocates and pre-faults 'prefill' buffers up front
+	bool Initialize(size_t bufferSize, size_t prefill, bool hugePages);
+	void Release();
+
+	bool IsInitialized() const { return m_pool != nullptr; }
+
+	AVBufferRef* Get();
+
+	FramePoolStats GetStats() const;
+
+private:
+	AVBufferPool* m_pool;
+	frame_pool_state* m_state;
+
+	static AVBufferRef* AllocBuffer(void* opaque, int size);
+	static void FreeBuffer(void* opaque, uint8_t* data);
+	static void ReturnBuffer(void* opaque, uint8_t* data);
+	static void ReleaseState(frame_pool_state* state);
+};
+
+#endif	//__FRAME_POOL_H__
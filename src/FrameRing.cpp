@@ -0,0 +1,166 @@
+#include "FrameRing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavcodec/avcodec.h>
+#ifdef __cplusplus
+}
+#endif
+
+FrameRing::FrameRing()
+	: m_capacity(0), m_row_count(0), m_row_pitch(0), m_head(0), m_tail(0), m_high_water(0), m_overflows(0)
+{
+}
+
+FrameRing::~FrameRing()
+{
+	Release();
+}
+
+bool FrameRing::Initialize(const size_t capacity, const int width, const int height, const AVPixelFormat format,
+	const size_t rowCount, const size_t rowPitch, const bool hugePages)
+{
+	Release();
+
+	if (capacity == 0 || rowCount == 0 || rowPitch == 0)
+		return false;
+
+	m_row_count = rowCount;
+	m_row_pitch = rowPitch;
+
+	//A couple of spare buffers for slots whose old buffer the encoder still holds
+	if (!m_pool.Initialize(rowCount * rowPitch + AV_INPUT_BUFFER_PADDING_SIZE, capacity + 2, hugePages))
+	{
+		Release();
+		return false;
+	}
+
+	m_slots.resize(capacity);
+	for (auto& slot : m_slots)
+	{
+		slot.timestamp = 0;
+		slot.repeat = 0;
+		slot.frame = av_frame_alloc();
+		if (!slot.frame)
+		{
+			Release();
+			return false;
+		}
+
+		slot.frame->format = format;
+		slot.frame->width = width;
+		slot.frame->height = height;
+
+		if (!AllocateBuffer(slot.frame))
+		{
+			Release();
+			return false;
+		}
+	}
+
+	m_capacity = capacity;
+
+	return true;
+}
+
+void FrameRing::Release()
+{
+	for (auto& slot : m_slots)
+	{
+		if (slot.frame)
+			av_frame_free(&slot.frame);
+	}
+
+	m_capacity = 0;
+	m_row_count = 0;
+	m_row_pitch = 0;
+	m_slots.clear();
+	m_pool.Release();
+
+	m_head.store(0);
+	m_tail.store(0);
+	m_high_water.store(0);
+	m_overflows.store(0);
+}
+
+FrameSlot* FrameRing::BeginWrite()
+{
+	const auto head = m_head.load(std::memory_order_relaxed);
+	const auto tail = m_tail.load(std::memory_order_acquire);
+	if (head - tail >= m_capacity)
+	{
+		m_overflows.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	auto& slot = m_slots[head % m_capacity];
+	if (!av_frame_is_writable(slot.frame))
+	{
+		//Still referenced downstream, leave that buffer to its last owner
+		av_buffer_unref(&slot.frame->buf[0]);
+		if (!AllocateBuffer(slot.frame))
+			return nullptr;
+	}
+
+	return &slot;
+}
+
+void FrameRing::EndWrite()
+{
+	const auto head = m_head.load(std::memory_order_relaxed) + 1;
+	m_head.store(head, std::memory_order_release);
+
+	//Only the producer raises the mark, so a plain compare is enough
+	const auto depth = static_cast<size_t>(head - m_tail.load(std::memory_order_acquire));
+	if (depth > m_high_water.load(std::memory_order_relaxed))
+		m_high_water.store(depth, std::memory_order_relaxed);
+}
+
+FrameSlot* FrameRing::BeginRead()
+{
+	const auto tail = m_tail.load(std::memory_order_relaxed);
+	const auto head = m_head.load(std::memory_order_acquire);
+	if (head == tail)
+		return nullptr;
+
+	return &m_slots[tail % m_capacity];
+}
+
+void FrameRing::EndRead()
+{
+	m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+size_t FrameRing::GetDepth() const
+{
+	const auto tail = m_tail.load(std::memory_order_acquire);
+	const auto head = m_head.load(std::memory_order_acquire);
+	return static_cast<size_t>(head - tail);
+}
+
+bool FrameRing::AllocateBuffer(AVFrame* frame)
+{
+	//Packed formats only: one plane laid out exactly like the source rows
+	const auto buf = m_pool.Get();
+	if (!buf)
+		return false;
+
+	frame->buf[0] = buf;
+	frame->data[0] = buf->data;
+	frame->linesize[0] = static_cast<int>(m_row_pitch);
+	frame->extended_data = frame->data;
+
+	return true;
+}
+
+FrameRingStats FrameRing::GetStats() const
+{
+	FrameRingStats stats;
+	stats.capacity = m_capacity;
+	stats.depth = GetDepth();
+	stats.high_water = m_high_water.load(std::memory_order_relaxed);
+	stats.pushed = m_head.load(std::memory_order_relaxed);
+	stats.overflows = m_overflows.load(std::memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,87 @@
+#ifndef __FRAME_RING_H__
+#define __FRAME_RING_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "FramePool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/frame.h>
+#ifdef __cplusplus
+}
+#endif
+
+struct FrameSlot
+{
+	AVFrame* frame;
+	int64_t timestamp;
+	int repeat;
+};
+
+struct FrameRingStats
+{
+	size_t capacity;
+	size_t depth;
+	size_t high_water;
+	uint64_t pushed;
+	uint64_t overflows;
+};
+
+//Fixed-capacity single-producer/single-consumer queue of preallocated frame
+//slots. The producer fills the slot returned by BeginWrite() and publishes it
+//with EndWrite(); the consumer mirrors that with BeginRead()/EndRead(). No
+//locks on either side.
+//
+//Slot frames are refcounted single-plane AVFrames with linesize equal to the
+//source row pitch. If the encoder still holds a reference to a slot's buffer
+//when the producer comes round to it again, BeginWrite() gives the slot a new
+//buffer from the pool and the old one goes back with the encoder's last
+//reference.
+class FrameRing
+{
+public:
+	FrameRing();
+	~FrameRing();
+
+	bool Initialize(size_t capacity, int width, int height, AVPixelFormat format, size_t rowCount, size_t rowPitch, bool hugePages);
+	void Release();
+
+	bool IsInitialized() const { return m_capacity != 0; }
+	size_t GetCapacity() const { return m_capacity; }
+	size_t GetSlotSize() const { return m_row_count * m_row_pitch; }
+
+	//Producer side. BeginWrite() returns nullptr and counts an overflow when full
+	FrameSlot* BeginWrite();
+	void EndWrite();
+
+	//Consumer side. BeginRead() returns nullptr when empty
+	FrameSlot* BeginRead();
+	void EndRead();
+
+	size_t GetDepth() const;
+	FrameRingStats GetStats() const;
+	FramePoolStats GetPoolStats() const { return m_pool.GetStats(); }
+
+private:
+	size_t m_capacity;
+	size_t m_row_count;
+	size_t m_row_pitch;
+	std::vector<FrameSlot> m_slots;
+	FramePool m_pool;
+
+	bool AllocateBuffer(AVFrame* frame);
+
+	//Monotonic counters, slot index is counter % capacity. Kept on separate
+	//cache lines so producer and consumer do not false-share
+	alignas(64) std::atomic<uint64_t> m_head;
+	alignas(64) std::atomic<uint64_t> m_tail;
+	alignas(64) std::atomic<size_t> m_high_water;
+	std::atomic<uint64_t> m_overflows;
+};
+
+#endif	//__FRAME_RING_H__
@@ -0,0 +1,40 @@
+#include "FrameSource.h"
+#include "Logger.h"
+#include "SettingsHolder.h"
+#include "SyntheticFrameSource.h"
+#include "ReplayFrameSource.h"
+
+#ifdef _WIN32
+#include "VRWorker.h"
+#endif
+
+FrameSource* CreateFrameSource(const SettingsHolder* settings, Logger* logger)
+{
+	switch (settings->GetFrameSource())
+	{
+	case FrameSourceType::Synthetic:
+	{
+		const auto source = new SyntheticFrameSource(logger);
+		source->Initialize(settings->GetSyntheticWidth(), settings->GetSyntheticHeight(), settings->GetStereo());
+		return source;
+	}
+	case FrameSourceType::Replay:
+	{
+		const auto source = new ReplayFrameSource(logger);
+		source->Initialize(settings->GetReplayFile().toStdString(), settings->GetReplayRealtime(), settings->GetReplayLoop());
+		return source;
+	}
+	case FrameSourceType::VR:
+	default:
+	{
+#ifdef _WIN32
+		const auto source = new VRWorker(logger);
+		source->Initalize(settings->GetVREye(), settings->GetStereo());
+		return source;
+#else
+		logger->WriteError("VR frame source is available on Windows only\r\n");
+		return nullptr;
+#endif
+	}
+	}
+}
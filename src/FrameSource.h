@@ -0,0 +1,60 @@
+#ifndef __FRAME_SOURCE_H__
+#define __FRAME_SOURCE_H__
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/frame.h>
+#ifdef __cplusplus
+}
+#endif
+
+class Logger;
+class SettingsHolder;
+
+//Anything that can deliver frames to the recording loop: the VR mirror texture,
+//a synthetic pattern or a decoded recording. Sources write straight into the
+//caller's frame, so the captured pixels reach the encoder without a copy.
+class FrameSource
+{
+public:
+	//Monotonic capture clock shared by all sources, in microseconds
+	static int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+public:
+	virtual ~FrameSource() = default;
+
+	virtual bool IsInitialized() const = 0;
+	virtual void Release() = 0;
+
+	virtual int GetWidth() const = 0;
+	virtual int GetHeight() const = 0;
+	virtual AVPixelFormat GetPixelFormat() const = 0;
+
+	virtual size_t GetBufferRowCount() const = 0;
+	virtual size_t GetBufferRowPitch() const = 0;
+
+	//Capture time of the last captured frame (see Now())
+	virtual int64_t GetTimestamp() const = 0;
+
+	//Hz at which new pictures appear, 0 if the source has no rate of its own
+	virtual double GetRefreshRate() const { return 0; }
+
+	//Writes the next frame into frame->data[0]; frame->linesize[0] must be at
+	//least GetBufferRowPitch() and the plane GetBufferRowCount() rows high
+	virtual bool CaptureFrame(AVFrame* frame) = 0;
+};
+
+//Creates and initializes the source selected in settings, nullptr if the
+//source type is not available on this platform
+FrameSource* CreateFrameSource(const SettingsHolder* settings, Logger* logger);
+
+#endif	//__FRAME_SOURCE_H__
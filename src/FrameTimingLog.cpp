@@ -0,0 +1,418 @@
+#include "FrameTimingLog.h"
+#include "FrameSource.h"
+#include "DropCounter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/avutil.h>
+#ifdef __cplusplus
+}
+#endif
+
+#pragma comment(lib, "avutil.lib")
+
+namespace
+{
+	const char TimingMagic[8] = { 'X', 'T', 'G', 'N', 'T', 'I', 'M', '1' };
+
+	static_assert(sizeof(frame_timing_header) <= FrameTimingLog::HeaderSize, "Timing header does not fit in its page");
+	static_assert(sizeof(frame_timing_record) == FrameTimingLog::RecordSize, "Timing records are not of their fixed size");
+	static_assert(FrameTimingLog::ChunkSize % 65536 == 0, "Timing chunks are not aligned to the mapping granularity");
+
+	int64_t UtcNow()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	//2026-10-17T12:34:56.123456Z
+	std::string FormatUtc(const int64_t utc)
+	{
+		if (utc == 0)
+			return std::string();
+
+		const auto seconds = static_cast<time_t>(utc / 1000000);
+		struct tm parts;
+#ifdef _WIN32
+		if (gmtime_s(&parts, &seconds) != 0)
+			return std::string();
+#else
+		if (!gmtime_r(&seconds, &parts))
+			return std::string();
+#endif
+
+		char text[40];
+		const auto length = strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &parts);
+		snprintf(text + length, sizeof(text) - length, ".%06dZ", static_cast<int>(utc % 1000000));
+		return text;
+	}
+
+	const char* GetStatusName(const uint8_t status)
+	{
+		switch (static_cast<FrameTimingStatus>(status))
+		{
+		case FrameTimingStatus::Encoded: return "encoded";
+		case FrameTimingStatus::Duplicate: return "duplicate";
+		case FrameTimingStatus::Dropped: return "dropped";
+		case FrameTimingStatus::Static: return "static";
+		default: return "none";
+		}
+	}
+}
+
+int64_t FrameTimingLog::ToUtc(const int64_t timestamp)
+{
+	const auto utc = UtcNow();
+	return utc - (FrameSource::Now() - timestamp);
+}
+
+FrameTimingLog::FrameTimingLog()
+	: m_open(false), m_next(0), m_lost(0),
+#ifdef _WIN32
+	m_file(nullptr)
+#else
+	m_file(-1)
+#endif
+{
+	for (auto& chunk : m_chunks)
+		chunk.store(nullptr, std::memory_order_relaxed);
+}
+
+FrameTimingLog::~FrameTimingLog()
+{
+	Close();
+}
+
+bool FrameTimingLog::Create(const std::string& filename, const AVRational timeBase, const int framerate)
+{
+	Close();
+
+#ifdef _WIN32
+	const auto file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+		nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+#else
+	const int file = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (file < 0)
+		return false;
+#endif
+
+	m_file = file;
+	m_filename = filename;
+	m_next = 0;
+	m_lost = 0;
+
+	const auto data = MapChunk(0);
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+
+	//Both clocks at one moment, for lining up records without capture_utc
+	const auto header = reinterpret_cast<frame_timing_header*>(data);
+	std::memset(header, 0, HeaderSize);
+	std::memcpy(header->magic, TimingMagic, sizeof(TimingMagic));
+	header->header_size = HeaderSize;
+	header->record_size = RecordSize;
+	header->time_base_num = timeBase.num;
+	header->time_base_den = timeBase.den;
+	header->framerate = framerate;
+	header->start_time = FrameSource::Now();
+	header->start_utc = ToUtc(header->start_time);
+
+	m_open.store(true, std::memory_order_release);
+	return true;
+}
+
+bool FrameTimingLog::Append(const frame_timing_record& record)
+{
+	if (!m_open.load(std::memory_order_acquire))
+		return false;
+
+	//Slots are claimed in order; a chunk is mapped by whoever reaches it first
+	const auto index = m_next.fetch_add(1, std::memory_order_relaxed);
+	const auto offset = HeaderSize + index * RecordSize;
+	const auto chunk = static_cast<size_t>(offset / ChunkSize);
+
+	auto data = chunk < MaxChunks ? m_chunks[chunk].load(std::memory_order_acquire) : nullptr;
+	if (!data)
+		data = MapChunk(chunk);
+	if (!data)
+	{
+		m_lost.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	std::memcpy(data + offset % ChunkSize, &record, RecordSize);
+	return true;
+}
+
+bool FrameTimingLog::Close()
+{
+	const bool open = m_open.exchange(false);
+	bool complete = open && m_lost.load() == 0;
+
+	const auto records = m_next.load();
+	if (open)
+	{
+		const auto header = reinterpret_cast<frame_timing_header*>(m_chunks[0].load());
+		header->records = records;
+		header->closed = 1;
+	}
+
+	//Views first, Windows does not cut a file that is still mapped
+	Unmap();
+
+#ifdef _WIN32
+	if (m_file)
+	{
+		//Down to the last record, the rest of its chunk was only reserved
+		LARGE_INTEGER end;
+		end.QuadPart = static_cast<LONGLONG>(HeaderSize + records * RecordSize);
+		if (open && (!SetFilePointerEx(m_file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file)))
+			complete = false;
+		CloseHandle(m_file);
+	}
+	m_file = nullptr;
+#else
+	if (m_file >= 0)
+	{
+		if (open && ftruncate(m_file, static_cast<off_t>(HeaderSize + records * RecordSize)) != 0)
+			complete = false;
+		close(m_file);
+	}
+	m_file = -1;
+#endif
+
+	return complete;
+}
+
+uint8_t* FrameTimingLog::MapChunk(const size_t chunk)
+{
+	if (chunk >= MaxChunks)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_map_mutex);
+	if (const auto mapped = m_chunks[chunk].load(std::memory_order_acquire))
+		return mapped;
+
+	const auto offset = chunk * ChunkSize;
+	const auto end = offset + ChunkSize;
+	uint8_t* data = nullptr;
+
+#ifdef _WIN32
+	//Sizing the mapping grows the file; the view holds on to the mapping
+	const auto mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(end >> 32), static_cast<DWORD>(end & 0xffffffff), nullptr);
+	if (!mapping)
+		return nullptr;
+
+	data = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS,
+		static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset & 0xffffffff), ChunkSize));
+	CloseHandle(mapping);
+	if (!data)
+		return nullptr;
+#else
+	//Real blocks, so a full disk fails here and not as a fault in Append().
+	//Without fallocate the file only ever grows, a later chunk may be there
+	struct stat info;
+	if (posix_fallocate(m_file, static_cast<off_t>(offset), ChunkSize) != 0
+		&& (fstat(m_file, &info) != 0 || (info.st_size < static_cast<off_t>(end) && ftruncate(m_file, static_cast<off_t>(end)) != 0)))
+		return nullptr;
+
+	const auto mapped = mmap(nullptr, ChunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, static_cast<off_t>(offset));
+	if (mapped == MAP_FAILED)
+		return nullptr;
+	data = static_cast<uint8_t*>(mapped);
+#endif
+
+	m_chunks[chunk].store(data, std::memory_order_release);
+	return data;
+}
+
+void FrameTimingLog::Unmap()
+{
+	for (auto& chunk : m_chunks)
+	{
+		const auto data = chunk.exchange(nullptr);
+		if (!data)
+			continue;
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(data, ChunkSize);
+#endif
+	}
+}
+
+FrameTimingReader::FrameTimingReader()
+	: m_data(nullptr), m_size(0)
+#ifdef _WIN32
+	, m_file(nullptr), m_mapping(nullptr)
+#endif
+{
+}
+
+FrameTimingReader::~FrameTimingReader()
+{
+	Release();
+}
+
+bool FrameTimingReader::Open(const std::string& filename)
+{
+	Release();
+
+#ifdef _WIN32
+	const auto file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	m_file = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < FrameTimingLog::HeaderSize)
+	{
+		Release();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	m_data = m_mapping ? static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	m_size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+	const int file = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size < FrameTimingLog::HeaderSize)
+	{
+		close(file);
+		return false;
+	}
+
+	const auto data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+	if (data != MAP_FAILED)
+	{
+		m_data = static_cast<const uint8_t*>(data);
+		m_size = static_cast<uint64_t>(info.st_size);
+	}
+#endif
+
+	if (!m_data || std::memcmp(GetHeader().magic, TimingMagic, sizeof(TimingMagic)) != 0
+		|| GetHeader().header_size != FrameTimingLog::HeaderSize || GetHeader().record_size != FrameTimingLog::RecordSize)
+	{
+		Release();
+		return false;
+	}
+
+	return true;
+}
+
+void FrameTimingReader::Release()
+{
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data)
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+}
+
+uint64_t FrameTimingReader::GetSlotCount() const
+{
+	if (!m_data)
+		return 0;
+
+	//A cut short file ends in reserved space, a closed one says how far it goes
+	const auto slots = (m_size - FrameTimingLog::HeaderSize) / FrameTimingLog::RecordSize;
+	return GetHeader().closed ? std::min<uint64_t>(GetHeader().records, slots) : slots;
+}
+
+bool FrameTimingReader::GetRecord(const uint64_t index, frame_timing_record& record) const
+{
+	if (index >= GetSlotCount())
+		return false;
+
+	std::memcpy(&record, m_data + FrameTimingLog::HeaderSize + index * FrameTimingLog::RecordSize, sizeof(record));
+	return record.status != static_cast<uint8_t>(FrameTimingStatus::None);
+}
+
+int64_t FrameTimingReader::ExportCsv(FILE* out) const
+{
+	if (!m_data)
+		return -1;
+
+	std::vector<frame_timing_record> records;
+	frame_timing_record record;
+	for (uint64_t i = 0; i < GetSlotCount(); ++i)
+	{
+		if (GetRecord(i, record))
+			records.push_back(record);
+	}
+
+	//Appended as frames finished; by pts where there is one, otherwise by
+	//capture time, both from the start of the recording
+	const auto& header = GetHeader();
+	const AVRational microseconds = { 1, 1000000 };
+	const AVRational timeBase = { header.time_base_num, header.time_base_den };
+	const auto order = [&](const frame_timing_record& r)
+	{
+		if (r.pts != AV_NOPTS_VALUE && timeBase.num > 0 && timeBase.den > 0)
+			return av_rescale_q(r.pts, timeBase, microseconds);
+		return r.capture_time ? r.capture_time - header.start_time : 0;
+	};
+	std::stable_sort(records.begin(), records.end(),
+		[&](const frame_timing_record& a, const frame_timing_record& b) { return order(a) < order(b); });
+
+	if (fprintf(out, "pts,seconds,status,drop_reason,picture_type,keyframe,size,"
+		"capture_us,capture_utc,convert_us,encode_us,mux_us\n") < 0)
+		return -1;
+
+	for (const auto& r : records)
+	{
+		const bool timed = r.pts != AV_NOPTS_VALUE && timeBase.den > 0;
+		const auto pictureType = r.picture_type ? av_get_picture_type_char(static_cast<AVPictureType>(r.picture_type)) : '?';
+		const char* reason = r.status == static_cast<uint8_t>(FrameTimingStatus::Dropped) && r.drop_reason < static_cast<uint8_t>(DropReason::Count)
+			? DropCounter::GetReasonName(static_cast<DropReason>(r.drop_reason)) : "";
+
+		if (fprintf(out, "%s,%s,%s,%s,%c,%d,%d,%" PRId64 ",%s,%" PRId64 ",%" PRId64 ",%" PRId64 "\n",
+			timed ? std::to_string(r.pts).c_str() : "",
+			timed ? std::to_string(r.pts * av_q2d(timeBase)).c_str() : "",
+			GetStatusName(r.status), reason, pictureType, r.keyframe, r.size,
+			r.capture_time, FormatUtc(r.capture_utc).c_str(), r.convert_time, r.encode_time, r.mux_time) < 0)
+			return -1;
+	}
+
+	return static_cast<int64_t>(records.size());
+}
@@ -0,0 +1,152 @@
+#ifndef __FRAME_TIMING_LOG_H__
+#define __FRAME_TIMING_LOG_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/rational.h>
+#ifdef __cplusplus
+}
+#endif
+
+enum class FrameTimingStatus : uint8_t
+{
+	None,		//Slot never written, e.g. cut short by a crash
+	Encoded,
+	Duplicate,	//The last picture sent to the encoder again
+	Dropped,	//drop_reason says where
+	Static		//Same as the last encoded frame and left out (VFR)
+};
+
+//Start of the timing file, one page
+struct frame_timing_header
+{
+	char magic[8];			//"XTGNTIM1"
+	uint32_t header_size;
+	uint32_t record_size;
+	int32_t time_base_num;	//Of the record pts
+	int32_t time_base_den;
+	int32_t framerate;
+	uint32_t closed;		//Set with records by Close()
+	int64_t start_time;		//Monotonic clock at Create(), see FrameSource::Now()
+	int64_t start_utc;		//UTC at the same moment, microseconds since 1970
+	uint64_t records;
+};
+
+//One frame. Times are microseconds on the monotonic capture clock, 0 for a
+//stage the frame never reached
+struct frame_timing_record
+{
+	int64_t pts;			//Header time base, AV_NOPTS_VALUE if it never got one
+	int64_t capture_time;
+	int64_t capture_utc;	//Microseconds since 1970 at capture_time
+	int64_t convert_time;	//In the encoder's format and handed to it
+	int64_t encode_time;	//Its packet out of the encoder
+	int64_t mux_time;		//Packet written to the file
+	int32_t size;			//Packet bytes
+	uint8_t status;			//FrameTimingStatus
+	uint8_t picture_type;	//AVPictureType the encoder chose
+	uint8_t keyframe;
+	uint8_t drop_reason;	//DropReason of a dropped frame
+	uint8_t reserved[8];
+};
+
+//Per-frame timing sidecar of a recording: fixed-size records appended to a
+//memory-mapped file, so storing one is a copy into mapped pages and nothing
+//waits for the disk. Whichever thread is done with a frame appends it, the
+//muxer for encoded frames and capture or encoder for dropped ones, so
+//records are in completion order rather than pts order. The file grows by
+//chunks mapped as they are reached, and what was appended survives the
+//process
+class FrameTimingLog
+{
+public:
+	static const uint32_t HeaderSize = 4096;
+	static const uint32_t RecordSize = 64;
+	//A multiple of the Windows mapping granularity, 65536 records
+	static const uint64_t ChunkSize = 4 * 1024 * 1024;
+
+	//UTC in microseconds since 1970 at timestamp of the monotonic clock,
+	//from both clocks read now
+	static int64_t ToUtc(int64_t timestamp);
+
+public:
+	FrameTimingLog();
+	~FrameTimingLog();
+
+	bool Create(const std::string& filename, AVRational timeBase, int framerate);
+	bool IsOpen() const { return m_open.load(std::memory_order_acquire); }
+	const std::string& GetFilename() const { return m_filename; }
+
+	//From any thread between Create() and Close(); false if the record
+	//could not be stored
+	bool Append(const frame_timing_record& record);
+	uint64_t GetAppended() const { return m_next.load(std::memory_order_relaxed) - m_lost.load(std::memory_order_relaxed); }
+
+	//Stores the record count and trims the file to it once nothing appends
+	//any more; false if a record was lost
+	bool Close();
+
+private:
+	//16 GB of records, days at 90 Hz
+	static const size_t MaxChunks = 4096;
+
+	std::string m_filename;
+	std::atomic<bool> m_open;
+	std::atomic<uint64_t> m_next;
+	std::atomic<uint64_t> m_lost;
+
+	//Only taken to map another chunk
+	std::mutex m_map_mutex;
+	std::atomic<uint8_t*> m_chunks[MaxChunks];
+
+#ifdef _WIN32
+	void* m_file;
+#else
+	int m_file;
+#endif
+
+	uint8_t* MapChunk(size_t chunk);
+	void Unmap();
+};
+
+//A timing file mapped read-only, whether closed or cut short
+class FrameTimingReader
+{
+public:
+	FrameTimingReader();
+	~FrameTimingReader();
+
+	bool Open(const std::string& filename);
+	void Release();
+
+	bool IsInitialized() const { return m_data != nullptr; }
+	const frame_timing_header& GetHeader() const { return *reinterpret_cast<const frame_timing_header*>(m_data); }
+
+	//Slots in the file, those of a cut short one include unwritten ones
+	uint64_t GetSlotCount() const;
+	//False for a slot never written
+	bool GetRecord(uint64_t index, frame_timing_record& record) const;
+
+	//Every record in capture order, one CSV row each; returns the rows
+	//written, -1 on a write error
+	int64_t ExportCsv(FILE* out) const;
+
+private:
+	const uint8_t* m_data;
+	uint64_t m_size;
+
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+};
+
+#endif	//__FRAME_TIMING_LOG_H__
@@ -0,0 +1,162 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	int FloorLog2(const uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<int>(index);
+#else
+		return 63 - __builtin_clzll(value);
+#endif
+	}
+}
+
+int64_t LatencyHistogram::GetBucketLow(const size_t bucket)
+{
+	const size_t subBuckets = size_t(1) << SubBucketBits;
+	if (bucket < 2 * subBuckets)
+		return static_cast<int64_t>(bucket);
+
+	const auto shift = bucket / subBuckets - 1;
+	return static_cast<int64_t>((bucket % subBuckets + subBuckets) << shift);
+}
+
+int64_t LatencyHistogram::GetBucketHigh(const size_t bucket)
+{
+	const size_t subBuckets = size_t(1) << SubBucketBits;
+	if (bucket < 2 * subBuckets)
+		return static_cast<int64_t>(bucket);
+
+	const auto shift = bucket / subBuckets - 1;
+	return GetBucketLow(bucket) + (int64_t(1) << shift) - 1;
+}
+
+size_t LatencyHistogram::GetBucket(int64_t microseconds)
+{
+	microseconds = std::max<int64_t>(0, std::min<int64_t>(microseconds, (int64_t(1) << MaxValueBits) - 1));
+
+	//Exact below 64, then the top SubBucketBits + 1 bits of the value
+	const auto value = static_cast<uint64_t>(microseconds);
+	if (value < (uint64_t(1) << SubBucketBits))
+		return static_cast<size_t>(value);
+
+	const int shift = FloorLog2(value) - SubBucketBits;
+	return (static_cast<size_t>(shift) << SubBucketBits) + static_cast<size_t>(value >> shift);
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+void LatencyHistogram::Reset()
+{
+	for (auto& bucket : m_buckets)
+		bucket.store(0, std::memory_order_relaxed);
+	m_count.store(0, std::memory_order_relaxed);
+	m_total.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Record(int64_t microseconds)
+{
+	if (microseconds < 0)
+		microseconds = 0;
+
+	m_buckets[GetBucket(microseconds)].fetch_add(1, std::memory_order_relaxed);
+	m_total.fetch_add(static_cast<uint64_t>(microseconds), std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+
+	//Raised only by a larger value, so the loop is over after a few tries at most
+	auto max = m_max.load(std::memory_order_relaxed);
+	while (microseconds > max && !m_max.compare_exchange_weak(max, microseconds, std::memory_order_relaxed))
+	{
+	}
+}
+
+LatencyStats LatencyHistogram::GetStats() const
+{
+	LatencyStats stats = {};
+
+	//The buckets rather than m_count, so the ranks add up even while
+	//other threads keep recording
+	uint64_t counts[BucketCount];
+	for (size_t i = 0; i < BucketCount; ++i)
+	{
+		counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+		stats.count += counts[i];
+	}
+
+	if (stats.count == 0)
+		return stats;
+
+	stats.max = m_max.load(std::memory_order_relaxed);
+	stats.mean = static_cast<double>(m_total.load(std::memory_order_relaxed)) / std::max<uint64_t>(m_count.load(std::memory_order_relaxed), 1);
+
+	const double percentiles[] = { 0.50, 0.90, 0.99 };
+	int64_t* results[] = { &stats.p50, &stats.p90, &stats.p99 };
+	size_t bucket = 0;
+	uint64_t seen = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentiles[i] * stats.count)));
+		while (bucket < BucketCount && seen + counts[bucket] < rank)
+			seen += counts[bucket++];
+
+		*results[i] = std::min(GetBucketHigh(std::min(bucket, BucketCount - 1)), stats.max);
+	}
+
+	return stats;
+}
+
+const char* StageLatency::GetStageName(const LatencyStage stage)
+{
+	switch (stage)
+	{
+	case LatencyStage::Capture: return "capture";
+	case LatencyStage::Convert: return "convert";
+	case LatencyStage::Encode: return "encode";
+	case LatencyStage::Mux: return "mux";
+	default: return "unknown";
+	}
+}
+
+void StageLatency::Reset()
+{
+	for (auto& stage : m_stages)
+		stage.Reset();
+}
+
+void StageLatency::WriteTable(Logger* logger) const
+{
+	logger->WriteInfo(QString("%1 %2 %3 %4 %5 %6 %7\r\n")
+		.arg("Latency, ms", -12).arg("frames", 9).arg("mean", 9).arg("p50", 9)
+		.arg("p90", 9).arg("p99", 9).arg("max", 9));
+
+	for (int i = 0; i < static_cast<int>(LatencyStage::Count); ++i)
+	{
+		const auto stage = static_cast<LatencyStage>(i);
+		const auto stats = GetStats(stage);
+		if (stats.count == 0)
+			continue;
+
+		logger->WriteInfo(QString("%1 %2 %3 %4 %5 %6 %7\r\n")
+			.arg(GetStageName(stage), -12)
+			.arg(static_cast<qulonglong>(stats.count), 9)
+			.arg(stats.mean / 1000, 9, 'f', 2)
+			.arg(stats.p50 / 1000.0, 9, 'f', 2)
+			.arg(stats.p90 / 1000.0, 9, 'f', 2)
+			.arg(stats.p99 / 1000.0, 9, 'f', 2)
+			.arg(stats.max / 1000.0, 9, 'f', 2));
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+//Microseconds; percentiles are the top of their bucket, at most 1/32 above
+//the values in it
+struct LatencyStats
+{
+	uint64_t count;
+	double mean;
+	int64_t p50;
+	int64_t p90;
+	int64_t p99;
+	int64_t max;
+};
+
+//Log-linear (HDR style) histogram of durations: 32 linear buckets per power
+//of two, microseconds up to an hour. Record() is a few relaxed atomic
+//increments, so any number of threads can add to it on their hot path
+//while another reads percentiles
+class LatencyHistogram
+{
+public:
+	static const int SubBucketBits = 5;
+	static const int MaxValueBits = 32;
+	static const size_t BucketCount = (MaxValueBits - SubBucketBits + 1) << SubBucketBits;
+
+	//Lowest and highest value counted in a bucket
+	static int64_t GetBucketLow(size_t bucket);
+	static int64_t GetBucketHigh(size_t bucket);
+	static size_t GetBucket(int64_t microseconds);
+
+public:
+	LatencyHistogram();
+
+	//Not while Record() may be called
+	void Reset();
+
+	void Record(int64_t microseconds);
+	void Record(std::chrono::steady_clock::duration duration)
+	{
+		Record(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+	}
+
+	//Consistent only once recording has stopped, close enough while it runs
+	LatencyStats GetStats() const;
+
+private:
+	std::atomic<uint64_t> m_buckets[BucketCount];
+	std::atomic<uint64_t> m_count;
+	std::atomic<uint64_t> m_total;
+	std::atomic<int64_t> m_max;
+};
+
+enum class LatencyStage
+{
+	Capture,	//Source to queue slot, GPU readback included
+	Convert,	//Colour conversion and scaling
+	Encode,		//Encoder calls, without waiting for the muxer
+	Mux,		//One packet into the file
+	Count
+};
+
+//One histogram per pipeline stage, filled by capture, encoder and mux
+//threads of a session
+class StageLatency
+{
+public:
+	static const char* GetStageName(LatencyStage stage);
+
+public:
+	void Reset();
+
+	void Record(LatencyStage stage, std::chrono::steady_clock::duration duration)
+	{
+		m_stages[static_cast<int>(stage)].Record(duration);
+	}
+
+	LatencyStats GetStats(LatencyStage stage) const { return m_stages[static_cast<int>(stage)].GetStats(); }
+
+	//Stage by stage, in milliseconds
+	void WriteTable(Logger* logger) const;
+
+private:
+	LatencyHistogram m_stages[static_cast<int>(LatencyStage::Count)];
+};
+
+#endif	//__LATENCY_HISTOGRAM_H__
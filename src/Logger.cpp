@@ -6,6 +6,7 @@
 Logger::Logger(QObject *parent, QString fileName, QPlainTextEdit *editor) : QObject(parent)
 {
 	m_editor = editor;
+	m_file = nullptr;
 	if (!fileName.isEmpty())
 	{
 		m_file = new QFile;
@@ -19,19 +20,25 @@ void Logger::Write(const QString& value)
 	QString text = value;// + "";
 	text = QDateTime::currentDateTime().toString("dd.MM.yyyy hh:mm:ss.ms ") + text;
 
-	QTextStream out(m_file);
-	out.setCodec("UTF-8");
+	QMutexLocker lock(&m_mutex);
+
 	if (m_file != nullptr)
 	{
+		QTextStream out(m_file);
+		out.setCodec("UTF-8");
 		out << text;
 	}
 
 	if (m_editor != nullptr)
 	{
 		QMetaObject::invokeMethod(m_editor, "appendPlainText", Q_ARG(QString, text));
+		QMetaObject::invokeMethod(m_editor, "update");
+	}
+	else
+	{
+		QTextStream err(stderr);
+		err << text;
 	}
-
-	QMetaObject::invokeMethod(m_editor, "update");
 }
 
 void Logger::WriteInfo(const QString& value)
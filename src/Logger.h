@@ -3,6 +3,7 @@
 
 #include <QPlainTextEdit>
 #include <QFile>
+#include <QMutex>
 
 class Logger : public QObject
 {
@@ -13,7 +14,8 @@ public:
 
 private:
 	QFile* m_file;
-	QPlainTextEdit *m_editor;
+	QPlainTextEdit *m_editor;	//Without one messages also go to stderr
+	QMutex m_mutex;			//Written from the capture, encoder and mux threads
 
 signals:
 
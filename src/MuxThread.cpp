@@ -0,0 +1,184 @@
+#include "MuxThread.h"
+#include "FrameSource.h"
+
+#include <algorithm>
+
+MuxThread::MuxThread(Logger* logger)
+	: m_logger(logger), m_stop(false), m_max_bytes(0), m_sync_interval(0), m_timing(nullptr), m_latency(nullptr), m_stats()
+{
+}
+
+MuxThread::~MuxThread()
+{
+	Stop();
+}
+
+void MuxThread::Start(const int64_t maxBytes, const std::chrono::milliseconds syncInterval, FrameTimingLog* timing)
+{
+	Stop();
+
+	m_stop = false;
+	m_max_bytes = maxBytes;
+	m_sync_interval = syncInterval;
+	m_timing = timing;
+	m_stats = MuxStats();
+
+	m_thread = std::thread(&MuxThread::WriterLoop, this);
+}
+
+void MuxThread::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+void MuxThread::Write(const std::shared_ptr<OutputFile>& output, AVPacket* pkt, const AVRational timeBase,
+	const frame_timing_record* timing)
+{
+	mux_item item;
+	item.output = output;
+	item.pkt = av_packet_alloc();
+	item.time_base = timeBase;
+	item.timed = timing && m_timing;
+	if (item.timed)
+		item.timing = *timing;
+	if (!item.pkt)
+	{
+		m_logger->WriteError("Could not allocate a packet for the muxer\r\n");
+		av_packet_unref(pkt);
+		return;
+	}
+	av_packet_move_ref(item.pkt, pkt);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	//One packet always fits, however large
+	if (m_stats.queued_bytes > 0 && m_stats.queued_bytes + item.pkt->size > m_max_bytes)
+	{
+		++m_stats.waits;
+		m_space.wait(lock, [&]() { return m_stats.queued_bytes == 0 || m_stats.queued_bytes + item.pkt->size <= m_max_bytes; });
+	}
+
+	m_stats.queued_bytes += item.pkt->size;
+	m_queue.push_back(std::move(item));
+	m_stats.depth = m_queue.size();
+	m_stats.high_water = std::max(m_stats.high_water, m_stats.depth);
+
+	lock.unlock();
+	m_wake.notify_one();
+}
+
+void MuxThread::Close(const std::shared_ptr<OutputFile>& output, const std::string& comment)
+{
+	mux_item item;
+	item.output = output;
+	item.pkt = nullptr;
+	item.time_base = AVRational{ 0, 1 };
+	item.comment = comment;
+	item.timed = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(std::move(item));
+		m_stats.depth = m_queue.size();
+	}
+	m_wake.notify_one();
+}
+
+MuxStats MuxThread::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void MuxThread::WriterLoop()
+{
+	typedef std::chrono::steady_clock clock;
+
+	//Whatever is being written to now is what gets synced
+	std::shared_ptr<OutputFile> current;
+	auto lastSync = clock::now();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		//Wake up for syncs too, a file should not sit unsynced because
+		//nothing more came for it
+		const auto ready = [&]() { return m_stop || !m_queue.empty(); };
+		if (current && m_sync_interval.count() > 0)
+			m_wake.wait_until(lock, lastSync + m_sync_interval, ready);
+		else
+			m_wake.wait(lock, ready);
+
+		if (m_queue.empty() && m_stop)
+			break;
+
+		if (!m_queue.empty())
+		{
+			auto item = std::move(m_queue.front());
+			m_queue.pop_front();
+			m_stats.depth = m_queue.size();
+			lock.unlock();
+
+			const bool packet = item.pkt != nullptr;
+			bool ok;
+			int64_t size = 0;
+			double elapsed = 0;
+			if (packet)
+			{
+				size = item.pkt->size;
+				const auto start = clock::now();
+				ok = item.output->WritePacket(item.pkt, item.time_base);
+				const auto end = clock::now();
+				elapsed = std::chrono::duration<double>(end - start).count();
+				if (m_latency)
+					m_latency->Record(LatencyStage::Mux, end - start);
+				av_packet_free(&item.pkt);
+				current = item.output;
+
+				//Written to the file, not necessarily to disk yet
+				if (item.timed)
+				{
+					if (ok)
+						item.timing.mux_time = FrameSource::Now();
+					m_timing->Append(item.timing);
+				}
+			}
+			else
+			{
+				ok = item.output->Close(item.comment);
+				if (current == item.output)
+					current.reset();
+			}
+
+			lock.lock();
+			m_stats.queued_bytes -= size;
+			if (packet)
+				++m_stats.written;
+			if (!ok)
+				++m_stats.failed;
+			m_stats.worst_write = std::max(m_stats.worst_write, elapsed);
+			m_space.notify_one();
+		}
+
+		if (current && m_sync_interval.count() > 0 && clock::now() - lastSync >= m_sync_interval)
+		{
+			lock.unlock();
+			const auto start = clock::now();
+			if (!current->Sync())
+				m_logger->WriteError(QString("Could not sync %1\r\n").arg(current->GetFilename().c_str()));
+			const auto now = clock::now();
+			lock.lock();
+
+			m_stats.worst_sync = std::max(m_stats.worst_sync, std::chrono::duration<double>(now - start).count());
+			lastSync = now;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef __MUX_THREAD_H__
+#define __MUX_THREAD_H__
+
+#include "Logger.h"
+#include "OutputFile.h"
+#include "FrameTimingLog.h"
+#include "LatencyHistogram.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct MuxStats
+{
+	size_t depth;			//Packets waiting
+	size_t high_water;
+	int64_t queued_bytes;
+	uint64_t written;
+	uint64_t failed;		//Packets and closes that did not make it to disk
+	uint64_t waits;			//Times Write() blocked on a full queue
+	double worst_write;		//Seconds, one packet into the muxer
+	double worst_sync;		//Seconds, flush and sync to disk
+};
+
+//Muxes and writes packets on a thread of its own, so a slow disk only
+//fills the queue instead of stalling the encoder. Files are closed on the
+//same thread after the last of their packets, and synced on a fixed
+//schedule rather than whenever the OS gets to it
+class MuxThread
+{
+public:
+	MuxThread(Logger* logger);
+	~MuxThread();
+
+	//maxBytes bounds the queue, Write() waits beyond it; syncInterval 0 - never.
+	//Timing records given to Write() go to timing once their packet is written
+	void Start(int64_t maxBytes, std::chrono::milliseconds syncInterval, FrameTimingLog* timing = nullptr);
+	//Writes out everything queued and closes what was asked to be closed
+	void Stop();
+
+	bool IsStarted() const { return m_thread.joinable(); }
+
+	//Packet writes go to its Mux stage from the next Start() on
+	void SetLatency(StageLatency* latency) { m_latency = latency; }
+
+	//Takes the packet's reference, pkt is blank afterwards
+	void Write(const std::shared_ptr<OutputFile>& output, AVPacket* pkt, AVRational timeBase,
+		const frame_timing_record* timing = nullptr);
+	//After every packet queued for it so far
+	void Close(const std::shared_ptr<OutputFile>& output, const std::string& comment);
+
+	MuxStats GetStats() const;
+
+private:
+	struct mux_item
+	{
+		std::shared_ptr<OutputFile> output;
+		AVPacket* pkt;			//nullptr - close the output
+		AVRational time_base;
+		std::string comment;
+		bool timed;
+		frame_timing_record timing;
+	};
+
+	Logger* m_logger;
+
+	std::thread m_thread;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_space;
+	std::deque<mux_item> m_queue;
+	bool m_stop;
+
+	int64_t m_max_bytes;
+	std::chrono::milliseconds m_sync_interval;
+	FrameTimingLog* m_timing;
+	StageLatency* m_latency;
+	MuxStats m_stats;
+
+	void WriterLoop();
+};
+
+#endif	//__MUX_THREAD_H__
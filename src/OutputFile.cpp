@@ -0,0 +1,396 @@
+#include "OutputFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	//Start of the reserved comment, looked for in the file after the trailer
+	const char CommentMark[] = "XTGN-COMMENT-RESERVED";
+	//Muxers that write tags with the header put them within this much
+	const size_t CommentScan = 1024 * 1024;
+	//Below this AVIO would write more often than its own default
+	const size_t MinBufferSize = 32 * 1024;
+}
+
+const char* OutputFile::GetContainerName(const VideoContainer container)
+{
+	switch (container)
+	{
+	case VideoContainer::Matroska:
+		return "matroska";
+	case VideoContainer::FragmentedMp4:
+		return "mp4";
+	case VideoContainer::Avi:
+	default:
+		return "avi";
+	}
+}
+
+bool OutputFile::NeedsGlobalHeader(const VideoContainer container)
+{
+	const auto format = av_guess_format(GetContainerName(container), nullptr, nullptr);
+	return format && (format->flags & AVFMT_GLOBALHEADER);
+}
+
+OutputFile::OutputFile(Logger* logger)
+	: m_logger(logger), m_ftx(nullptr), m_stream(nullptr), m_config(),
+#ifdef _WIN32
+	m_file(nullptr),
+#else
+	m_file(-1),
+#endif
+	m_position(0), m_size(0)
+{
+}
+
+OutputFile::~OutputFile()
+{
+	Free();
+}
+
+bool OutputFile::Open(const std::string& filename, const VideoContainer container, const AVCodecParameters* par,
+	const AVRational timeBase, const AVRational frameRate, const OutputFileConfig& config)
+{
+	Free();
+
+	m_filename = filename;
+	m_config = config;
+	m_position = 0;
+	m_size = 0;
+
+	avformat_alloc_output_context2(&m_ftx, NULL, GetContainerName(container), filename.c_str());
+	if (!m_ftx)
+	{
+		m_logger->WriteError("Could not allocate output context\r\n");
+		return false;
+	}
+
+	m_stream = avformat_new_stream(m_ftx, nullptr);
+	if (!m_stream || avcodec_parameters_copy(m_stream->codecpar, par) < 0)
+	{
+		m_logger->WriteError("Could not create stream to video file\r\n");
+		Free();
+		return false;
+	}
+
+	m_stream->time_base = timeBase;
+	m_stream->avg_frame_rate = frameRate;
+
+	//AVI and Matroska write their tags with the header only, so the comment
+	//gets a placeholder here that Close() overwrites in place
+	if (m_config.comment_size > 0)
+		av_dict_set(&m_ftx->metadata, "comment", GetPaddedComment(CommentMark).c_str(), 0);
+
+	av_dump_format(m_ftx, 0, filename.c_str(), 1);
+
+	if (!(m_ftx->oformat->flags & AVFMT_NOFILE))
+	{
+		if (!OpenFile())
+		{
+			m_logger->WriteError(QString("Could not open file: %1\r\n").arg(filename.c_str()));
+			Free();
+			return false;
+		}
+
+		//A file grown in one piece stays in one piece on disk
+		if (m_config.preallocate > 0 && !Preallocate(m_config.preallocate))
+			m_logger->WriteError(QString("Could not reserve %1 MB for %2\r\n")
+				.arg(static_cast<qlonglong>(m_config.preallocate >> 20)).arg(filename.c_str()));
+
+		//The seek callback makes the context seekable, so the muxers still
+		//go back for their indexes and sizes
+		const auto bufferSize = std::max(m_config.buffer_size, MinBufferSize);
+		const auto buffer = static_cast<uint8_t*>(av_malloc(bufferSize));
+		if (buffer)
+			m_ftx->pb = avio_alloc_context(buffer, static_cast<int>(bufferSize), 1, this, nullptr, WriteBuffer, Seek);
+
+		if (!m_ftx->pb)
+		{
+			av_free(buffer);
+			m_logger->WriteError("Could not allocate the write buffer\r\n");
+			Free();
+			return false;
+		}
+	}
+
+	//Streaming layouts leave nothing big for the trailer, and a file cut off
+	//by a crash stays playable up to the last cluster or fragment written
+	AVDictionary* options = nullptr;
+	switch (container)
+	{
+	case VideoContainer::Matroska:
+		av_dict_set(&options, "cluster_time_limit", "1000", 0);
+		break;
+	case VideoContainer::FragmentedMp4:
+		av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+		break;
+	default:
+		break;
+	}
+
+	//No flush per packet, it would make the write buffer pointless. What
+	//reaches the disk and when is up to Sync()
+	av_dict_set(&options, "flush_packets", "0", 0);
+
+	const auto ret = avformat_write_header(m_ftx, &options);
+
+	const AVDictionaryEntry* unused = nullptr;
+	while ((unused = av_dict_get(options, "", unused, AV_DICT_IGNORE_SUFFIX)))
+		m_logger->WriteError(QString("Muxer option %1 not recognised\r\n").arg(unused->key));
+	av_dict_free(&options);
+
+	if (ret < 0)
+	{
+		m_logger->WriteError("Error write header to file\r\n");
+		Free();
+		return false;
+	}
+
+	m_logger->WriteInfo(QString("Writing %1 to %2\r\n").arg(m_ftx->oformat->long_name).arg(filename.c_str()));
+
+	return true;
+}
+
+bool OutputFile::WritePacket(AVPacket* pkt, const AVRational timeBase)
+{
+	if (!m_ftx)
+	{
+		av_packet_unref(pkt);
+		return false;
+	}
+
+	//The muxer may have picked its own stream time base in write_header
+	av_packet_rescale_ts(pkt, timeBase, m_stream->time_base);
+	pkt->stream_index = m_stream->index;
+
+	//Takes the packet's reference, or unrefs it on failure
+	if (av_interleaved_write_frame(m_ftx, pkt) < 0)
+	{
+		m_logger->WriteError("Error during save\r\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool OutputFile::Sync()
+{
+	if (!m_ftx || !m_ftx->pb)
+		return false;
+
+	avio_flush(m_ftx->pb);
+	if (m_ftx->pb->error < 0)
+		return false;
+
+#ifdef _WIN32
+	return FlushFileBuffers(m_file) != 0;
+#else
+	return fdatasync(m_file) == 0;
+#endif
+}
+
+bool OutputFile::Close(const std::string& comment)
+{
+	if (!m_ftx)
+		return false;
+
+	//Muxers that write tags with the trailer take the final text directly
+	if (m_config.comment_size > 0)
+		av_dict_set(&m_ftx->metadata, "comment", GetPaddedComment(comment).c_str(), 0);
+
+	const bool written = av_write_trailer(m_ftx) >= 0;
+	if (!written)
+		m_logger->WriteError("Error during save\r\n");
+
+	Free();
+
+	if (m_config.comment_size > 0)
+		PatchComment(comment);
+
+	return written;
+}
+
+void OutputFile::Discard()
+{
+	if (!m_ftx)
+		return;
+
+	Free();
+	std::remove(m_filename.c_str());
+}
+
+void OutputFile::Free()
+{
+	if (m_ftx && m_ftx->pb)
+	{
+		avio_flush(m_ftx->pb);
+		av_freep(&m_ftx->pb->buffer);
+		avio_context_free(&m_ftx->pb);
+	}
+
+	CloseFile();
+
+	if (m_ftx)
+		avformat_free_context(m_ftx);
+
+	m_ftx = nullptr;
+	m_stream = nullptr;
+}
+
+bool OutputFile::OpenFile()
+{
+#ifdef _WIN32
+	const auto file = CreateFileA(m_filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_file = file;
+	return true;
+#else
+	m_file = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	return m_file >= 0;
+#endif
+}
+
+void OutputFile::CloseFile()
+{
+#ifdef _WIN32
+	//Space reserved past the end is given back with the last handle
+	if (m_file)
+		CloseHandle(m_file);
+	m_file = nullptr;
+#else
+	if (m_file >= 0)
+	{
+		//Hands back what was reserved and not written
+		if (m_config.preallocate > 0 && ftruncate(m_file, m_size) != 0)
+			m_logger->WriteError(QString("Could not trim %1\r\n").arg(m_filename.c_str()));
+		close(m_file);
+	}
+	m_file = -1;
+#endif
+}
+
+bool OutputFile::Preallocate(const int64_t bytes)
+{
+#ifdef _WIN32
+	FILE_ALLOCATION_INFO info;
+	info.AllocationSize.QuadPart = bytes;
+	return SetFileInformationByHandle(m_file, FileAllocationInfo, &info, sizeof(info)) != 0;
+#elif defined(FALLOC_FL_KEEP_SIZE)
+	return fallocate(m_file, FALLOC_FL_KEEP_SIZE, 0, bytes) == 0;
+#else
+	//Grows the file, CloseFile() cuts it back to what was written
+	return posix_fallocate(m_file, 0, bytes) == 0;
+#endif
+}
+
+int OutputFile::WriteBuffer(void* opaque, uint8_t* buf, const int size)
+{
+	const auto output = static_cast<OutputFile*>(opaque);
+
+	int written = 0;
+	while (written < size)
+	{
+#ifdef _WIN32
+		DWORD chunk = 0;
+		if (!WriteFile(output->m_file, buf + written, static_cast<DWORD>(size - written), &chunk, nullptr) || chunk == 0)
+			return AVERROR(EIO);
+#else
+		const auto chunk = write(output->m_file, buf + written, size - written);
+		if (chunk < 0 && errno == EINTR)
+			continue;
+		if (chunk <= 0)
+			return AVERROR(EIO);
+#endif
+		written += static_cast<int>(chunk);
+	}
+
+	output->m_position += written;
+	if (output->m_position > output->m_size)
+		output->m_size = output->m_position;
+
+	return written;
+}
+
+int64_t OutputFile::Seek(void* opaque, const int64_t offset, const int whence)
+{
+	const auto output = static_cast<OutputFile*>(opaque);
+
+	//The file may be longer on disk when preallocated, the written size is what counts
+	int64_t position;
+	switch (whence & ~AVSEEK_FORCE)
+	{
+	case AVSEEK_SIZE:
+		return output->m_size;
+	case SEEK_SET:
+		position = offset;
+		break;
+	case SEEK_CUR:
+		position = output->m_position + offset;
+		break;
+	case SEEK_END:
+		position = output->m_size + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+#ifdef _WIN32
+	LARGE_INTEGER distance;
+	distance.QuadPart = position;
+	if (!SetFilePointerEx(output->m_file, distance, nullptr, FILE_BEGIN))
+		return AVERROR(EIO);
+#else
+	if (lseek(output->m_file, position, SEEK_SET) < 0)
+		return AVERROR(errno);
+#endif
+
+	output->m_position = position;
+	return position;
+}
+
+std::string OutputFile::GetPaddedComment(const std::string& text) const
+{
+	//Same length every time so the patch never moves anything
+	auto padded = text.substr(0, m_config.comment_size);
+	if (text.size() > m_config.comment_size && padded.size() >= 3)
+		padded.replace(padded.size() - 3, 3, "...");
+	padded.resize(m_config.comment_size, ' ');
+	return padded;
+}
+
+void OutputFile::PatchComment(const std::string& comment) const
+{
+	auto file = fopen(m_filename.c_str(), "r+b");
+	if (!file)
+	{
+		m_logger->WriteError(QString("Could not reopen %1 to write the comment\r\n").arg(m_filename.c_str()));
+		return;
+	}
+
+	std::vector<char> head(CommentScan);
+	head.resize(fread(head.data(), 1, head.size(), file));
+
+	const auto markEnd = CommentMark + sizeof(CommentMark) - 1;
+	const auto found = std::search(head.begin(), head.end(), CommentMark, markEnd);
+	if (found != head.end())
+	{
+		const auto padded = GetPaddedComment(comment);
+		fseek(file, static_cast<long>(found - head.begin()), SEEK_SET);
+		fwrite(padded.data(), 1, padded.size(), file);
+	}
+
+	fclose(file);
+}
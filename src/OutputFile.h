@@ -0,0 +1,96 @@
+#ifndef __OUTPUT_FILE_H__
+#define __OUTPUT_FILE_H__
+
+#include "Logger.h"
+
+#include <string>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#ifdef __cplusplus
+}
+#endif
+
+enum class VideoContainer
+{
+	Avi,			//Index written at the end; CFR only
+	Matroska,
+	FragmentedMp4	//moov up front, one fragment per keyframe
+};
+
+struct OutputFileConfig
+{
+	//Header space reserved for the comment given to Close(), 0 - none
+	size_t comment_size;
+	//AVIO write buffer; the disk sees writes of this size, not per packet
+	size_t buffer_size;
+	//Disk space reserved up front without changing the file size, 0 - none
+	int64_t preallocate;
+};
+
+//One container file with a single video stream, written through its own
+//AVIOContext straight to the OS file. The header is written by Open(), so a
+//file can be opened ahead of time on another thread and take packets the
+//moment it is needed. One thread at a time
+class OutputFile
+{
+public:
+	static const char* GetContainerName(VideoContainer container);
+
+	//Whether the encoder has to put its parameter sets in extradata
+	static bool NeedsGlobalHeader(VideoContainer container);
+
+public:
+	OutputFile(Logger* logger);
+	~OutputFile();
+
+	bool Open(const std::string& filename, VideoContainer container, const AVCodecParameters* par,
+		AVRational timeBase, AVRational frameRate, const OutputFileConfig& config);
+
+	//Trailer, close, then the comment. Safe on a file that failed to open
+	bool Close(const std::string& comment);
+
+	//Closes without a trailer and deletes the file, for one never written to
+	void Discard();
+
+	bool IsOpen() const { return m_ftx != nullptr; }
+	const std::string& GetFilename() const { return m_filename; }
+
+	//pkt timestamps are in timeBase; the packet is consumed
+	bool WritePacket(AVPacket* pkt, AVRational timeBase);
+
+	//Empties the write buffer and waits for the data to reach the disk
+	bool Sync();
+
+private:
+	Logger* m_logger;
+
+	AVFormatContext* m_ftx;
+	AVStream* m_stream;
+	std::string m_filename;
+	OutputFileConfig m_config;
+
+#ifdef _WIN32
+	void* m_file;
+#else
+	int m_file;
+#endif
+	int64_t m_position;
+	int64_t m_size;		//End of the written data
+
+	bool OpenFile();
+	void CloseFile();
+	bool Preallocate(int64_t bytes);
+	void Free();
+
+	static int WriteBuffer(void* opaque, uint8_t* buf, int size);
+	static int64_t Seek(void* opaque, int64_t offset, int whence);
+
+	std::string GetPaddedComment(const std::string& text) const;
+	void PatchComment(const std::string& comment) const;
+};
+
+#endif	//__OUTPUT_FILE_H__
@@ -0,0 +1,643 @@
+#include "RecordingPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+RecordingPipeline::RecordingPipeline(Logger* logger)
+	: m_logger(logger), m_source(nullptr), m_writer(nullptr), m_config(), m_tick_rate(0), m_initialized(false),
+	m_running(false), m_capture_done(false), m_captured(0), m_encoded(0),
+	m_time_base{ 0, 1 }, m_degrade_requested(false), m_timing(nullptr), m_latency(nullptr), m_reference(nullptr), m_static(0),
+	m_thinning(false), m_thin_counter(0)
+{
+}
+
+RecordingPipeline::~RecordingPipeline()
+{
+	Release();
+}
+
+void RecordingPipeline::Initialize(FrameSource* source, XVideoWriter* writer, const PipelineConfig& config)
+{
+	if (m_initialized)
+		Release();
+
+	if (!source || !source->IsInitialized() || !writer || !writer->IsInitialized() || config.framerate <= 0)
+	{
+		m_logger->WriteError("Recording pipeline: source or writer uninitialized\r\n");
+		return;
+	}
+
+	//VFR pts come from capture times, so capture can follow the headset and
+	//take every picture it shows rather than padding to the framerate
+	m_tick_rate = config.framerate;
+	if (config.variable_frame_rate && source->GetRefreshRate() > 0)
+	{
+		m_tick_rate = std::max(1, static_cast<int>(std::lround(source->GetRefreshRate())));
+		m_logger->WriteInfo(QString("Variable frame rate: capturing at the source's %1 Hz\r\n").arg(m_tick_rate));
+	}
+
+	if (config.spool != SpoolMode::Off)
+	{
+		m_ring.Release();
+		if (!m_spool.Create(config.spool_file, config.spool_capacity, source->GetWidth(), source->GetHeight(),
+			source->GetPixelFormat(), source->GetBufferRowCount(), source->GetBufferRowPitch(),
+			m_tick_rate, writer->GetTimeBase()))
+		{
+			m_logger->WriteError(QString("Could not create the spool %1: %2 x %3 bytes\r\n")
+				.arg(config.spool_file.c_str()).arg(config.spool_capacity)
+				.arg(source->GetBufferRowCount() * source->GetBufferRowPitch()));
+			return;
+		}
+
+		m_logger->WriteInfo(QString("Spooling to %1: %2 frames, %3 GB, encoded %4\r\n")
+			.arg(config.spool_file.c_str()).arg(config.spool_capacity)
+			.arg(m_spool.GetFileSize() / double(1 << 30), 0, 'f', 1)
+			.arg(config.spool == SpoolMode::Deferred ? "after capture" : "alongside at low priority"));
+	}
+	else if (!m_ring.Initialize(config.queue_capacity, source->GetWidth(), source->GetHeight(), source->GetPixelFormat(),
+		source->GetBufferRowCount(), source->GetBufferRowPitch(), config.huge_pages))
+	{
+		m_logger->WriteError(QString("Could not allocate frame queue: %1 x %2 bytes\r\n")
+			.arg(config.queue_capacity).arg(source->GetBufferRowCount() * source->GetBufferRowPitch()));
+		return;
+	}
+
+	m_source = source;
+	m_writer = writer;
+	m_config = config;
+	m_captured = 0;
+	m_encoded = 0;
+	m_drops.Reset();
+	m_time_base = writer->GetTimeBase();
+	m_degrade_requested = false;
+	m_timing = writer->GetTimingLog();
+
+	if (m_config.keep_every < 2)
+		m_config.keep_every = 2;
+
+	ReleaseOutputs();
+	if (!config.outputs.empty() && !InitializeOutputs(source, writer, config))
+		return;
+
+	//Spooling is about keeping every frame: nothing is given up to catch up,
+	//and static frames are not compared, as that would copy each one out
+	if (config.spool != SpoolMode::Off)
+	{
+		m_config.overload_policy = OverloadPolicy::DropNewest;
+		m_config.static_detection = false;
+	}
+
+	m_static = 0;
+	m_detector.Release();
+	if (m_config.static_detection)
+	{
+		if (m_reference)
+			av_frame_unref(m_reference);
+		else
+			m_reference = av_frame_alloc();
+
+		if (!m_reference)
+		{
+			m_logger->WriteError("Could not allocate the static frame reference\r\n");
+			return;
+		}
+
+		m_detector.Initialize(config.static_row_step, config.static_tolerance);
+		m_logger->WriteInfo(QString("Static frame detection: tolerance %1, every %2 rows, %3 kernel\r\n")
+			.arg(config.static_tolerance).arg(std::max(config.static_row_step, 1))
+			.arg(ColorConverter::GetSimdLevelName(m_detector.GetSimdLevel())));
+	}
+
+	//Armed here rather than in Run() so a Stop() that comes before the
+	//capture thread gets going is not lost
+	m_running = true;
+	m_initialized = true;
+}
+
+void RecordingPipeline::Release()
+{
+	Stop();
+
+	m_initialized = false;
+	if (m_reference)
+		av_frame_free(&m_reference);
+	m_detector.Release();
+	m_ring.Release();
+	m_spool.Release();
+	ReleaseOutputs();
+	m_source = nullptr;
+	m_writer = nullptr;
+	m_timing = nullptr;
+}
+
+void RecordingPipeline::Run()
+{
+	if (!m_initialized)
+		return;
+
+	m_capture_done = false;
+
+	for (const auto& output : m_outputs)
+		output->Start(m_config.queue_capacity);
+
+	std::thread encoder(&RecordingPipeline::EncodeLoop, this);
+
+	CaptureLoop();
+
+	m_capture_done.store(true, std::memory_order_release);
+	encoder.join();
+
+	//Whatever the outputs still hold is encoded before the files are closed
+	for (const auto& output : m_outputs)
+		output->Finish();
+
+	const auto stats = GetQueueStats();
+	m_logger->WriteInfo(QString("Frames captured %1, encoded %2; %3 capacity %4, high-water %5, overflows %6\r\n")
+		.arg(m_captured.load()).arg(m_encoded.load()).arg(m_spool.IsInitialized() ? "spool" : "queue")
+		.arg(stats.capacity).arg(stats.high_water).arg(stats.overflows));
+
+	if (m_ring.IsInitialized())
+	{
+		const auto pool = m_ring.GetPoolStats();
+		m_logger->WriteInfo(QString("Frame pool: %1 buffers of %2 bytes%3, outstanding %4, peak %5\r\n")
+			.arg(pool.allocated).arg(pool.buffer_size).arg(pool.huge_pages ? " on large pages" : "")
+			.arg(pool.outstanding).arg(pool.peak));
+	}
+
+	const auto pacer = m_pacer.GetStats();
+	m_logger->WriteInfo(QString("Pacing: %1 ticks, %2 late, %3 skipped, %4 duplicated; jitter mean %5 us, max %6 us\r\n")
+		.arg(pacer.ticks).arg(pacer.late).arg(pacer.skipped).arg(pacer.duplicated)
+		.arg(pacer.mean_jitter, 0, 'f', 1).arg(pacer.max_jitter));
+
+	ReportDrops();
+
+	if (m_reference)
+		av_frame_unref(m_reference);
+
+	if (m_detector.IsInitialized())
+	{
+		const auto captured = m_captured.load();
+		m_logger->WriteInfo(QString("Static frames %1 of %2 (%3%), %4\r\n")
+			.arg(m_static.load()).arg(captured)
+			.arg(captured ? 100.0 * m_static / captured : 0.0, 0, 'f', 1)
+			.arg(m_config.variable_frame_rate ? "skipped" : "sent as duplicates"));
+	}
+
+	//The writer is closed after a run, a new experiment initializes again
+	m_initialized = false;
+}
+
+void RecordingPipeline::Stop()
+{
+	m_running = false;
+}
+
+void RecordingPipeline::FinishSpool(const bool written)
+{
+	if (!m_spool.IsInitialized())
+		return;
+
+	const auto spooled = m_spool.GetWritten();
+	const auto filename = m_spool.GetFilename();
+	if (written && m_encoded == spooled)
+	{
+		m_logger->WriteInfo(QString("Spool verified, all %1 frames encoded; removing %2\r\n")
+			.arg(static_cast<qulonglong>(spooled)).arg(filename.c_str()));
+		m_spool.Release(true);
+		return;
+	}
+
+	//Every frame is still in there with its pts, nothing is lost yet
+	m_logger->WriteError(QString("Spool kept at %1: %2 of %3 frames encoded%4\r\n")
+		.arg(filename.c_str()).arg(m_encoded.load()).arg(static_cast<qulonglong>(spooled))
+		.arg(written ? "" : ", the recording did not close cleanly"));
+	m_spool.Release();
+}
+
+void RecordingPipeline::ReportDrops()
+{
+	const auto total = m_drops.GetTotal();
+	const auto seconds = DropCounter::Format(m_drops.GetSeconds());
+
+	m_logger->WriteInfo(QString("Dropped frames %1: %2 %3, %4 %5, %6 %7\r\n")
+		.arg(total)
+		.arg(m_drops.GetTotal(DropReason::QueueFull)).arg(DropCounter::GetReasonName(DropReason::QueueFull))
+		.arg(m_drops.GetTotal(DropReason::PacerSkip)).arg(DropCounter::GetReasonName(DropReason::PacerSkip))
+		.arg(m_drops.GetTotal(DropReason::Overload)).arg(DropCounter::GetReasonName(DropReason::Overload)));
+
+	if (total)
+		m_logger->WriteInfo(QString("Dropped per second: %1\r\n").arg(seconds.c_str()));
+
+	//Goes into the recording, so gaps can be told from a still picture
+	m_writer->SetComment(GetDropReport());
+}
+
+std::string RecordingPipeline::GetDropReport() const
+{
+	return "dropped_frames=" + std::to_string(m_drops.GetTotal())
+		+ "; dropped_per_second=" + DropCounter::Format(m_drops.GetSeconds());
+}
+
+bool RecordingPipeline::ShouldDiscard(const size_t depth, const size_t capacity)
+{
+	switch (m_config.overload_policy)
+	{
+	case OverloadPolicy::DropOldest:
+		//Anything more than half a queue behind is too old to be worth it
+		return depth > capacity / 2;
+
+	case OverloadPolicy::KeepEveryNth:
+		//Hysteresis so the rate does not flip every frame
+		if (depth > capacity / 2)
+			m_thinning = true;
+		else if (depth <= capacity / 4)
+			m_thinning = false;
+
+		if (!m_thinning)
+		{
+			m_thin_counter = 0;
+			return false;
+		}
+
+		return m_thin_counter++ % m_config.keep_every != 0;
+
+	default:
+		return false;
+	}
+}
+
+void RecordingPipeline::CaptureLoop()
+{
+	auto lastReport = std::chrono::steady_clock::now();
+	int64_t nextTick = 0;
+
+	const AVRational microseconds = { 1, 1000000 };
+	const auto timeBase = m_writer->GetTimeBase();
+	int64_t firstTimestamp = AV_NOPTS_VALUE;
+
+	m_pacer.Start(m_tick_rate, m_config.late_tick_policy);
+
+	while (m_running)
+	{
+		const auto tick = m_pacer.WaitNextTick();
+
+		//Ticks the pacer jumped over are frames missing from the recording too
+		const auto second = tick.index / m_tick_rate;
+		if (tick.index > nextTick)
+		{
+			m_drops.Add(second, DropReason::PacerSkip, tick.index - nextTick);
+			AddTiming(m_config.variable_frame_rate ? AV_NOPTS_VALUE : nextTick, AV_NOPTS_VALUE,
+				FrameTimingStatus::Dropped, DropReason::PacerSkip, static_cast<int>(tick.index - nextTick));
+		}
+		nextTick = tick.index + 1 + tick.repeat;
+
+		//The source writes straight into the queued frame; a full queue
+		//means this tick is dropped. The pts is the tick number, or the
+		//capture time in VFR mode, so the video stays as long as the session
+		//whatever was dropped
+		const auto slot = m_spool.IsInitialized() ? m_spool.BeginWrite() : m_ring.BeginWrite();
+		const auto captureStart = std::chrono::steady_clock::now();
+		if (slot && m_source->CaptureFrame(slot->frame))
+		{
+			if (m_latency)
+				m_latency->Record(LatencyStage::Capture, std::chrono::steady_clock::now() - captureStart);
+
+			slot->timestamp = m_source->GetTimestamp();
+			if (m_config.variable_frame_rate)
+			{
+				if (firstTimestamp == AV_NOPTS_VALUE)
+					firstTimestamp = slot->timestamp;
+
+				slot->frame->pts = av_rescale_q(slot->timestamp - firstTimestamp, microseconds, timeBase);
+				slot->repeat = 0;
+			}
+			else
+			{
+				slot->frame->pts = tick.index;
+				slot->repeat = tick.repeat;
+			}
+			if (m_spool.IsInitialized())
+				m_spool.EndWrite();
+			else
+				m_ring.EndWrite();
+			++m_captured;
+		}
+		else if (!slot)
+		{
+			m_drops.Add(second, DropReason::QueueFull, 1 + tick.repeat);
+			//Never captured; the time is that of the tick it was due at
+			AddTiming(m_config.variable_frame_rate ? AV_NOPTS_VALUE : tick.index, FrameSource::Now(),
+				FrameTimingStatus::Dropped, DropReason::QueueFull, 1 + tick.repeat);
+			if (m_config.overload_policy == OverloadPolicy::DegradeResolution)
+				RequestDegrade();
+		}
+
+		//Tell once a second where frames went missing
+		if (std::chrono::steady_clock::now() - lastReport >= std::chrono::seconds(1))
+		{
+			const auto dropped = m_drops.TakeNew();
+			if (!dropped.empty())
+				m_logger->WriteError(QString("Frames dropped per second: %1\r\n").arg(DropCounter::Format(dropped).c_str()));
+
+			//Segments closed along the way carry the report up to then
+			if (!dropped.empty() && m_writer->IsSegmented())
+				m_writer->SetComment(GetDropReport());
+			lastReport = std::chrono::steady_clock::now();
+		}
+	}
+
+	m_pacer.Stop();
+}
+
+void RecordingPipeline::EncodeSlot(FrameSlot* slot, int& staticRun)
+{
+	const auto pts = slot->frame->pts;
+
+	//At least one real frame a second, so a long still stays seekable and
+	//a VFR file does not go quiet
+	if (m_detector.IsInitialized() && staticRun < m_tick_rate
+		&& m_detector.IsStatic(slot->frame, m_reference))
+	{
+		++staticRun;
+		m_static += 1 + slot->repeat;
+
+		if (m_config.variable_frame_rate)
+		{
+			AddTiming(pts, slot->timestamp, FrameTimingStatus::Static, DropReason::Count);
+			return;
+		}
+
+		for (int i = 0; i <= slot->repeat; ++i)
+			Send(slot->frame, pts + i, slot->timestamp, true);
+		return;
+	}
+
+	staticRun = 0;
+	if (m_detector.IsInitialized())
+	{
+		//Holding the buffer makes the ring give that slot a fresh one next time
+		av_frame_unref(m_reference);
+		av_frame_ref(m_reference, slot->frame);
+	}
+
+	//Duplicates for ticks the capture loop woke up too late for
+	for (int i = 0; i <= slot->repeat; ++i)
+		Send(slot->frame, pts + i, slot->timestamp, i > 0);
+}
+
+void RecordingPipeline::Send(AVFrame* frame, const int64_t pts, const int64_t timestamp, const bool unchanged)
+{
+	if (m_groups.empty())
+	{
+		if (unchanged && m_writer->WriteDuplicate(pts, timestamp))
+			return;
+
+		frame->pts = pts;
+		m_writer->WriteFrame(frame, timestamp);
+		return;
+	}
+
+	//Converted once per group; the outputs take references, so a queued
+	//frame keeps its buffer and the next conversion gets another
+	for (auto& group : m_groups)
+	{
+		const AVFrame* picture = frame;
+		if (group.converter->IsInitialized())
+		{
+			if (!unchanged || !group.converted)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				group.converted = group.converter->Convert(frame, group.frame);
+				//The main output is the first and so is its group; the
+				//stages are those of the main output only
+				if (m_latency && group.converted && &group == &m_groups.front())
+					m_latency->Record(LatencyStage::Convert, std::chrono::steady_clock::now() - start);
+			}
+			if (!group.converted)
+				continue;
+
+			picture = group.frame;
+		}
+
+		//The other outputs drop on their own when they fall behind
+		for (const auto output : group.outputs)
+		{
+			if (output->GetWriter() == m_writer)
+				PushMain(output, picture, pts, timestamp);
+			else
+				output->Push(picture, pts, timestamp);
+		}
+	}
+}
+
+void RecordingPipeline::PushMain(TeeOutput* output, const AVFrame* picture, const int64_t pts, const int64_t timestamp)
+{
+	//Drops of the main output are missing from the recording, so they go
+	//into its drop report as well as the output's own count
+	const auto second = [&](const int64_t framePts) { return static_cast<int64_t>(framePts * av_q2d(m_time_base)); };
+
+	if (m_config.overload_policy == OverloadPolicy::DropOldest)
+	{
+		//Anything more than half a queue behind is too old to be worth it
+		for (const auto dropped : output->DropOldest(output->GetCapacity() / 2))
+			m_drops.Add(second(dropped), DropReason::Overload);
+	}
+	else if (ShouldDiscard(output->GetDepth(), output->GetCapacity()))
+	{
+		m_drops.Add(second(pts), DropReason::Overload);
+		AddTiming(pts, timestamp, FrameTimingStatus::Dropped, DropReason::Overload);
+		return;
+	}
+
+	if (!output->Push(picture, pts, timestamp))
+	{
+		m_drops.Add(second(pts), DropReason::QueueFull);
+		if (m_config.overload_policy == OverloadPolicy::DegradeResolution)
+			RequestDegrade();
+	}
+}
+
+void RecordingPipeline::RequestDegrade()
+{
+	//A segmented writer shrinks at its next segment, otherwise the caller
+	//does at the next session
+	if (m_writer->IsSegmented())
+		m_writer->RequestDownscale();
+	else if (!m_degrade_requested)
+	{
+		m_degrade_requested = true;
+		m_logger->WriteError("Encoder falling behind: next session will be recorded at a lower resolution\r\n");
+	}
+}
+
+bool RecordingPipeline::InitializeOutputs(FrameSource* source, XVideoWriter* writer, const PipelineConfig& config)
+{
+	m_outputs.push_back(std::make_unique<TeeOutput>(m_logger, "main", writer));
+	for (const auto& output : config.outputs)
+	{
+		auto tee = std::make_unique<TeeOutput>(m_logger, output.name);
+		if (!tee->Initialize(output.writer, source->GetPixelFormat()))
+		{
+			ReleaseOutputs();
+			return false;
+		}
+		m_outputs.push_back(std::move(tee));
+	}
+
+	for (const auto& output : m_outputs)
+	{
+		const auto& target = output->GetWriter()->GetConfig();
+		const auto format = output->GetWriter()->GetPixelFormat();
+
+		auto group = std::find_if(m_groups.begin(), m_groups.end(), [&](const tee_group& other)
+		{
+			const auto& shared = other.outputs.front()->GetWriter()->GetConfig();
+			return other.outputs.front()->GetWriter()->GetPixelFormat() == format
+				&& shared.width == target.width && shared.height == target.height
+				&& shared.color_matrix == target.color_matrix && shared.color_range == target.color_range;
+		});
+
+		if (group == m_groups.end())
+		{
+			tee_group created;
+			created.converter = std::make_unique<FrameConverter>(m_logger);
+			created.frame = av_frame_alloc();
+			created.converted = false;
+			if (!created.frame || !created.converter->Initialize(source->GetPixelFormat(), source->GetWidth(), source->GetHeight(),
+				format, target.width, target.height, target.color_matrix, target.color_range, target.conversion_bands))
+			{
+				m_logger->WriteError(QString("Could not set up the conversion for output %1\r\n").arg(output->GetName().c_str()));
+				av_frame_free(&created.frame);
+				ReleaseOutputs();
+				return false;
+			}
+
+			created.frame->format = format;
+			created.frame->width = target.width;
+			created.frame->height = target.height;
+			m_groups.push_back(std::move(created));
+			group = m_groups.end() - 1;
+		}
+
+		group->outputs.push_back(output.get());
+	}
+
+	m_logger->WriteInfo(QString("Recording %1 outputs with %2 conversions\r\n").arg(m_outputs.size()).arg(m_groups.size()));
+	return true;
+}
+
+void RecordingPipeline::ReleaseOutputs()
+{
+	for (const auto& output : m_outputs)
+		output->Finish();
+
+	for (auto& group : m_groups)
+		av_frame_free(&group.frame);
+
+	m_groups.clear();
+	m_outputs.clear();
+}
+
+std::vector<TeeOutputStats> RecordingPipeline::GetOutputStats() const
+{
+	std::vector<TeeOutputStats> stats;
+	for (const auto& output : m_outputs)
+		stats.push_back(output->GetStats());
+	return stats;
+}
+
+bool RecordingPipeline::CloseOutputs()
+{
+	//The writer itself is closed by its owner
+	bool complete = true;
+	for (size_t i = 1; i < m_outputs.size(); ++i)
+		complete = m_outputs[i]->GetWriter()->CloseFile() && complete;
+	return complete;
+}
+
+void RecordingPipeline::EncodeLoop()
+{
+	int staticRun = 0;
+	m_thinning = false;
+	m_thin_counter = 0;
+
+	const bool spooling = m_spool.IsInitialized();
+	if (spooling && m_config.spool == SpoolMode::Deferred)
+	{
+		//The whole machine belongs to capture until it stops
+		while (!m_capture_done.load(std::memory_order_acquire))
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		m_logger->WriteInfo(QString("Encoding %1 spooled frames\r\n").arg(static_cast<qulonglong>(m_spool.GetWritten())));
+	}
+	else if (spooling)
+	{
+		//Whatever capture leaves over. Elsewhere the thread keeps the normal
+		//priority, the spool takes up what the encoder does not keep up with
+#ifdef _WIN32
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+	}
+
+	while (true)
+	{
+		//Read the flag before the queue so a frame published just before the
+		//capture loop finished is never left behind
+		const auto done = m_capture_done.load(std::memory_order_acquire);
+
+		const auto slot = spooling ? m_spool.BeginRead() : m_ring.BeginRead();
+		if (!slot)
+		{
+			if (done)
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		//With more outputs the ring only hands frames on to their queues
+		if (m_groups.empty() && ShouldDiscard(m_ring.GetDepth(), m_ring.GetCapacity()))
+		{
+			const auto second = static_cast<int64_t>(slot->frame->pts * av_q2d(m_time_base));
+			m_drops.Add(second, DropReason::Overload, 1 + slot->repeat);
+			AddTiming(slot->frame->pts, slot->timestamp, FrameTimingStatus::Dropped, DropReason::Overload, 1 + slot->repeat);
+			m_ring.EndRead();
+			continue;
+		}
+
+		EncodeSlot(slot, staticRun);
+
+		if (spooling)
+			m_spool.EndRead();
+		else
+			m_ring.EndRead();
+		++m_encoded;
+	}
+}
+
+void RecordingPipeline::AddTiming(const int64_t pts, const int64_t timestamp, const FrameTimingStatus status,
+	const DropReason reason, const int count)
+{
+	if (!m_timing)
+		return;
+
+	frame_timing_record record = {};
+	if (timestamp != AV_NOPTS_VALUE)
+	{
+		record.capture_time = timestamp;
+		record.capture_utc = FrameTimingLog::ToUtc(timestamp);
+	}
+	record.status = static_cast<uint8_t>(status);
+	record.drop_reason = static_cast<uint8_t>(reason);
+
+	for (int i = 0; i < count; ++i)
+	{
+		record.pts = pts != AV_NOPTS_VALUE ? pts + i : AV_NOPTS_VALUE;
+		m_timing->Append(record);
+	}
+}
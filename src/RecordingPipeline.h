@@ -0,0 +1,178 @@
+#ifndef __RECORDING_PIPELINE_H__
+#define __RECORDING_PIPELINE_H__
+
+#include "Logger.h"
+#include "FrameSource.h"
+#include "FrameRing.h"
+#include "SpoolFile.h"
+#include "FramePacer.h"
+#include "XVideoWriter.h"
+#include "FrameConverter.h"
+#include "TeeOutput.h"
+#include "DropCounter.h"
+#include "StaticFrameDetector.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//What to give up when the encoder cannot keep up with capture
+enum class OverloadPolicy
+{
+	DropNewest,			//A full queue drops the tick being captured
+	DropOldest,			//The encoder skips queued frames to get back to the newest
+	KeepEveryNth,		//While behind, only every Nth queued frame is encoded
+	DegradeResolution	//Drop newest, and ask for a smaller picture from the next segment on
+};
+
+//Raw frames into a spool file instead of the encoder queue
+enum class SpoolMode
+{
+	Off,
+	Deferred,	//Encoded after capture stops
+	Concurrent	//Encoded meanwhile at low priority, as far as it keeps up
+};
+
+struct PipelineConfig
+{
+	int framerate;
+	size_t queue_capacity;
+	bool huge_pages;
+	LateTickPolicy late_tick_policy;
+	//pts from capture timestamps, no padding frames for late ticks
+	bool variable_frame_rate;
+	OverloadPolicy overload_policy;
+	int keep_every;		//N for KeepEveryNth
+	//Frames that match the last encoded one are skipped (VFR) or sent as a
+	//duplicate of it (CFR)
+	bool static_detection;
+	int static_tolerance;	//Mean difference per byte still counted as static
+	int static_row_step;	//1 - compare every row
+	SpoolMode spool;
+	std::string spool_file;
+	size_t spool_capacity;	//Frames
+	//More files from the same capture. The writer is then one output among
+	//them and takes frames already converted, see TeeOutput
+	std::vector<TeeOutputConfig> outputs;
+};
+
+//Capture and encode on separate threads: the capture loop writes each frame
+//into a FrameRing slot and the encoder thread drains the ring into
+//XVideoWriter, so an encoder stall shows up as queue depth instead of a
+//missed capture
+class RecordingPipeline
+{
+public:
+	//Header space reserved for the drop report, see XVideoWriter::SetComment()
+	static const size_t DropReportSize = 16 * 1024;
+
+public:
+	RecordingPipeline(Logger* logger);
+	~RecordingPipeline();
+
+	void Initialize(FrameSource* source, XVideoWriter* writer, const PipelineConfig& config);
+	//Capture times, and conversions for several outputs, go to latency
+	void SetLatency(StageLatency* latency) { m_latency = latency; }
+	void Release();
+
+	bool IsInitialized() const { return m_initialized; }
+	bool IsRunning() const { return m_running; }
+
+	//Capture loop on the calling thread, encoder on its own thread. Returns
+	//after Stop() once the queue has been drained; one run per Initialize()
+	void Run();
+	void Stop();
+
+	FrameRingStats GetQueueStats() const { return m_spool.IsInitialized() ? m_spool.GetStats() : m_ring.GetStats(); }
+	FramePoolStats GetPoolStats() const { return m_ring.GetPoolStats(); }
+	FramePacerStats GetPacerStats() const { return m_pacer.GetStats(); }
+	uint64_t GetCapturedFrames() const { return m_captured; }
+	uint64_t GetEncodedFrames() const { return m_encoded; }
+	uint64_t GetDroppedFrames() const { return m_drops.GetTotal(); }
+	uint64_t GetStaticFrames() const { return m_static; }
+
+	//Set by DegradeResolution once the queue has overflowed while the writer
+	//is not segmented, so the caller can start the next session smaller.
+	//Reading it clears it
+	bool TakeDegradeRequest() { return m_degrade_requested.exchange(false); }
+
+	//After the writer is closed: deletes the spool if every frame in it was
+	//encoded and the writer finished cleanly, keeps it otherwise
+	void FinishSpool(bool written);
+
+	//The writer first, empty unless there are more outputs
+	std::vector<TeeOutputStats> GetOutputStats() const;
+	//After Run(): closes the files of the outputs other than the writer.
+	//True if every one of them is complete
+	bool CloseOutputs();
+
+private:
+	Logger* m_logger;
+
+	FrameSource* m_source;
+	XVideoWriter* m_writer;
+	PipelineConfig m_config;
+	//Capture ticks per second: the framerate, or the source's own rate in VFR
+	int m_tick_rate;
+
+	bool m_initialized;
+	std::atomic<bool> m_running;
+	std::atomic<bool> m_capture_done;
+
+	FrameRing m_ring;
+	SpoolFile m_spool;
+	FramePacer m_pacer;
+	std::atomic<uint64_t> m_captured;
+	std::atomic<uint64_t> m_encoded;
+
+	DropCounter m_drops;
+	AVRational m_time_base;
+	std::atomic<bool> m_degrade_requested;
+
+	//The writer's sidecar, for frames that never get to it
+	FrameTimingLog* m_timing;
+	StageLatency* m_latency;
+
+	StaticFrameDetector m_detector;
+	//Last frame actually encoded, what static frames are compared against
+	AVFrame* m_reference;
+	std::atomic<uint64_t> m_static;
+
+	//KeepEveryNth state of the encode thread
+	bool m_thinning;
+	uint64_t m_thin_counter;
+
+	//Outputs wanting the same format, size and colour share one conversion
+	struct tee_group
+	{
+		std::unique_ptr<FrameConverter> converter;	//Not initialized - the captured frame as is
+		AVFrame* frame;
+		bool converted;		//frame holds the last picture, repeats go out as it
+		std::vector<TeeOutput*> outputs;
+	};
+	std::vector<std::unique_ptr<TeeOutput>> m_outputs;
+	std::vector<tee_group> m_groups;
+
+	void CaptureLoop();
+	void EncodeLoop();
+	//Whether the overload policy discards the frame at the head of a queue
+	//this deep; with more outputs the main one's queue is what falls behind
+	bool ShouldDiscard(size_t depth, size_t capacity);
+	//Overload policy on the main output's queue, then the frame into it
+	void PushMain(TeeOutput* output, const AVFrame* picture, int64_t pts, int64_t timestamp);
+	//Smaller picture from the next segment on, or the next session
+	void RequestDegrade();
+	//Encodes the slot, or repeats the last frame if nothing has changed
+	void EncodeSlot(FrameSlot* slot, int& staticRun);
+	//To the writer or every output; unchanged frames reuse what was sent last
+	void Send(AVFrame* frame, int64_t pts, int64_t timestamp, bool unchanged);
+	//Frames left out, count ticks from pts on; timestamp AV_NOPTS_VALUE - never captured
+	void AddTiming(int64_t pts, int64_t timestamp, FrameTimingStatus status, DropReason reason, int count = 1);
+	bool InitializeOutputs(FrameSource* source, XVideoWriter* writer, const PipelineConfig& config);
+	void ReleaseOutputs();
+	void ReportDrops();
+	std::string GetDropReport() const;
+};
+
+#endif	//__RECORDING_PIPELINE_H__
@@ -0,0 +1,309 @@
+#include "RecordingSession.h"
+#include "EncoderTuner.h"
+
+#include <boost/asio.hpp>
+
+#include <QJsonDocument>
+
+bool RecordingSession::IsGoProRecording(const QByteArray& datagram)
+{
+	const auto status = QJsonDocument::fromBinaryData(datagram);
+	return status["state"].toInt() == 1 && !status["url"].toString().isEmpty();
+}
+
+RecordingSession::RecordingSession(Logger* logger)
+	: m_logger(logger), m_divider(1), m_running(false), m_summary()
+{
+	m_writer = std::make_unique<XVideoWriter>(logger);
+	m_pipeline = std::make_unique<RecordingPipeline>(logger);
+}
+
+RecordingSession::~RecordingSession()
+{
+	Stop();
+	m_pipeline.reset();
+	m_source.reset();
+}
+
+bool RecordingSession::Prepare(const SettingsHolder& settings, const std::string& filename)
+{
+	Stop();
+	m_pipeline->Release();
+
+	m_settings = std::make_unique<SettingsHolder>(settings);
+	m_filename = filename;
+
+	m_latency.Reset();
+	m_writer->SetLatency(&m_latency);
+	m_pipeline->SetLatency(&m_latency);
+
+	m_source.reset(CreateFrameSource(m_settings.get(), m_logger));
+
+	if (!m_source || !m_source->IsInitialized())
+	{
+		m_logger->WriteError("Frame source failed initialization");
+		return false;
+	}
+
+	//The last session could not keep up. Segmented recordings shrink at the
+	//next segment by themselves, otherwise the next session is the next chance
+	if (m_pipeline->TakeDegradeRequest() && m_divider < 4)
+	{
+		m_divider *= 2;
+		m_logger->WriteInfo(QString("Overload: recording at 1/%1 of the configured size\r\n").arg(m_divider));
+	}
+
+	//In stereo the sizes are those of one eye and frames hold both
+	const int eyes = settings.GetStereo() ? 2 : 1;
+
+	VideoWriterConfig writerConfig;
+	writerConfig.filename = filename;
+	writerConfig.container = settings.GetContainer();
+	writerConfig.codec_name = settings.GetCodecName().toStdString();
+	writerConfig.bitrate = settings.GetVideoBitrate() * 1000;	//kb/s -> b/s
+	writerConfig.width = settings.GetVideoWidth() * eyes / m_divider;
+	writerConfig.height = settings.GetVideoHeight() / m_divider;
+	writerConfig.framerate = settings.GetVideoFramerate();
+	writerConfig.variable_frame_rate = settings.GetVariableFrameRate();
+	writerConfig.color_matrix = settings.GetColorMatrix();
+	writerConfig.color_range = settings.GetColorRange();
+	writerConfig.conversion_bands = settings.GetConversionBands();
+	writerConfig.threading = settings.GetEncoderThreading();
+	writerConfig.thread_count = settings.GetEncoderThreads();
+	writerConfig.row_mt = settings.GetEncoderRowMT();
+	writerConfig.preset = settings.GetEncoderPreset().toStdString();
+	writerConfig.crf = settings.GetEncoderCrf();
+	writerConfig.encode_budget = settings.GetEncodeBudget();
+	writerConfig.fastest_preset = settings.GetFastestPreset().toStdString();
+	writerConfig.max_crf = settings.GetMaxCrf();
+	writerConfig.min_bitrate = settings.GetMinBitrate() * 1000;	//kb/s -> b/s
+	writerConfig.comment_size = RecordingPipeline::DropReportSize;
+	writerConfig.segment_minutes = settings.GetSegmentMinutes();
+	writerConfig.segment_bytes = settings.GetSegmentMegabytes() * 1024LL * 1024;
+	writerConfig.write_buffer = settings.GetWriteBuffer() * 1024;
+	writerConfig.mux_queue_bytes = settings.GetMuxQueue() * 1024LL * 1024;
+	writerConfig.sync_interval = settings.GetSyncInterval();
+	writerConfig.expected_minutes = settings.GetExpectedMinutes();
+	writerConfig.lossless = settings.GetLossless();
+	writerConfig.frame_hash = settings.GetFrameHash().toStdString();
+	writerConfig.frame_timing = settings.GetFrameTiming();
+
+	if (writerConfig.lossless)
+	{
+		//The tuner measures YUV encoding, the budget would cost exactness
+		writerConfig.codec_name = settings.GetLosslessCodec().toStdString();
+		writerConfig.encode_budget = false;
+		if (writerConfig.threading == EncoderThreading::AutoTune)
+			writerConfig.threading = EncoderThreading::Auto;
+	}
+
+	if (writerConfig.threading == EncoderThreading::AutoTune)
+	{
+		//Falls back to the codec's own choice if nothing could be measured
+		EncoderTuner tuner(m_logger);
+		if (!tuner.Tune(writerConfig))
+			writerConfig.threading = EncoderThreading::Auto;
+	}
+
+	//With more outputs the pipeline converts for all of them, and the writer
+	//takes frames in its own format and size
+	std::vector<TeeOutputConfig> outputs;
+	for (const auto& extra : settings.GetExtraOutputs())
+	{
+		TeeOutputConfig output;
+		output.name = extra.suffix.toStdString();
+		output.writer = writerConfig;
+		output.writer.filename = GetExtraFilename(filename, output.name);
+		output.writer.codec_name = extra.codec_name.toStdString();
+		output.writer.bitrate = extra.bitrate * 1000;	//kb/s -> b/s
+		output.writer.width = extra.width * eyes / m_divider;
+		output.writer.height = extra.height / m_divider;
+		output.writer.preset = extra.preset.toStdString();
+		output.writer.crf = extra.crf;
+		output.writer.comment_size = 0;
+		//Proxies of a lossless recording are ordinary lossy ones
+		output.writer.lossless = false;
+		output.writer.frame_hash.clear();
+		//Capture times are the same for every output, the main one has them
+		output.writer.frame_timing = false;
+		output.writer.encode_budget = settings.GetEncodeBudget();
+		outputs.push_back(output);
+	}
+
+	if (outputs.empty())
+	{
+		m_writer->Initialize(writerConfig,
+			m_source->GetPixelFormat(),
+			m_source->GetWidth(),
+			m_source->GetHeight());
+	}
+	else
+	{
+		m_writer->Initialize(writerConfig,
+			XVideoWriter::GetEncoderFormat(writerConfig, m_source->GetPixelFormat()),
+			writerConfig.width,
+			writerConfig.height);
+	}
+
+	if (!m_writer->IsInitialized())
+	{
+		m_logger->WriteError("VideoWriter failed initialization");
+		return false;
+	}
+
+	PipelineConfig pipelineConfig;
+	pipelineConfig.framerate = settings.GetVideoFramerate();
+	pipelineConfig.queue_capacity = settings.GetQueueCapacity();
+	pipelineConfig.huge_pages = settings.GetHugePages();
+	pipelineConfig.late_tick_policy = settings.GetLateTickPolicy();
+	pipelineConfig.variable_frame_rate = settings.GetVariableFrameRate();
+	pipelineConfig.overload_policy = settings.GetOverloadPolicy();
+	pipelineConfig.keep_every = settings.GetKeepEvery();
+	pipelineConfig.static_detection = settings.GetStaticDetection();
+	pipelineConfig.static_tolerance = settings.GetStaticTolerance();
+	pipelineConfig.static_row_step = settings.GetStaticRowStep();
+	pipelineConfig.spool = settings.GetSpoolMode();
+	pipelineConfig.spool_file = writerConfig.filename + ".spool";
+	//VFR captures at the headset's own rate, the spool holds the minutes at it
+	const double captureRate = settings.GetVariableFrameRate() && m_source->GetRefreshRate() > 0
+		? m_source->GetRefreshRate() : settings.GetVideoFramerate();
+	pipelineConfig.spool_capacity = static_cast<size_t>(settings.GetSpoolMinutes() * 60 * captureRate);
+	pipelineConfig.outputs = outputs;
+
+	m_pipeline->Initialize(m_source.get(), m_writer.get(), pipelineConfig);
+
+	if (!m_pipeline->IsInitialized())
+	{
+		m_logger->WriteError("Recording pipeline failed initialization");
+		return false;
+	}
+
+	m_logger->WriteInfo("All successfully initialized. Waiting...");
+	return true;
+}
+
+std::string RecordingSession::GetExtraFilename(const std::string& filename, const std::string& suffix)
+{
+	//<name>_<suffix>.<ext>, next to the main file
+	const auto slash = filename.find_last_of("/\\");
+	auto dot = filename.rfind('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		dot = filename.size();
+
+	return filename.substr(0, dot) + "_" + suffix + filename.substr(dot);
+}
+
+bool RecordingSession::IsPrepared() const
+{
+	return m_source && m_source->IsInitialized() && m_writer->IsInitialized() && m_pipeline->IsInitialized();
+}
+
+bool RecordingSession::Start()
+{
+	if (m_running)
+	{
+		m_logger->WriteError("Stop current expirement first");
+		return false;
+	}
+
+	if (!m_source || !m_source->IsInitialized())
+	{
+		m_logger->WriteError("Frame source uninitialized");
+		return false;
+	}
+
+	if (!m_writer->IsInitialized())
+	{
+		m_logger->WriteError("Videowriter uninitialized");
+		return false;
+	}
+
+	if (!m_pipeline->IsInitialized())
+	{
+		m_logger->WriteError("Recording pipeline uninitialized");
+		return false;
+	}
+
+	//The last session's thread finished by itself but was never joined
+	if (m_thread)
+	{
+		m_thread->join();
+		m_thread.reset();
+	}
+
+	m_running = true;
+	m_thread = std::make_unique<std::thread>(&RecordingSession::Run, this);
+	return true;
+}
+
+void RecordingSession::Stop()
+{
+	if (m_thread)
+	{
+		m_pipeline->Stop();
+		m_thread->join();
+		m_thread.reset();
+	}
+}
+
+void RecordingSession::Run()
+{
+	m_logger->WriteInfo("Thread successfully started");
+
+	const auto start = std::chrono::steady_clock::now();
+
+	SendSyncPulse();
+
+	//Capture runs on this thread, encoding on the pipeline's own thread
+	m_pipeline->Run();
+	const auto queue = m_pipeline->GetQueueStats();
+
+	auto written = m_writer->CloseFile();
+	written = m_pipeline->CloseOutputs() && written;
+	m_pipeline->FinishSpool(written);
+	m_logger->WriteInfo("Write file..");
+
+	m_latency.WriteTable(m_logger);
+
+	SessionSummary summary;
+	summary.filename = m_filename;
+	summary.complete = written;
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	summary.divider = m_divider;
+	summary.captured = m_pipeline->GetCapturedFrames();
+	summary.encoded = m_pipeline->GetEncodedFrames();
+	summary.dropped = m_pipeline->GetDroppedFrames();
+	summary.static_frames = m_pipeline->GetStaticFrames();
+	summary.queue = queue;
+	summary.pacer = m_pipeline->GetPacerStats();
+	summary.mux = m_writer->GetMuxStats();
+	summary.outputs = m_pipeline->GetOutputStats();
+	for (int i = 0; i < static_cast<int>(LatencyStage::Count); ++i)
+		summary.latency[i] = m_latency.GetStats(static_cast<LatencyStage>(i));
+	m_summary = summary;
+
+	m_running = false;
+}
+
+void RecordingSession::SendSyncPulse()
+{
+	boost::asio::io_context io;
+	boost::asio::serial_port serial_port(io);
+
+	try
+	{
+		serial_port.set_option(boost::asio::serial_port_base::parity(m_settings->GetPortParity()));
+		serial_port.set_option(boost::asio::serial_port_base::baud_rate(m_settings->GetPortRate()));
+		serial_port.set_option(boost::asio::serial_port_base::character_size(m_settings->GetPortDataBits()));
+		serial_port.set_option(boost::asio::serial_port_base::stop_bits(m_settings->GetPortStopbits()));
+
+		serial_port.open(m_settings->GetPortName().toStdString());
+
+		serial_port.write_some(boost::asio::buffer("1"));
+		serial_port.close();
+	}
+	catch (const boost::system::system_error& ex)
+	{
+		m_logger->WriteError(QString("Error initialization serial port %1: %2").arg(m_settings->GetPortName()).arg(ex.what()));
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef __RECORDING_SESSION_H__
+#define __RECORDING_SESSION_H__
+
+#include "Logger.h"
+#include "FrameSource.h"
+#include "XVideoWriter.h"
+#include "RecordingPipeline.h"
+#include "SettingsHolder.h"
+#include "LatencyHistogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <QByteArray>
+
+//What one session did, filled in once its thread has finished
+struct SessionSummary
+{
+	std::string filename;
+	bool complete;			//Every encoded frame made it into a finished file
+	double seconds;			//Serial pulse to closed file
+	int divider;			//Output size divider the session started with
+	uint64_t captured;
+	uint64_t encoded;
+	uint64_t dropped;
+	uint64_t static_frames;
+	FrameRingStats queue;
+	FramePacerStats pacer;
+	MuxStats mux;
+	std::vector<TeeOutputStats> outputs;	//Empty with one output
+	LatencyStats latency[static_cast<int>(LatencyStage::Count)];
+};
+
+//Frame source, writer and pipeline of one experiment, set up from settings
+//and run on a thread of their own: serial sync pulse, capture and encode
+//until Stop(), then the file is closed. Shared by the window and the
+//headless recorder
+class RecordingSession
+{
+public:
+	//Whether a GoPro status datagram says the camera has started recording
+	static bool IsGoProRecording(const QByteArray& datagram);
+
+	//Where the extra output with this suffix goes when recording to filename
+	static std::string GetExtraFilename(const std::string& filename, const std::string& suffix);
+
+public:
+	RecordingSession(Logger* logger);
+	~RecordingSession();
+
+	//Stops and replaces the previous session
+	bool Prepare(const SettingsHolder& settings, const std::string& filename);
+	bool IsPrepared() const;
+
+	bool Start();
+	//Stops capture and waits for the file to be closed
+	void Stop();
+	bool IsRunning() const { return m_running; }
+
+	//Valid once the session is no longer running
+	SessionSummary GetSummary() const { return m_summary; }
+
+	//For live statistics while running
+	const RecordingPipeline* GetPipeline() const { return m_pipeline.get(); }
+	MuxStats GetMuxStats() const { return m_writer->GetMuxStats(); }
+	std::vector<TeeOutputStats> GetOutputStats() const { return m_pipeline->GetOutputStats(); }
+	LatencyStats GetLatency(LatencyStage stage) const { return m_latency.GetStats(stage); }
+
+private:
+	Logger* m_logger;
+
+	std::unique_ptr<SettingsHolder> m_settings;
+	//Main output only, extra outputs encode on threads of their own. Before
+	//the writer and pipeline, which record into it until they are gone
+	StageLatency m_latency;
+	std::unique_ptr<FrameSource> m_source;
+	std::unique_ptr<XVideoWriter> m_writer;
+	std::unique_ptr<RecordingPipeline> m_pipeline;
+	std::string m_filename;
+
+	//Output size divider raised by the DegradeResolution overload policy
+	int m_divider;
+
+	std::unique_ptr<std::thread> m_thread;
+	std::atomic<bool> m_running;
+
+	SessionSummary m_summary;
+
+	void Run();
+	void SendSyncPulse();
+};
+
+#endif	//__RECORDING_SESSION_H__
@@ -0,0 +1,219 @@
+#include "ReplayFrameSource.h"
+
+#include <thread>
+
+ReplayFrameSource::ReplayFrameSource(Logger* logger)
+	: m_logger(logger), m_initialized(false), m_realtime(false), m_loop(false), m_width(0), m_height(0),
+	m_row_pitch(0), m_timestamp(0), m_start_time(0), m_first_pts(AV_NOPTS_VALUE), m_loop_offset(0), m_last_time(0)
+{
+	m_replay_context = std::make_unique<replay_context>();
+}
+
+ReplayFrameSource::~ReplayFrameSource()
+{
+	Release();
+}
+
+void ReplayFrameSource::Initialize(const std::string& filename, const bool realtime, const bool loop)
+{
+	if (m_initialized)
+		Release();
+
+	m_realtime = realtime;
+	m_loop = loop;
+
+	if (avformat_open_input(&m_replay_context->ftx, filename.c_str(), nullptr, nullptr) < 0)
+	{
+		m_logger->WriteError(QString("Could not open replay file: %1\r\n").arg(filename.c_str()));
+		Release();
+		return;
+	}
+
+	if (avformat_find_stream_info(m_replay_context->ftx, nullptr) < 0)
+	{
+		m_logger->WriteError("Could not find replay stream info\r\n");
+		Release();
+		return;
+	}
+
+	AVCodec* codec = nullptr;
+	m_replay_context->stream_index = av_find_best_stream(m_replay_context->ftx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+	if (m_replay_context->stream_index < 0 || !codec)
+	{
+		m_logger->WriteError("Could not find video stream in replay file\r\n");
+		Release();
+		return;
+	}
+
+	m_replay_context->ctx = avcodec_alloc_context3(codec);
+	if (!m_replay_context->ctx)
+	{
+		m_logger->WriteError("Could not allocate replay codec context\r\n");
+		Release();
+		return;
+	}
+
+	const auto stream = m_replay_context->ftx->streams[m_replay_context->stream_index];
+	if (avcodec_parameters_to_context(m_replay_context->ctx, stream->codecpar) < 0
+		|| avcodec_open2(m_replay_context->ctx, codec, nullptr) < 0)
+	{
+		m_logger->WriteError(QString("Could not open replay decoder %1\r\n").arg(codec->name));
+		Release();
+		return;
+	}
+
+	m_replay_context->frame = av_frame_alloc();
+	m_replay_context->pkt = av_packet_alloc();
+	if (!m_replay_context->frame || !m_replay_context->pkt)
+	{
+		m_logger->WriteError("Could not allocate replay frame\r\n");
+		Release();
+		return;
+	}
+
+	m_width = m_replay_context->ctx->width;
+	m_height = m_replay_context->ctx->height;
+	m_row_pitch = static_cast<size_t>(m_width) * 4;
+
+	m_replay_context->sws_ctx = sws_getContext(m_width, m_height, m_replay_context->ctx->pix_fmt,
+		m_width, m_height, AV_PIX_FMT_RGBA, SWS_POINT, nullptr, nullptr, nullptr);
+	if (!m_replay_context->sws_ctx)
+	{
+		m_logger->WriteError("Could not allocate the replay sws context\r\n");
+		Release();
+		return;
+	}
+
+	m_replay_context->eof = false;
+	m_first_pts = AV_NOPTS_VALUE;
+	m_loop_offset = 0;
+	m_last_time = 0;
+	m_timestamp = 0;
+	m_start_time = Now();
+
+	m_logger->WriteInfo(QString("Replay %1: %2x%3 %4, %5\r\n").arg(filename.c_str()).arg(m_width).arg(m_height)
+		.arg(codec->name).arg(m_realtime ? "real-time" : "as fast as possible"));
+
+	m_initialized = true;
+}
+
+void ReplayFrameSource::Release()
+{
+	m_initialized = false;
+
+	if (m_replay_context->ctx)
+		avcodec_free_context(&m_replay_context->ctx);
+
+	if (m_replay_context->ftx)
+		avformat_close_input(&m_replay_context->ftx);
+
+	if (m_replay_context->frame)
+		av_frame_free(&m_replay_context->frame);
+
+	if (m_replay_context->pkt)
+		av_packet_free(&m_replay_context->pkt);
+
+	if (m_replay_context->sws_ctx)
+		sws_freeContext(m_replay_context->sws_ctx);
+
+	m_replay_context->ctx = nullptr;
+	m_replay_context->ftx = nullptr;
+	m_replay_context->frame = nullptr;
+	m_replay_context->pkt = nullptr;
+	m_replay_context->sws_ctx = nullptr;
+	m_replay_context->stream_index = -1;
+	m_replay_context->eof = false;
+}
+
+bool ReplayFrameSource::DecodeFrame()
+{
+	while (true)
+	{
+		auto ret = avcodec_receive_frame(m_replay_context->ctx, m_replay_context->frame);
+		if (ret >= 0)
+			return true;
+
+		if (ret == AVERROR_EOF)
+			return false;
+
+		if (ret != AVERROR(EAGAIN))
+		{
+			m_logger->WriteError("Error during replay decoding\r\n");
+			return false;
+		}
+
+		if (m_replay_context->eof)
+			return false;
+
+		ret = av_read_frame(m_replay_context->ftx, m_replay_context->pkt);
+		if (ret < 0)
+		{
+			//Drain the decoder
+			m_replay_context->eof = true;
+			avcodec_send_packet(m_replay_context->ctx, nullptr);
+			continue;
+		}
+
+		if (m_replay_context->pkt->stream_index == m_replay_context->stream_index)
+			avcodec_send_packet(m_replay_context->ctx, m_replay_context->pkt);
+
+		av_packet_unref(m_replay_context->pkt);
+	}
+}
+
+bool ReplayFrameSource::Rewind()
+{
+	if (av_seek_frame(m_replay_context->ftx, m_replay_context->stream_index, 0, AVSEEK_FLAG_BACKWARD) < 0)
+	{
+		m_logger->WriteError("Could not rewind replay file\r\n");
+		return false;
+	}
+
+	avcodec_flush_buffers(m_replay_context->ctx);
+	m_replay_context->eof = false;
+
+	//Next pass continues right after the last delivered frame
+	m_loop_offset = m_last_time + 1;
+	m_first_pts = AV_NOPTS_VALUE;
+
+	return true;
+}
+
+bool ReplayFrameSource::CaptureFrame(AVFrame* dst)
+{
+	if (!m_initialized)
+		return false;
+
+	if (!DecodeFrame())
+	{
+		if (!m_loop || !Rewind() || !DecodeFrame())
+			return false;
+	}
+
+	const auto frame = m_replay_context->frame;
+	const auto stream = m_replay_context->ftx->streams[m_replay_context->stream_index];
+
+	auto pts = frame->best_effort_timestamp;
+	if (pts == AV_NOPTS_VALUE)
+		pts = 0;
+	if (m_first_pts == AV_NOPTS_VALUE)
+		m_first_pts = pts;
+
+	const AVRational us = { 1, 1000000 };
+	m_last_time = m_loop_offset + av_rescale_q(pts - m_first_pts, stream->time_base, us);
+
+	if (m_realtime)
+	{
+		const auto wait = m_start_time + m_last_time - Now();
+		if (wait > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(wait));
+	}
+
+	sws_scale(m_replay_context->sws_ctx, frame->data, frame->linesize, 0, frame->height, dst->data, dst->linesize);
+
+	av_frame_unref(frame);
+
+	m_timestamp = m_realtime ? Now() : m_start_time + m_last_time;
+
+	return true;
+}
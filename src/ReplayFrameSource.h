@@ -0,0 +1,76 @@
+#ifndef __REPLAY_FRAME_SOURCE_H__
+#define __REPLAY_FRAME_SOURCE_H__
+
+#include "Logger.h"
+#include "FrameSource.h"
+
+#include <memory>
+#include <string>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#ifdef __cplusplus
+}
+#endif
+
+struct replay_context
+{
+	AVFormatContext* ftx;
+	AVCodecContext* ctx;
+	AVFrame* frame;
+	AVPacket* pkt;
+	struct SwsContext* sws_ctx;
+	int stream_index;
+	bool eof;
+};
+
+//Decodes an existing recording and delivers it as RGBA frames, either at the
+//pace of its timestamps or as fast as the decoder goes
+class ReplayFrameSource : public FrameSource
+{
+public:
+	ReplayFrameSource(Logger* logger);
+	~ReplayFrameSource();
+
+	void Initialize(const std::string& filename, bool realtime, bool loop);
+	void Release() override;
+
+	bool IsInitialized() const override { return m_initialized; }
+
+	int GetWidth() const override { return m_width; }
+	int GetHeight() const override { return m_height; }
+	AVPixelFormat GetPixelFormat() const override { return AV_PIX_FMT_RGBA; }
+
+	size_t GetBufferRowCount() const override { return m_height; }
+	size_t GetBufferRowPitch() const override { return m_row_pitch; }
+	int64_t GetTimestamp() const override { return m_timestamp; }
+
+	bool CaptureFrame(AVFrame* frame) override;
+
+private:
+	Logger* m_logger;
+
+	std::unique_ptr<replay_context> m_replay_context;
+
+	bool m_initialized;
+	bool m_realtime;
+	bool m_loop;
+	int m_width;
+	int m_height;
+	size_t m_row_pitch;
+
+	int64_t m_timestamp;
+	int64_t m_start_time;
+	int64_t m_first_pts;
+	int64_t m_loop_offset;
+	int64_t m_last_time;
+
+	bool DecodeFrame();
+	bool Rewind();
+};
+
+#endif	//__REPLAY_FRAME_SOURCE_H__
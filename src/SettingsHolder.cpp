@@ -3,12 +3,52 @@
 SettingsHolder::SettingsHolder()
 {
 	m_eye = vr::EVREye::Eye_Right;
+	m_stereo = false;
 
+	m_frame_source = FrameSourceType::VR;
+	m_synthetic_width = 2016;
+	m_synthetic_height = 2240;
+	m_replay_realtime = true;
+	m_replay_loop = false;
+
+	m_container = VideoContainer::Matroska;
 	m_codec_name = "libx264";
 	m_video_bitrate = 2500;
 	m_video_width = 800;
 	m_video_height = 600;
 	m_video_framerate = 30;
+	m_variable_frame_rate = false;
+	m_color_matrix = YuvMatrix::BT601;
+	m_color_range = YuvRange::Limited;
+	m_conversion_bands = 0;
+	m_encoder_threading = EncoderThreading::Auto;
+	m_encoder_threads = 0;
+	m_encoder_row_mt = false;
+	m_encoder_preset = "slow";
+	m_encoder_crf = -1;
+	m_encode_budget = false;
+	m_fastest_preset = "veryfast";
+	m_max_crf = 30;
+	m_min_bitrate = 0;
+	m_segment_minutes = 0;
+	m_segment_megabytes = 0;
+	m_write_buffer = 4096;
+	m_mux_queue = 256;
+	m_sync_interval = 5;
+	m_expected_minutes = 0;
+	m_lossless = false;
+	m_lossless_codec = "ffv1";
+	m_frame_timing = false;
+	m_queue_capacity = 8;
+	m_huge_pages = false;
+	m_late_tick_policy = LateTickPolicy::Skip;
+	m_overload_policy = OverloadPolicy::DropNewest;
+	m_keep_every = 2;
+	m_static_detection = false;
+	m_static_tolerance = 0;
+	m_static_row_step = 1;
+	m_spool_mode = SpoolMode::Off;
+	m_spool_minutes = 1;
 
 	m_port_name = "COM1";
 	m_port_rate = 9600;
@@ -24,11 +64,53 @@ SettingsHolder::SettingsHolder(const SettingsHolder& settings)
 {
 	//Initalize properties after load from QSettings
 	SetVREye(settings.m_eye);
+	SetStereo(settings.m_stereo);
+	SetFrameSource(settings.m_frame_source);
+	SetSyntheticWidth(settings.m_synthetic_width);
+	SetSyntheticHeight(settings.m_synthetic_height);
+	SetReplayFile(settings.m_replay_file);
+	SetReplayRealtime(settings.m_replay_realtime);
+	SetReplayLoop(settings.m_replay_loop);
+	SetContainer(settings.m_container);
 	SetCodecName(settings.m_codec_name);
 	SetVideoBitrate(settings.m_video_bitrate);
 	SetVideoWidth(settings.m_video_width);
 	SetVideoHeight(settings.m_video_height);
 	SetVideoFramerate(settings.m_video_framerate);
+	SetVariableFrameRate(settings.m_variable_frame_rate);
+	SetColorMatrix(settings.m_color_matrix);
+	SetColorRange(settings.m_color_range);
+	SetConversionBands(settings.m_conversion_bands);
+	SetEncoderThreading(settings.m_encoder_threading);
+	SetEncoderThreads(settings.m_encoder_threads);
+	SetEncoderRowMT(settings.m_encoder_row_mt);
+	SetEncoderPreset(settings.m_encoder_preset);
+	SetEncoderCrf(settings.m_encoder_crf);
+	SetEncodeBudget(settings.m_encode_budget);
+	SetFastestPreset(settings.m_fastest_preset);
+	SetMaxCrf(settings.m_max_crf);
+	SetMinBitrate(settings.m_min_bitrate);
+	SetSegmentMinutes(settings.m_segment_minutes);
+	SetSegmentMegabytes(settings.m_segment_megabytes);
+	SetWriteBuffer(settings.m_write_buffer);
+	SetMuxQueue(settings.m_mux_queue);
+	SetSyncInterval(settings.m_sync_interval);
+	SetExpectedMinutes(settings.m_expected_minutes);
+	SetLossless(settings.m_lossless);
+	SetLosslessCodec(settings.m_lossless_codec);
+	SetFrameHash(settings.m_frame_hash);
+	SetFrameTiming(settings.m_frame_timing);
+	SetQueueCapacity(settings.m_queue_capacity);
+	SetHugePages(settings.m_huge_pages);
+	SetLateTickPolicy(settings.m_late_tick_policy);
+	SetOverloadPolicy(settings.m_overload_policy);
+	SetKeepEvery(settings.m_keep_every);
+	SetStaticDetection(settings.m_static_detection);
+	SetStaticTolerance(settings.m_static_tolerance);
+	SetStaticRowStep(settings.m_static_row_step);
+	SetSpoolMode(settings.m_spool_mode);
+	SetSpoolMinutes(settings.m_spool_minutes);
+	SetExtraOutputs(settings.m_extra_outputs);
 	SetPortName(settings.m_port_name);
 	SetPortRate(settings.m_port_rate);
 	SetPortDataBits(settings.m_port_databits);
@@ -45,11 +127,133 @@ void SettingsHolder::Load(QSettings* settings)
 	else
 		m_eye = vr::EVREye::Eye_Left;
 
+	m_stereo = settings->value("stereo", "false").toBool();
+
+	const auto source = settings->value("frame_source", "vr").toString();
+	if (source.compare("synthetic", Qt::CaseInsensitive) == 0)
+		m_frame_source = FrameSourceType::Synthetic;
+	else if (source.compare("replay", Qt::CaseInsensitive) == 0)
+		m_frame_source = FrameSourceType::Replay;
+	else
+		m_frame_source = FrameSourceType::VR;
+
+	m_synthetic_width = settings->value("synthetic_width", "2016").toInt();
+	m_synthetic_height = settings->value("synthetic_height", "2240").toInt();
+	m_replay_file = settings->value("replay_file", "").toString();
+	m_replay_realtime = settings->value("replay_realtime", "true").toBool();
+	m_replay_loop = settings->value("replay_loop", "false").toBool();
+
+	const auto container = settings->value("container", "matroska").toString();
+	if (container.compare("avi", Qt::CaseInsensitive) == 0)
+		m_container = VideoContainer::Avi;
+	else if (container.compare("mp4", Qt::CaseInsensitive) == 0)
+		m_container = VideoContainer::FragmentedMp4;
+	else
+		m_container = VideoContainer::Matroska;
+
 	m_codec_name = settings->value("video_codec", "libx264").toString();
 	m_video_bitrate = settings->value("video_bitrate", "2500").toInt();
 	m_video_width = settings->value("video_width", "800").toInt();
 	m_video_height = settings->value("video_height", "600").toInt();
 	m_video_framerate = settings->value("video_framerate", "30").toInt();
+	m_variable_frame_rate = settings->value("video_vfr", "false").toBool();
+
+	const auto matrix = settings->value("color_matrix", "bt601").toString();
+	if (matrix.compare("bt709", Qt::CaseInsensitive) == 0)
+		m_color_matrix = YuvMatrix::BT709;
+	else
+		m_color_matrix = YuvMatrix::BT601;
+
+	const auto range = settings->value("color_range", "limited").toString();
+	if (range.compare("full", Qt::CaseInsensitive) == 0)
+		m_color_range = YuvRange::Full;
+	else
+		m_color_range = YuvRange::Limited;
+
+	m_conversion_bands = settings->value("conversion_bands", "0").toInt();
+
+	const auto threading = settings->value("encoder_threading", "auto").toString();
+	if (threading.compare("frame", Qt::CaseInsensitive) == 0)
+		m_encoder_threading = EncoderThreading::Frame;
+	else if (threading.compare("slice", Qt::CaseInsensitive) == 0)
+		m_encoder_threading = EncoderThreading::Slice;
+	else if (threading.compare("autotune", Qt::CaseInsensitive) == 0)
+		m_encoder_threading = EncoderThreading::AutoTune;
+	else
+		m_encoder_threading = EncoderThreading::Auto;
+
+	m_encoder_threads = settings->value("encoder_threads", "0").toInt();
+	m_encoder_row_mt = settings->value("encoder_row_mt", "false").toBool();
+	m_encoder_preset = settings->value("encoder_preset", "slow").toString();
+	m_encoder_crf = settings->value("encoder_crf", "-1").toInt();
+	m_encode_budget = settings->value("encode_budget", "false").toBool();
+	m_fastest_preset = settings->value("encode_budget_fastest_preset", "veryfast").toString();
+	m_max_crf = settings->value("encode_budget_max_crf", "30").toInt();
+	m_min_bitrate = settings->value("encode_budget_min_bitrate", "0").toInt();
+	m_segment_minutes = settings->value("segment_minutes", "0").toInt();
+	m_segment_megabytes = settings->value("segment_megabytes", "0").toInt();
+	m_write_buffer = settings->value("write_buffer_kb", "4096").toInt();
+	m_mux_queue = settings->value("mux_queue_mb", "256").toInt();
+	m_sync_interval = settings->value("sync_interval", "5").toInt();
+	m_expected_minutes = settings->value("expected_minutes", "0").toInt();
+	m_lossless = settings->value("lossless", "false").toBool();
+	SetLosslessCodec(settings->value("lossless_codec", "ffv1").toString());
+	SetFrameHash(settings->value("frame_hash", "").toString());
+	m_frame_timing = settings->value("frame_timing", "false").toBool();
+	m_queue_capacity = settings->value("queue_capacity", "8").toInt();
+	m_huge_pages = settings->value("huge_pages", "false").toBool();
+
+	const auto latePolicy = settings->value("late_tick_policy", "skip").toString();
+	if (latePolicy.compare("duplicate", Qt::CaseInsensitive) == 0)
+		m_late_tick_policy = LateTickPolicy::Duplicate;
+	else if (latePolicy.compare("catchup", Qt::CaseInsensitive) == 0)
+		m_late_tick_policy = LateTickPolicy::CatchUp;
+	else
+		m_late_tick_policy = LateTickPolicy::Skip;
+
+	const auto overloadPolicy = settings->value("overload_policy", "drop_newest").toString();
+	if (overloadPolicy.compare("drop_oldest", Qt::CaseInsensitive) == 0)
+		m_overload_policy = OverloadPolicy::DropOldest;
+	else if (overloadPolicy.compare("keep_every_nth", Qt::CaseInsensitive) == 0)
+		m_overload_policy = OverloadPolicy::KeepEveryNth;
+	else if (overloadPolicy.compare("degrade_resolution", Qt::CaseInsensitive) == 0)
+		m_overload_policy = OverloadPolicy::DegradeResolution;
+	else
+		m_overload_policy = OverloadPolicy::DropNewest;
+
+	m_keep_every = settings->value("overload_keep_every", "2").toInt();
+	m_static_detection = settings->value("static_detection", "false").toBool();
+	m_static_tolerance = settings->value("static_tolerance", "0").toInt();
+	m_static_row_step = settings->value("static_row_step", "1").toInt();
+
+	const auto spoolMode = settings->value("spool_mode", "off").toString();
+	if (spoolMode.compare("deferred", Qt::CaseInsensitive) == 0)
+		m_spool_mode = SpoolMode::Deferred;
+	else if (spoolMode.compare("concurrent", Qt::CaseInsensitive) == 0)
+		m_spool_mode = SpoolMode::Concurrent;
+	else
+		m_spool_mode = SpoolMode::Off;
+
+	m_spool_minutes = settings->value("spool_minutes", "1").toInt();
+
+	std::vector<ExtraOutputSettings> outputs;
+	const int outputCount = settings->beginReadArray("outputs");
+	for (int i = 0; i < outputCount; ++i)
+	{
+		settings->setArrayIndex(i);
+
+		ExtraOutputSettings output;
+		output.suffix = settings->value("suffix", QString("out%1").arg(i + 1)).toString();
+		output.codec_name = settings->value("video_codec", m_codec_name).toString();
+		output.bitrate = settings->value("video_bitrate", "800").toInt();
+		output.width = settings->value("video_width", m_video_width / 2).toInt();
+		output.height = settings->value("video_height", m_video_height / 2).toInt();
+		output.preset = settings->value("encoder_preset", "veryfast").toString();
+		output.crf = settings->value("encoder_crf", "-1").toInt();
+		outputs.push_back(output);
+	}
+	settings->endArray();
+	SetExtraOutputs(outputs);
 
 	m_port_name = settings->value("port_name", "COM1").toString();
 	m_port_rate = settings->value("port_rate", "9600").toInt();
@@ -99,11 +303,148 @@ void SettingsHolder::Save(QSettings* settings)
 		break;
 	}
 
+	settings->setValue("stereo", m_stereo);
+
+	switch (m_frame_source)
+	{
+	case FrameSourceType::VR:
+		settings->setValue("frame_source", "vr");
+		break;
+	case FrameSourceType::Synthetic:
+		settings->setValue("frame_source", "synthetic");
+		break;
+	case FrameSourceType::Replay:
+		settings->setValue("frame_source", "replay");
+		break;
+	}
+
+	settings->setValue("synthetic_width", m_synthetic_width);
+	settings->setValue("synthetic_height", m_synthetic_height);
+	settings->setValue("replay_file", m_replay_file);
+	settings->setValue("replay_realtime", m_replay_realtime);
+	settings->setValue("replay_loop", m_replay_loop);
+
+	switch (m_container)
+	{
+	case VideoContainer::Avi:
+		settings->setValue("container", "avi");
+		break;
+	case VideoContainer::Matroska:
+		settings->setValue("container", "matroska");
+		break;
+	case VideoContainer::FragmentedMp4:
+		settings->setValue("container", "mp4");
+		break;
+	}
 	settings->setValue("video_codec", m_codec_name);
 	settings->setValue("video_bitrate", m_video_bitrate);
 	settings->setValue("video_width", m_video_width);
 	settings->setValue("video_height", m_video_height);
 	settings->setValue("video_framerate", m_video_framerate);
+	settings->setValue("video_vfr", m_variable_frame_rate);
+	settings->setValue("color_matrix", m_color_matrix == YuvMatrix::BT709 ? "bt709" : "bt601");
+	settings->setValue("color_range", m_color_range == YuvRange::Full ? "full" : "limited");
+	settings->setValue("conversion_bands", m_conversion_bands);
+
+	switch (m_encoder_threading)
+	{
+	case EncoderThreading::Frame:
+		settings->setValue("encoder_threading", "frame");
+		break;
+	case EncoderThreading::Slice:
+		settings->setValue("encoder_threading", "slice");
+		break;
+	case EncoderThreading::AutoTune:
+		settings->setValue("encoder_threading", "autotune");
+		break;
+	default:
+		settings->setValue("encoder_threading", "auto");
+		break;
+	}
+
+	settings->setValue("encoder_threads", m_encoder_threads);
+	settings->setValue("encoder_row_mt", m_encoder_row_mt);
+	settings->setValue("encoder_preset", m_encoder_preset);
+	settings->setValue("encoder_crf", m_encoder_crf);
+	settings->setValue("encode_budget", m_encode_budget);
+	settings->setValue("encode_budget_fastest_preset", m_fastest_preset);
+	settings->setValue("encode_budget_max_crf", m_max_crf);
+	settings->setValue("encode_budget_min_bitrate", m_min_bitrate);
+	settings->setValue("segment_minutes", m_segment_minutes);
+	settings->setValue("segment_megabytes", m_segment_megabytes);
+	settings->setValue("write_buffer_kb", m_write_buffer);
+	settings->setValue("mux_queue_mb", m_mux_queue);
+	settings->setValue("sync_interval", m_sync_interval);
+	settings->setValue("expected_minutes", m_expected_minutes);
+	settings->setValue("lossless", m_lossless);
+	settings->setValue("lossless_codec", m_lossless_codec);
+	settings->setValue("frame_hash", m_frame_hash);
+	settings->setValue("frame_timing", m_frame_timing);
+	settings->setValue("queue_capacity", m_queue_capacity);
+	settings->setValue("huge_pages", m_huge_pages);
+
+	switch (m_late_tick_policy)
+	{
+	case LateTickPolicy::Skip:
+		settings->setValue("late_tick_policy", "skip");
+		break;
+	case LateTickPolicy::Duplicate:
+		settings->setValue("late_tick_policy", "duplicate");
+		break;
+	case LateTickPolicy::CatchUp:
+		settings->setValue("late_tick_policy", "catchup");
+		break;
+	}
+
+	switch (m_overload_policy)
+	{
+	case OverloadPolicy::DropNewest:
+		settings->setValue("overload_policy", "drop_newest");
+		break;
+	case OverloadPolicy::DropOldest:
+		settings->setValue("overload_policy", "drop_oldest");
+		break;
+	case OverloadPolicy::KeepEveryNth:
+		settings->setValue("overload_policy", "keep_every_nth");
+		break;
+	case OverloadPolicy::DegradeResolution:
+		settings->setValue("overload_policy", "degrade_resolution");
+		break;
+	}
+	settings->setValue("overload_keep_every", m_keep_every);
+	settings->setValue("static_detection", m_static_detection);
+	settings->setValue("static_tolerance", m_static_tolerance);
+	settings->setValue("static_row_step", m_static_row_step);
+
+	switch (m_spool_mode)
+	{
+	case SpoolMode::Off:
+		settings->setValue("spool_mode", "off");
+		break;
+	case SpoolMode::Deferred:
+		settings->setValue("spool_mode", "deferred");
+		break;
+	case SpoolMode::Concurrent:
+		settings->setValue("spool_mode", "concurrent");
+		break;
+	}
+	settings->setValue("spool_minutes", m_spool_minutes);
+
+	settings->beginWriteArray("outputs", static_cast<int>(m_extra_outputs.size()));
+	for (size_t i = 0; i < m_extra_outputs.size(); ++i)
+	{
+		const auto& output = m_extra_outputs[i];
+		settings->setArrayIndex(static_cast<int>(i));
+		settings->setValue("suffix", output.suffix);
+		settings->setValue("video_codec", output.codec_name);
+		settings->setValue("video_bitrate", output.bitrate);
+		settings->setValue("video_width", output.width);
+		settings->setValue("video_height", output.height);
+		settings->setValue("encoder_preset", output.preset);
+		settings->setValue("encoder_crf", output.crf);
+	}
+	settings->endArray();
+
 	settings->setValue("port_name", m_port_name);
 	settings->setValue("port_rate", m_port_rate);
 	settings->setValue("port_databits", m_port_databits);
@@ -145,6 +486,52 @@ void SettingsHolder::SetVREye(vr::EVREye eye)
 	m_eye = eye;
 }
 
+void SettingsHolder::SetStereo(bool use)
+{
+	m_stereo = use;
+}
+
+void SettingsHolder::SetFrameSource(FrameSourceType source)
+{
+	m_frame_source = source;
+}
+
+void SettingsHolder::SetSyntheticWidth(int width)
+{
+	if (width <= 0)
+		return;
+
+	m_synthetic_width = width;
+}
+
+void SettingsHolder::SetSyntheticHeight(int height)
+{
+	if (height <= 0)
+		return;
+
+	m_synthetic_height = height;
+}
+
+void SettingsHolder::SetReplayFile(const QString& filename)
+{
+	m_replay_file = filename;
+}
+
+void SettingsHolder::SetReplayRealtime(bool realtime)
+{
+	m_replay_realtime = realtime;
+}
+
+void SettingsHolder::SetReplayLoop(bool loop)
+{
+	m_replay_loop = loop;
+}
+
+void SettingsHolder::SetContainer(VideoContainer container)
+{
+	m_container = container;
+}
+
 void SettingsHolder::SetCodecName(const QString& codecName)
 {
 	m_codec_name = codecName;
@@ -182,6 +569,242 @@ void SettingsHolder::SetVideoFramerate(int framerate)
 	m_video_framerate = framerate;
 }
 
+void SettingsHolder::SetVariableFrameRate(bool use)
+{
+	m_variable_frame_rate = use;
+}
+
+void SettingsHolder::SetColorMatrix(YuvMatrix matrix)
+{
+	m_color_matrix = matrix;
+}
+
+void SettingsHolder::SetColorRange(YuvRange range)
+{
+	m_color_range = range;
+}
+
+void SettingsHolder::SetConversionBands(int bands)
+{
+	if (bands < 0)
+		return;
+
+	m_conversion_bands = bands;
+}
+
+void SettingsHolder::SetEncoderThreading(EncoderThreading threading)
+{
+	m_encoder_threading = threading;
+}
+
+void SettingsHolder::SetEncoderThreads(int threads)
+{
+	if (threads < 0)
+		return;
+
+	m_encoder_threads = threads;
+}
+
+void SettingsHolder::SetEncoderRowMT(bool use)
+{
+	m_encoder_row_mt = use;
+}
+
+void SettingsHolder::SetEncoderPreset(const QString& preset)
+{
+	m_encoder_preset = preset;
+}
+
+void SettingsHolder::SetEncoderCrf(int crf)
+{
+	if (crf < -1)
+		return;
+
+	m_encoder_crf = crf;
+}
+
+void SettingsHolder::SetEncodeBudget(bool use)
+{
+	m_encode_budget = use;
+}
+
+void SettingsHolder::SetFastestPreset(const QString& preset)
+{
+	m_fastest_preset = preset;
+}
+
+void SettingsHolder::SetMaxCrf(int crf)
+{
+	if (crf < 0)
+		return;
+
+	m_max_crf = crf;
+}
+
+void SettingsHolder::SetMinBitrate(int bitrate)
+{
+	if (bitrate < 0)
+		return;
+
+	m_min_bitrate = bitrate;
+}
+
+void SettingsHolder::SetSegmentMinutes(int minutes)
+{
+	if (minutes < 0)
+		return;
+
+	m_segment_minutes = minutes;
+}
+
+void SettingsHolder::SetSegmentMegabytes(int megabytes)
+{
+	if (megabytes < 0)
+		return;
+
+	m_segment_megabytes = megabytes;
+}
+
+void SettingsHolder::SetWriteBuffer(int kilobytes)
+{
+	if (kilobytes <= 0)
+		return;
+
+	m_write_buffer = kilobytes;
+}
+
+void SettingsHolder::SetMuxQueue(int megabytes)
+{
+	if (megabytes <= 0)
+		return;
+
+	m_mux_queue = megabytes;
+}
+
+void SettingsHolder::SetSyncInterval(int seconds)
+{
+	if (seconds < 0)
+		return;
+
+	m_sync_interval = seconds;
+}
+
+void SettingsHolder::SetExpectedMinutes(int minutes)
+{
+	if (minutes < 0)
+		return;
+
+	m_expected_minutes = minutes;
+}
+
+void SettingsHolder::SetLossless(bool use)
+{
+	m_lossless = use;
+}
+
+void SettingsHolder::SetLosslessCodec(const QString& codecName)
+{
+	for (const auto& codec : XVideoWriter::GetLosslessEncoders())
+	{
+		if (codecName.compare(codec.c_str(), Qt::CaseInsensitive) == 0)
+		{
+			m_lossless_codec = codec.c_str();
+			return;
+		}
+	}
+}
+
+void SettingsHolder::SetFrameHash(const QString& hash)
+{
+	if (!hash.isEmpty() && !FrameChecksum::IsHashSupported(hash.toStdString()))
+		return;
+
+	m_frame_hash = hash;
+}
+
+void SettingsHolder::SetFrameTiming(bool use)
+{
+	m_frame_timing = use;
+}
+
+void SettingsHolder::SetQueueCapacity(int capacity)
+{
+	if (capacity <= 0)
+		return;
+
+	m_queue_capacity = capacity;
+}
+
+void SettingsHolder::SetHugePages(bool use)
+{
+	m_huge_pages = use;
+}
+
+void SettingsHolder::SetLateTickPolicy(LateTickPolicy policy)
+{
+	m_late_tick_policy = policy;
+}
+
+void SettingsHolder::SetOverloadPolicy(OverloadPolicy policy)
+{
+	m_overload_policy = policy;
+}
+
+void SettingsHolder::SetKeepEvery(int n)
+{
+	if (n < 2)
+		return;
+
+	m_keep_every = n;
+}
+
+void SettingsHolder::SetStaticDetection(bool use)
+{
+	m_static_detection = use;
+}
+
+void SettingsHolder::SetStaticTolerance(int tolerance)
+{
+	if (tolerance < 0)
+		return;
+
+	m_static_tolerance = tolerance;
+}
+
+void SettingsHolder::SetStaticRowStep(int step)
+{
+	if (step <= 0)
+		return;
+
+	m_static_row_step = step;
+}
+
+void SettingsHolder::SetSpoolMode(SpoolMode mode)
+{
+	m_spool_mode = mode;
+}
+
+void SettingsHolder::SetSpoolMinutes(int minutes)
+{
+	if (minutes <= 0)
+		return;
+
+	m_spool_minutes = minutes;
+}
+
+void SettingsHolder::SetExtraOutputs(const std::vector<ExtraOutputSettings>& outputs)
+{
+	//Entries that could not be recorded are left out rather than failing later
+	m_extra_outputs.clear();
+	for (const auto& output : outputs)
+	{
+		if (output.suffix.isEmpty() || output.width <= 0 || output.height <= 0 || output.bitrate <= 0)
+			continue;
+
+		m_extra_outputs.push_back(output);
+	}
+}
+
 void SettingsHolder::SetPortName(const QString& port)
 {
 	m_port_name = port;
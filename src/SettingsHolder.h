@@ -3,9 +3,35 @@
 
 #include "openvr.h"
 #include "boost/asio.hpp"
+#include "FramePacer.h"
+#include "ColorConverter.h"
+#include "XVideoWriter.h"
+#include "RecordingPipeline.h"
 
 #include <QSettings>
 
+#include <vector>
+
+enum class FrameSourceType
+{
+	VR,
+	Synthetic,
+	Replay
+};
+
+//Another file recorded from the same capture, <name>_<suffix>.<ext>, with
+//the rest of the video settings taken from the main one
+struct ExtraOutputSettings
+{
+	QString suffix;
+	QString codec_name;
+	int bitrate;	//kb/s
+	int width;
+	int height;
+	QString preset;
+	int crf;		//-1 - rate control by bitrate
+};
+
 class SettingsHolder
 {
 public:
@@ -16,7 +42,34 @@ public:
 	vr::EVREye GetVREye() const { return m_eye; }
 	void SetVREye(vr::EVREye eye);
 
+	//Both eyes side by side in one frame, the eye setting is ignored. Video
+	//and synthetic sizes stay those of one eye
+	bool GetStereo() const { return m_stereo; }
+	void SetStereo(bool use);
+
+	//Frame source
+	FrameSourceType GetFrameSource() const { return m_frame_source; }
+	void SetFrameSource(FrameSourceType source);
+
+	int GetSyntheticWidth() const { return m_synthetic_width; }
+	void SetSyntheticWidth(int width);
+
+	int GetSyntheticHeight() const { return m_synthetic_height; }
+	void SetSyntheticHeight(int height);
+
+	QString GetReplayFile() const { return m_replay_file; }
+	void SetReplayFile(const QString& filename);
+
+	bool GetReplayRealtime() const { return m_replay_realtime; }
+	void SetReplayRealtime(bool realtime);
+
+	bool GetReplayLoop() const { return m_replay_loop; }
+	void SetReplayLoop(bool loop);
+
 	//Video
+	VideoContainer GetContainer() const { return m_container; }
+	void SetContainer(VideoContainer container);
+
 	QString GetCodecName() const { return m_codec_name; }
 	void SetCodecName(const QString& codecName);
 
@@ -32,6 +85,124 @@ public:
 	int GetVideoFramerate() const { return m_video_framerate; }
 	void SetVideoFramerate(int framerate);
 
+	bool GetVariableFrameRate() const { return m_variable_frame_rate; }
+	void SetVariableFrameRate(bool use);
+
+	YuvMatrix GetColorMatrix() const { return m_color_matrix; }
+	void SetColorMatrix(YuvMatrix matrix);
+
+	YuvRange GetColorRange() const { return m_color_range; }
+	void SetColorRange(YuvRange range);
+
+	//0 - one band per core
+	int GetConversionBands() const { return m_conversion_bands; }
+	void SetConversionBands(int bands);
+
+	EncoderThreading GetEncoderThreading() const { return m_encoder_threading; }
+	void SetEncoderThreading(EncoderThreading threading);
+
+	//0 - codec default
+	int GetEncoderThreads() const { return m_encoder_threads; }
+	void SetEncoderThreads(int threads);
+
+	bool GetEncoderRowMT() const { return m_encoder_row_mt; }
+	void SetEncoderRowMT(bool use);
+
+	QString GetEncoderPreset() const { return m_encoder_preset; }
+	void SetEncoderPreset(const QString& preset);
+
+	//-1 - rate control by bitrate
+	int GetEncoderCrf() const { return m_encoder_crf; }
+	void SetEncoderCrf(int crf);
+
+	//Encode budget: limits for stepping preset and quality at run time
+	bool GetEncodeBudget() const { return m_encode_budget; }
+	void SetEncodeBudget(bool use);
+
+	QString GetFastestPreset() const { return m_fastest_preset; }
+	void SetFastestPreset(const QString& preset);
+
+	int GetMaxCrf() const { return m_max_crf; }
+	void SetMaxCrf(int crf);
+
+	//kb/s, 0 - bitrate is never lowered
+	int GetMinBitrate() const { return m_min_bitrate; }
+	void SetMinBitrate(int bitrate);
+
+	//0 - recording is not split by time
+	int GetSegmentMinutes() const { return m_segment_minutes; }
+	void SetSegmentMinutes(int minutes);
+
+	//0 - recording is not split by size
+	int GetSegmentMegabytes() const { return m_segment_megabytes; }
+	void SetSegmentMegabytes(int megabytes);
+
+	int GetWriteBuffer() const { return m_write_buffer; }	//KB
+	void SetWriteBuffer(int kilobytes);
+
+	int GetMuxQueue() const { return m_mux_queue; }	//MB
+	void SetMuxQueue(int megabytes);
+
+	//Seconds, 0 - left to the OS
+	int GetSyncInterval() const { return m_sync_interval; }
+	void SetSyncInterval(int seconds);
+
+	//Disk space reserved for an unsegmented recording, 0 - none
+	int GetExpectedMinutes() const { return m_expected_minutes; }
+	void SetExpectedMinutes(int minutes);
+
+	//Pixel exact RGB through the lossless codec instead of the video codec
+	bool GetLossless() const { return m_lossless; }
+	void SetLossless(bool use);
+
+	QString GetLosslessCodec() const { return m_lossless_codec; }
+	void SetLosslessCodec(const QString& codecName);
+
+	//av_hash name of the per-frame checksums, empty - none
+	QString GetFrameHash() const { return m_frame_hash; }
+	void SetFrameHash(const QString& hash);
+
+	//Per-frame capture, encode and mux times in <name>.timing
+	bool GetFrameTiming() const { return m_frame_timing; }
+	void SetFrameTiming(bool use);
+
+	int GetQueueCapacity() const { return m_queue_capacity; }
+	void SetQueueCapacity(int capacity);
+
+	bool GetHugePages() const { return m_huge_pages; }
+	void SetHugePages(bool use);
+
+	LateTickPolicy GetLateTickPolicy() const { return m_late_tick_policy; }
+	void SetLateTickPolicy(LateTickPolicy policy);
+
+	OverloadPolicy GetOverloadPolicy() const { return m_overload_policy; }
+	void SetOverloadPolicy(OverloadPolicy policy);
+
+	//N for OverloadPolicy::KeepEveryNth
+	int GetKeepEvery() const { return m_keep_every; }
+	void SetKeepEvery(int n);
+
+	bool GetStaticDetection() const { return m_static_detection; }
+	void SetStaticDetection(bool use);
+
+	//Mean difference per byte still counted as unchanged, 0 - bit identical
+	int GetStaticTolerance() const { return m_static_tolerance; }
+	void SetStaticTolerance(int tolerance);
+
+	int GetStaticRowStep() const { return m_static_row_step; }
+	void SetStaticRowStep(int step);
+
+	SpoolMode GetSpoolMode() const { return m_spool_mode; }
+	void SetSpoolMode(SpoolMode mode);
+
+	//Length of capture the spool holds
+	int GetSpoolMinutes() const { return m_spool_minutes; }
+	void SetSpoolMinutes(int minutes);
+
+	//Each gets an encoder and a queue of its own
+	const std::vector<ExtraOutputSettings>& GetExtraOutputs() const { return m_extra_outputs; }
+	void SetExtraOutputs(const std::vector<ExtraOutputSettings>& outputs);
+
 	//Serial port
 	QString GetPortName() const { return m_port_name; }
 	void SetPortName(const QString& port);
@@ -58,11 +229,53 @@ public:
 	void Load(QSettings* settings);
 private:
 	vr::EVREye m_eye;
+	bool m_stereo;
+	FrameSourceType m_frame_source;
+	int m_synthetic_width;
+	int m_synthetic_height;
+	QString m_replay_file;
+	bool m_replay_realtime;
+	bool m_replay_loop;
+	VideoContainer m_container;
 	QString m_codec_name;
 	int m_video_bitrate;
 	int m_video_width;
 	int m_video_height;
 	int m_video_framerate;
+	bool m_variable_frame_rate;
+	YuvMatrix m_color_matrix;
+	YuvRange m_color_range;
+	int m_conversion_bands;
+	EncoderThreading m_encoder_threading;
+	int m_encoder_threads;
+	bool m_encoder_row_mt;
+	QString m_encoder_preset;
+	int m_encoder_crf;
+	bool m_encode_budget;
+	QString m_fastest_preset;
+	int m_max_crf;
+	int m_min_bitrate;
+	int m_segment_minutes;
+	int m_segment_megabytes;
+	int m_write_buffer;
+	int m_mux_queue;
+	int m_sync_interval;
+	int m_expected_minutes;
+	bool m_lossless;
+	QString m_lossless_codec;
+	QString m_frame_hash;
+	bool m_frame_timing;
+	int m_queue_capacity;
+	bool m_huge_pages;
+	LateTickPolicy m_late_tick_policy;
+	OverloadPolicy m_overload_policy;
+	int m_keep_every;
+	bool m_static_detection;
+	int m_static_tolerance;
+	int m_static_row_step;
+	SpoolMode m_spool_mode;
+	int m_spool_minutes;
+	std::vector<ExtraOutputSettings> m_extra_outputs;
 	QString m_port_name;
 	int m_port_rate;
 	int m_port_databits;
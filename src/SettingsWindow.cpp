@@ -1,5 +1,6 @@
 #include "SettingsWindow.h"
 #include "XVideoWriter.h"
+#include "EncodeBudget.h"
 
 #include "ui_settingswindow.h"
 
@@ -14,7 +15,9 @@ SettingsDialog::SettingsDialog(SettingsHolder* set, QWidget* parent)
 
 	ui->setupUi(this);
 
-	if(settings->GetVREye() == vr::Eye_Right)
+	if (settings->GetStereo())
+		ui->bothEyesRadioButton->setChecked(true);
+	else if(settings->GetVREye() == vr::Eye_Right)
 		ui->rightEyeRadioButton->setChecked(true);
 	else
 		ui->leftEyeRadioButton->setChecked(true);
@@ -24,7 +27,9 @@ SettingsDialog::SettingsDialog(SettingsHolder* set, QWidget* parent)
 	{
 		if (checked)
 		{
-			settings->SetVREye(button == ui->rightEyeRadioButton ? vr::Eye_Right : vr::Eye_Left);
+			settings->SetStereo(button == ui->bothEyesRadioButton);
+			if (button != ui->bothEyesRadioButton)
+				settings->SetVREye(button == ui->rightEyeRadioButton ? vr::Eye_Right : vr::Eye_Left);
 		}
 	});
 
@@ -80,6 +85,103 @@ SettingsDialog::SettingsDialog(SettingsHolder* set, QWidget* parent)
 		settings->SetVideoFramerate(i);
 	});
 
+	ui->encoderThreadingComboBox->addItem("auto", static_cast<int>(EncoderThreading::Auto));
+	ui->encoderThreadingComboBox->addItem("frame", static_cast<int>(EncoderThreading::Frame));
+	ui->encoderThreadingComboBox->addItem("slice", static_cast<int>(EncoderThreading::Slice));
+	ui->encoderThreadingComboBox->addItem("auto-tune", static_cast<int>(EncoderThreading::AutoTune));
+	ui->encoderThreadingComboBox->setCurrentIndex(ui->encoderThreadingComboBox->findData(static_cast<int>(settings->GetEncoderThreading())));
+	connect(ui->encoderThreadingComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+		[=](const int index)
+	{
+		settings->SetEncoderThreading(static_cast<EncoderThreading>(ui->encoderThreadingComboBox->itemData(index).toInt()));
+	});
+
+	ui->encoderThreadsSpinBox->setValue(settings->GetEncoderThreads());
+	connect(ui->encoderThreadsSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+		[=](const int i)
+	{
+		settings->SetEncoderThreads(i);
+	});
+
+	ui->encoderRowMTCheckBox->setChecked(settings->GetEncoderRowMT());
+	connect(ui->encoderRowMTCheckBox, &QCheckBox::toggled,
+		[=](const bool on)
+	{
+		settings->SetEncoderRowMT(on);
+	});
+
+	for (int i = 0; i < EncodeBudget::GetPresetCount(); ++i)
+	{
+		ui->encoderPresetComboBox->addItem(EncodeBudget::GetPresetName(i));
+		ui->fastestPresetComboBox->addItem(EncodeBudget::GetPresetName(i));
+	}
+
+	ui->encoderPresetComboBox->setCurrentText(settings->GetEncoderPreset());
+	connect(ui->encoderPresetComboBox, &QComboBox::currentTextChanged,
+		[=](const QString& text)
+	{
+		settings->SetEncoderPreset(text);
+	});
+
+	ui->encoderCrfSpinBox->setValue(settings->GetEncoderCrf());
+	connect(ui->encoderCrfSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+		[=](const int i)
+	{
+		settings->SetEncoderCrf(i);
+	});
+
+	ui->encodeBudgetCheckBox->setChecked(settings->GetEncodeBudget());
+	connect(ui->encodeBudgetCheckBox, &QCheckBox::toggled,
+		[=](const bool on)
+	{
+		settings->SetEncodeBudget(on);
+	});
+
+	ui->fastestPresetComboBox->setCurrentText(settings->GetFastestPreset());
+	connect(ui->fastestPresetComboBox, &QComboBox::currentTextChanged,
+		[=](const QString& text)
+	{
+		settings->SetFastestPreset(text);
+	});
+
+	ui->maxCrfSpinBox->setValue(settings->GetMaxCrf());
+	connect(ui->maxCrfSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+		[=](const int i)
+	{
+		settings->SetMaxCrf(i);
+	});
+
+	ui->minBitrateSpinBox->setValue(settings->GetMinBitrate());
+	connect(ui->minBitrateSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+		[=](const int i)
+	{
+		settings->SetMinBitrate(i);
+	});
+
+	ui->containerComboBox->addItem("Matroska", static_cast<int>(VideoContainer::Matroska));
+	ui->containerComboBox->addItem("Fragmented MP4", static_cast<int>(VideoContainer::FragmentedMp4));
+	ui->containerComboBox->addItem("AVI", static_cast<int>(VideoContainer::Avi));
+	ui->containerComboBox->setCurrentIndex(ui->containerComboBox->findData(static_cast<int>(settings->GetContainer())));
+	connect(ui->containerComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+		[=](const int index)
+	{
+		settings->SetContainer(static_cast<VideoContainer>(ui->containerComboBox->itemData(index).toInt()));
+	});
+
+	ui->segmentMinutesSpinBox->setValue(settings->GetSegmentMinutes());
+	connect(ui->segmentMinutesSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+		[=](const int i)
+	{
+		settings->SetSegmentMinutes(i);
+	});
+
+	ui->segmentMegabytesSpinBox->setValue(settings->GetSegmentMegabytes());
+	connect(ui->segmentMegabytesSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+		[=](const int i)
+	{
+		settings->SetSegmentMegabytes(i);
+	});
+
 	ui->portLineEdit->setText(settings->GetPortName());
 	connect(ui->portLineEdit, &QLineEdit::textChanged,
 		[=](const QString& text)
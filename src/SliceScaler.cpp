@@ -0,0 +1,125 @@
+#include "SliceScaler.h"
+
+#include <algorithm>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/pixdesc.h>
+#ifdef __cplusplus
+}
+#endif
+
+namespace
+{
+	//Rows a band boundary has to be a multiple of, so no chroma row is split
+	int RowAlignment(const AVPixelFormat format)
+	{
+		const auto desc = av_pix_fmt_desc_get(format);
+		return desc ? 1 << desc->log2_chroma_h : 1;
+	}
+
+	void OffsetPlanes(const AVFrame* frame, const AVPixelFormat format, const int row, uint8_t* planes[4])
+	{
+		const auto desc = av_pix_fmt_desc_get(format);
+		for (int p = 0; p < 4; ++p)
+		{
+			if (!frame->data[p])
+			{
+				planes[p] = nullptr;
+				continue;
+			}
+
+			const int shift = (p == 1 || p == 2) && desc ? desc->log2_chroma_h : 0;
+			planes[p] = frame->data[p] + static_cast<ptrdiff_t>(row >> shift) * frame->linesize[p];
+		}
+	}
+}
+
+SliceScaler::SliceScaler()
+	: m_src_format(AV_PIX_FMT_NONE), m_dst_format(AV_PIX_FMT_NONE)
+{
+}
+
+SliceScaler::~SliceScaler()
+{
+	Release();
+}
+
+bool SliceScaler::Initialize(const int srcWidth, const int srcHeight, const AVPixelFormat srcFormat,
+	const int dstWidth, const int dstHeight, const AVPixelFormat dstFormat,
+	const int bands, const int flags, const YuvMatrix matrix, const YuvRange range)
+{
+	Release();
+
+	if (srcHeight <= 0 || dstHeight <= 0)
+		return false;
+
+	m_src_format = srcFormat;
+	m_dst_format = dstFormat;
+
+	const int srcAlign = RowAlignment(srcFormat);
+	const int dstAlign = RowAlignment(dstFormat);
+	const int count = std::max(1, std::min(bands, dstHeight / dstAlign));
+
+	const auto srcRowFor = [&](const int dstRow)
+	{
+		const auto row = static_cast<int>(static_cast<int64_t>(dstRow) * srcHeight / dstHeight);
+		return row / srcAlign * srcAlign;
+	};
+
+	int dstRow = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const int dstEnd = i + 1 == count ? dstHeight
+			: static_cast<int>(static_cast<int64_t>(i + 1) * dstHeight / count) / dstAlign * dstAlign;
+		const int srcRow = srcRowFor(dstRow);
+		const int srcEnd = i + 1 == count ? srcHeight : srcRowFor(dstEnd);
+
+		if (dstEnd <= dstRow || srcEnd <= srcRow)
+			continue;
+
+		band_context band;
+		band.src_row = srcRow;
+		band.src_rows = srcEnd - srcRow;
+		band.dst_row = dstRow;
+		band.sws_ctx = sws_getContext(srcWidth, band.src_rows, srcFormat,
+			dstWidth, dstEnd - dstRow, dstFormat, flags, nullptr, nullptr, nullptr);
+
+		if (!band.sws_ctx)
+		{
+			Release();
+			return false;
+		}
+
+		//Match the matrix and range the encoder is told about
+		const auto colorspace = matrix == YuvMatrix::BT709 ? SWS_CS_ITU709 : SWS_CS_ITU601;
+		sws_setColorspaceDetails(band.sws_ctx, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+			sws_getCoefficients(colorspace), range == YuvRange::Full ? 1 : 0, 0, 1 << 16, 1 << 16);
+
+		m_bands.push_back(band);
+		dstRow = dstEnd;
+	}
+
+	return !m_bands.empty();
+}
+
+void SliceScaler::Release()
+{
+	for (auto& band : m_bands)
+		sws_freeContext(band.sws_ctx);
+
+	m_bands.clear();
+}
+
+void SliceScaler::Scale(const AVFrame* src, AVFrame* dst, const int band) const
+{
+	const auto& context = m_bands[band];
+
+	uint8_t* srcPlanes[4];
+	uint8_t* dstPlanes[4];
+	OffsetPlanes(src, m_src_format, context.src_row, srcPlanes);
+	OffsetPlanes(dst, m_dst_format, context.dst_row, dstPlanes);
+
+	sws_scale(context.sws_ctx, srcPlanes, src->linesize, 0, context.src_rows, dstPlanes, dst->linesize);
+}
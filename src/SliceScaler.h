@@ -0,0 +1,54 @@
+#ifndef __SLICE_SCALER_H__
+#define __SLICE_SCALER_H__
+
+#include "ColorConverter.h"
+
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+#ifdef __cplusplus
+}
+#endif
+
+//sws_scale split into horizontal bands with one SwsContext per band, so the
+//bands of a frame can be scaled concurrently. Each band maps its own range of
+//source rows onto its output rows; filter taps do not reach across band
+//edges, which is invisible with the fast bilinear filter used for capture
+class SliceScaler
+{
+public:
+	SliceScaler();
+	~SliceScaler();
+
+	bool Initialize(int srcWidth, int srcHeight, AVPixelFormat srcFormat,
+		int dstWidth, int dstHeight, AVPixelFormat dstFormat,
+		int bands, int flags, YuvMatrix matrix, YuvRange range);
+	void Release();
+
+	bool IsInitialized() const { return !m_bands.empty(); }
+
+	//May be fewer than asked for when the output is short
+	int GetBandCount() const { return static_cast<int>(m_bands.size()); }
+
+	//Bands are independent and can run on any thread
+	void Scale(const AVFrame* src, AVFrame* dst, int band) const;
+
+private:
+	struct band_context
+	{
+		SwsContext* sws_ctx;
+		int src_row;
+		int src_rows;
+		int dst_row;
+	};
+
+	std::vector<band_context> m_bands;
+	AVPixelFormat m_src_format;
+	AVPixelFormat m_dst_format;
+};
+
+#endif	//__SLICE_SCALER_H__
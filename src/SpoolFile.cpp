@@ -0,0 +1,324 @@
+#include "SpoolFile.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char SpoolMagic[8] = { 'X', 'T', 'G', 'N', 'S', 'P', 'L', '1' };
+	const size_t PageSize = 4096;
+
+	static_assert(sizeof(spool_file_header) <= SpoolFile::HeaderSize, "Spool header does not fit in its page");
+	static_assert(sizeof(spool_frame_header) <= SpoolFile::FrameHeaderSize, "Spool frame header does not fit in front of the pixels");
+}
+
+SpoolFile::SpoolFile()
+	: m_data(nullptr), m_size(0), m_slot_size(0),
+#ifdef _WIN32
+	m_file(nullptr), m_mapping(nullptr),
+#endif
+	m_head(0), m_tail(0), m_high_water(0), m_overflows(0)
+{
+}
+
+SpoolFile::~SpoolFile()
+{
+	Release();
+}
+
+bool SpoolFile::Create(const std::string& filename, const size_t capacity, const int width, const int height,
+	const AVPixelFormat format, const size_t rowCount, const size_t rowPitch, const int framerate, const AVRational timeBase)
+{
+	Release();
+
+	if (capacity == 0 || rowCount == 0 || rowPitch == 0)
+		return false;
+
+	//Whole pages per slot, so every frame starts page and cache line aligned
+	//after its header and a slot is never half in another's page
+	const size_t pixels = rowCount * rowPitch;
+	m_slot_size = (FrameHeaderSize + pixels + PageSize - 1) / PageSize * PageSize;
+	m_filename = filename;
+
+	if (!Map(HeaderSize + static_cast<uint64_t>(m_slot_size) * capacity, true))
+	{
+		Release();
+		return false;
+	}
+
+	const auto header = GetHeader();
+	std::memset(header, 0, HeaderSize);
+	std::memcpy(header->magic, SpoolMagic, sizeof(SpoolMagic));
+	header->header_size = HeaderSize;
+	header->frame_header_size = FrameHeaderSize;
+	header->width = width;
+	header->height = height;
+	header->format = format;
+	header->framerate = framerate;
+	header->time_base_num = timeBase.num;
+	header->time_base_den = timeBase.den;
+	header->row_count = rowCount;
+	header->row_pitch = rowPitch;
+	header->slot_size = m_slot_size;
+	header->slot_count = capacity;
+	header->frames = 0;
+
+	m_slots.resize(capacity);
+	for (size_t i = 0; i < capacity; ++i)
+	{
+		auto& slot = m_slots[i];
+		slot.timestamp = 0;
+		slot.repeat = 0;
+		slot.frame = av_frame_alloc();
+		if (!slot.frame)
+		{
+			Release();
+			return false;
+		}
+
+		//Points into the mapping, no AVBuffer: the slot is overwritten in place
+		slot.frame->format = format;
+		slot.frame->width = width;
+		slot.frame->height = height;
+		slot.frame->data[0] = reinterpret_cast<uint8_t*>(GetFrameHeader(i)) + FrameHeaderSize;
+		slot.frame->linesize[0] = static_cast<int>(rowPitch);
+		slot.frame->extended_data = slot.frame->data;
+	}
+
+	return true;
+}
+
+bool SpoolFile::Open(const std::string& filename)
+{
+	Release();
+
+	m_filename = filename;
+	if (!Map(0, false))
+	{
+		Release();
+		return false;
+	}
+
+	//Everything the slots are found with has to agree with the file size
+	const auto header = GetHeader();
+	if (m_size < HeaderSize || std::memcmp(header->magic, SpoolMagic, sizeof(SpoolMagic)) != 0
+		|| header->header_size != HeaderSize || header->frame_header_size != FrameHeaderSize
+		|| header->slot_size < FrameHeaderSize + header->row_count * header->row_pitch
+		|| header->slot_count == 0 || HeaderSize + header->slot_size * header->slot_count > m_size)
+	{
+		Release();
+		return false;
+	}
+
+	m_slot_size = static_cast<size_t>(header->slot_size);
+	return true;
+}
+
+uint64_t SpoolFile::GetFirstFrame() const
+{
+	if (!m_data)
+		return 0;
+
+	const auto header = GetHeader();
+	return header->frames > header->slot_count ? header->frames - header->slot_count : 0;
+}
+
+bool SpoolFile::GetFrame(const uint64_t index, AVFrame* frame, int64_t& pts, int64_t& timestamp) const
+{
+	if (!m_data || index < GetFirstFrame() || index >= GetFrameCount())
+		return false;
+
+	const auto header = GetHeader();
+	const auto slot = static_cast<size_t>(index % header->slot_count);
+	const auto frameHeader = GetFrameHeader(slot);
+	if (frameHeader->sequence != index + 1)
+		return false;
+
+	frame->format = header->format;
+	frame->width = header->width;
+	frame->height = header->height;
+	frame->data[0] = reinterpret_cast<uint8_t*>(frameHeader) + FrameHeaderSize;
+	frame->linesize[0] = static_cast<int>(header->row_pitch);
+	frame->extended_data = frame->data;
+
+	pts = frameHeader->pts;
+	timestamp = frameHeader->timestamp;
+	return true;
+}
+
+void SpoolFile::Release(const bool remove)
+{
+	for (auto& slot : m_slots)
+	{
+		if (slot.frame)
+			av_frame_free(&slot.frame);
+	}
+	m_slots.clear();
+
+	Unmap();
+
+	if (remove && !m_filename.empty())
+		std::remove(m_filename.c_str());
+
+	m_slot_size = 0;
+	m_head.store(0);
+	m_tail.store(0);
+	m_high_water.store(0);
+	m_overflows.store(0);
+}
+
+bool SpoolFile::Map(uint64_t size, const bool create)
+{
+#ifdef _WIN32
+	const auto file = CreateFileA(m_filename.c_str(), create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ,
+		nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	m_file = file;
+
+	if (!create)
+	{
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+			return false;
+		size = static_cast<uint64_t>(fileSize.QuadPart);
+	}
+
+	//Sizing the mapping sizes the file, all of it reserved up front
+	m_mapping = CreateFileMappingA(m_file, nullptr, create ? PAGE_READWRITE : PAGE_READONLY,
+		static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xffffffff), nullptr);
+	if (!m_mapping)
+		return false;
+
+	m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0));
+#else
+	const int file = create ? open(m_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+		: open(m_filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		return false;
+
+	if (create)
+	{
+		//Real blocks rather than a sparse file, so a full disk shows up now
+		//and not as a fault in the capture thread
+		if (posix_fallocate(file, 0, static_cast<off_t>(size)) != 0 && ftruncate(file, static_cast<off_t>(size)) != 0)
+		{
+			close(file);
+			return false;
+		}
+	}
+	else
+	{
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size == 0)
+		{
+			close(file);
+			return false;
+		}
+		size = static_cast<uint64_t>(info.st_size);
+	}
+
+	const auto data = mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+	if (data == MAP_FAILED)
+		return false;
+
+	m_data = static_cast<uint8_t*>(data);
+	madvise(m_data, size, MADV_SEQUENTIAL);
+#endif
+
+	m_size = size;
+	return m_data != nullptr;
+}
+
+void SpoolFile::Unmap()
+{
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data)
+		munmap(m_data, m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+}
+
+FrameSlot* SpoolFile::BeginWrite()
+{
+	const auto head = m_head.load(std::memory_order_relaxed);
+	const auto tail = m_tail.load(std::memory_order_acquire);
+	if (head - tail >= m_slots.size())
+	{
+		m_overflows.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	return &m_slots[head % m_slots.size()];
+}
+
+void SpoolFile::EndWrite()
+{
+	const auto head = m_head.load(std::memory_order_relaxed);
+	const auto index = static_cast<size_t>(head % m_slots.size());
+	const auto& slot = m_slots[index];
+
+	//What a later reader of the file needs to encode the frame without us
+	const auto frame = GetFrameHeader(index);
+	frame->pts = slot.frame->pts;
+	frame->timestamp = slot.timestamp;
+	frame->repeat = slot.repeat;
+	frame->size = static_cast<uint32_t>(GetHeader()->row_count * GetHeader()->row_pitch);
+	frame->sequence = head + 1;
+	GetHeader()->frames = head + 1;
+
+	m_head.store(head + 1, std::memory_order_release);
+
+	const auto depth = static_cast<size_t>(head + 1 - m_tail.load(std::memory_order_acquire));
+	if (depth > m_high_water.load(std::memory_order_relaxed))
+		m_high_water.store(depth, std::memory_order_relaxed);
+}
+
+FrameSlot* SpoolFile::BeginRead()
+{
+	const auto tail = m_tail.load(std::memory_order_relaxed);
+	const auto head = m_head.load(std::memory_order_acquire);
+	if (head == tail)
+		return nullptr;
+
+	return &m_slots[tail % m_slots.size()];
+}
+
+void SpoolFile::EndRead()
+{
+	m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+FrameRingStats SpoolFile::GetStats() const
+{
+	const auto head = m_head.load(std::memory_order_acquire);
+
+	FrameRingStats stats;
+	stats.capacity = m_slots.size();
+	stats.depth = static_cast<size_t>(head - m_tail.load(std::memory_order_acquire));
+	stats.high_water = m_high_water.load(std::memory_order_relaxed);
+	stats.pushed = head;
+	stats.overflows = m_overflows.load(std::memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,128 @@
+#ifndef __SPOOL_FILE_H__
+#define __SPOOL_FILE_H__
+
+#include "FrameRing.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/frame.h>
+#ifdef __cplusplus
+}
+#endif
+
+//Start of the spool file, one page
+struct spool_file_header
+{
+	char magic[8];			//"XTGNSPL1"
+	uint32_t header_size;
+	uint32_t frame_header_size;
+	int32_t width;
+	int32_t height;
+	int32_t format;			//AVPixelFormat of the captured frames
+	int32_t framerate;
+	int32_t time_base_num;	//Of the frame pts
+	int32_t time_base_den;
+	uint64_t row_count;
+	uint64_t row_pitch;
+	uint64_t slot_size;		//Frame header and pixels, page aligned
+	uint64_t slot_count;
+	uint64_t frames;		//Frames written so far; slot is frame % slot_count
+};
+
+//Start of every slot, the pixels follow at frame_header_size
+struct spool_frame_header
+{
+	uint64_t sequence;		//Frame number + 1, 0 - never written
+	int64_t pts;
+	int64_t timestamp;		//Capture clock, see FrameSource::Now()
+	int32_t repeat;
+	uint32_t size;			//Pixel bytes
+};
+
+//Ring of fixed-size frame slots in a preallocated, memory-mapped file, used
+//the same way as FrameRing by one producer and one consumer. Capturing
+//into a slot writes straight into the mapped pages; the OS writes them back
+//on its own time, so the spool holds far more than memory would, and what
+//it holds survives the process
+class SpoolFile
+{
+public:
+	static const uint32_t HeaderSize = 4096;
+	static const uint32_t FrameHeaderSize = 64;
+
+public:
+	SpoolFile();
+	~SpoolFile();
+
+	bool Create(const std::string& filename, size_t capacity, int width, int height, AVPixelFormat format,
+		size_t rowCount, size_t rowPitch, int framerate, AVRational timeBase);
+	//Maps an existing spool read-only for GetFrame(), e.g. one kept after a
+	//session that did not finish encoding
+	bool Open(const std::string& filename);
+	//Unmaps, and deletes the file if asked to
+	void Release(bool remove = false);
+
+	bool IsInitialized() const { return m_data != nullptr; }
+	const std::string& GetFilename() const { return m_filename; }
+	uint64_t GetFileSize() const { return m_size; }
+	size_t GetCapacity() const { return m_slots.size(); }
+
+	//Producer side. BeginWrite() returns nullptr and counts an overflow when
+	//full; EndWrite() stores the slot's pts, timestamp and repeat with it
+	FrameSlot* BeginWrite();
+	void EndWrite();
+
+	//Consumer side. BeginRead() returns nullptr when empty. The frame has no
+	//buffer of its own, whoever keeps it past EndRead() copies it
+	FrameSlot* BeginRead();
+	void EndRead();
+
+	uint64_t GetWritten() const { return m_head.load(std::memory_order_acquire); }
+	FrameRingStats GetStats() const;
+
+	//Format of an opened spool, as recorded by Create()
+	const spool_file_header& GetFormat() const { return *GetHeader(); }
+
+	//Frames [GetFirstFrame(), GetFrameCount()) are still in an opened spool,
+	//older ones were overwritten when the ring went round
+	uint64_t GetFirstFrame() const;
+	uint64_t GetFrameCount() const { return m_data ? GetHeader()->frames : 0; }
+
+	//Points frame at the pixels of frame number index, nothing is copied.
+	//False if the slot holds another frame or was never completely written
+	bool GetFrame(uint64_t index, AVFrame* frame, int64_t& pts, int64_t& timestamp) const;
+
+private:
+	std::string m_filename;
+	uint8_t* m_data;
+	uint64_t m_size;
+	size_t m_slot_size;
+	std::vector<FrameSlot> m_slots;
+
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+
+	alignas(64) std::atomic<uint64_t> m_head;
+	alignas(64) std::atomic<uint64_t> m_tail;
+	alignas(64) std::atomic<size_t> m_high_water;
+	std::atomic<uint64_t> m_overflows;
+
+	bool Map(uint64_t size, bool create);
+	void Unmap();
+	spool_file_header* GetHeader() const { return reinterpret_cast<spool_file_header*>(m_data); }
+	spool_frame_header* GetFrameHeader(size_t slot) const
+	{
+		return reinterpret_cast<spool_frame_header*>(m_data + HeaderSize + slot * m_slot_size);
+	}
+};
+
+#endif	//__SPOOL_FILE_H__
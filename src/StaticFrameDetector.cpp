@@ -0,0 +1,165 @@
+#include "StaticFrameDetector.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define XTGN_X86
+#endif
+
+#ifdef XTGN_X86
+#include <immintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/imgutils.h>
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(XTGN_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace
+{
+	const size_t Segment = StaticFrameDetector::SegmentBytes;
+
+	uint32_t SadScalar(const uint8_t* a, const uint8_t* b, const size_t bytes)
+	{
+		uint32_t sad = 0;
+		for (size_t i = 0; i < bytes; ++i)
+			sad += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+		return sad;
+	}
+
+	bool CompareRowScalar(const uint8_t* a, const uint8_t* b, const size_t bytes, const uint32_t limit)
+	{
+		for (size_t x = 0; x < bytes; x += Segment)
+		{
+			const auto length = bytes - x < Segment ? bytes - x : Segment;
+			if (SadScalar(a + x, b + x, length) > limit)
+				return false;
+		}
+		return true;
+	}
+
+	//Bit-identical: the C library's memcmp is already vectorised
+	bool CompareRowExact(const uint8_t* a, const uint8_t* b, const size_t bytes, uint32_t)
+	{
+		return std::memcmp(a, b, bytes) == 0;
+	}
+
+#ifdef XTGN_X86
+	TARGET_SSE2 bool CompareRowSSE2(const uint8_t* a, const uint8_t* b, const size_t bytes, const uint32_t limit)
+	{
+		size_t x = 0;
+		for (; x + Segment <= bytes; x += Segment)
+		{
+			__m128i sad = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x)));
+			for (size_t i = 16; i < Segment; i += 16)
+			{
+				sad = _mm_add_epi64(sad, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x + i)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x + i))));
+			}
+
+			const auto total = static_cast<uint32_t>(_mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+			if (total > limit)
+				return false;
+		}
+
+		return x == bytes || SadScalar(a + x, b + x, bytes - x) <= limit;
+	}
+
+	TARGET_AVX2 bool CompareRowAVX2(const uint8_t* a, const uint8_t* b, const size_t bytes, const uint32_t limit)
+	{
+		size_t x = 0;
+		for (; x + Segment <= bytes; x += Segment)
+		{
+			const __m256i sad = _mm256_add_epi64(
+				_mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x)),
+					_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x))),
+				_mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x + 32)),
+					_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x + 32))));
+
+			const __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(sad), _mm256_extracti128_si256(sad, 1));
+			const auto total = static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+			if (total > limit)
+				return false;
+		}
+
+		return x == bytes || SadScalar(a + x, b + x, bytes - x) <= limit;
+	}
+#endif
+}
+
+StaticFrameDetector::StaticFrameDetector()
+	: m_row(nullptr), m_row_step(1), m_limit(0), m_level(SimdLevel::Scalar)
+{
+}
+
+void StaticFrameDetector::Initialize(const int rowStep, const int tolerance, SimdLevel level)
+{
+	m_row_step = rowStep > 0 ? rowStep : 1;
+	m_limit = tolerance > 0 ? static_cast<uint32_t>(tolerance) * SegmentBytes : 0;
+
+	level = std::min(level, ColorConverter::DetectSimdLevel());
+
+	if (m_limit == 0)
+	{
+		m_row = &CompareRowExact;
+		m_level = SimdLevel::Scalar;
+		return;
+	}
+
+	m_row = &CompareRowScalar;
+	m_level = SimdLevel::Scalar;
+
+#ifdef XTGN_X86
+	//SAD has nothing wider worth having than AVX2
+	if (level >= SimdLevel::AVX2)
+	{
+		m_row = &CompareRowAVX2;
+		m_level = SimdLevel::AVX2;
+	}
+	else if (level > SimdLevel::Scalar)
+	{
+		//Plain SSE2, filed under the lowest vector level the dispatch knows
+		m_row = &CompareRowSSE2;
+		m_level = SimdLevel::SSE41;
+	}
+#endif
+}
+
+void StaticFrameDetector::Release()
+{
+	m_row = nullptr;
+}
+
+bool StaticFrameDetector::IsStatic(const AVFrame* frame, const AVFrame* reference) const
+{
+	if (!m_row || !frame || !reference || !frame->data[0] || !reference->data[0]
+		|| frame->format != reference->format || frame->width != reference->width || frame->height != reference->height)
+		return false;
+
+	//Packed formats only, like the capture queue
+	const int bytes = av_image_get_linesize(static_cast<AVPixelFormat>(frame->format), frame->width, 0);
+	if (bytes <= 0)
+		return false;
+
+	for (int y = 0; y < frame->height; y += m_row_step)
+	{
+		if (!m_row(frame->data[0] + static_cast<ptrdiff_t>(y) * frame->linesize[0],
+			reference->data[0] + static_cast<ptrdiff_t>(y) * reference->linesize[0], bytes, m_limit))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,42 @@
+#ifndef __STATIC_FRAME_DETECTOR_H__
+#define __STATIC_FRAME_DETECTOR_H__
+
+#include "ColorConverter.h"
+
+#include <cstddef>
+#include <cstdint>
+
+//Tells whether a captured frame differs visibly from a reference frame of the
+//same size and packed format. Rows are compared in 64-byte segments by sum of
+//absolute differences; the first segment over the tolerance ends the scan, so
+//a changing frame costs a fraction of a full pass and only a static one is
+//read to the end
+class StaticFrameDetector
+{
+public:
+	static const int SegmentBytes = 64;
+
+public:
+	StaticFrameDetector();
+
+	//rowStep 1 compares every row, larger values sample. tolerance is the mean
+	//absolute difference per byte allowed in a segment, 0 - bit identical
+	void Initialize(int rowStep, int tolerance, SimdLevel level = SimdLevel::AVX512);
+	void Release();
+
+	bool IsInitialized() const { return m_row != nullptr; }
+	SimdLevel GetSimdLevel() const { return m_level; }
+
+	bool IsStatic(const AVFrame* frame, const AVFrame* reference) const;
+
+private:
+	//False as soon as one segment of the row differs by more than limit
+	typedef bool(*row_func)(const uint8_t* a, const uint8_t* b, size_t bytes, uint32_t limit);
+
+	row_func m_row;
+	int m_row_step;
+	uint32_t m_limit;
+	SimdLevel m_level;
+};
+
+#endif	//__STATIC_FRAME_DETECTOR_H__
@@ -0,0 +1,143 @@
+#include "SyntheticFrameSource.h"
+
+#include <cstring>
+
+namespace
+{
+	const size_t PatternPeriod = 256;
+	const size_t ScrollStep = 4;
+	const size_t StampBits = 32;
+	const size_t StampSize = 16;
+	//Pattern shift of the right eye in stereo, in pixels
+	const size_t Disparity = 8;
+
+	const uint8_t BarColors[][4] =
+	{
+		{ 235, 235, 235, 255 },
+		{ 235, 235, 16, 255 },
+		{ 16, 235, 235, 255 },
+		{ 16, 235, 16, 255 },
+		{ 235, 16, 235, 255 },
+		{ 235, 16, 16, 255 },
+		{ 16, 16, 235, 255 },
+		{ 16, 16, 16, 255 }
+	};
+}
+
+SyntheticFrameSource::SyntheticFrameSource(Logger* logger)
+	: m_logger(logger), m_initialized(false), m_width(0), m_height(0), m_eyes(1), m_row_pitch(0),
+	m_frame_number(0), m_timestamp(0), m_pattern_period(PatternPeriod)
+{
+}
+
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+	Release();
+}
+
+void SyntheticFrameSource::Initialize(const int width, const int height, const bool stereo)
+{
+	if (m_initialized)
+		Release();
+
+	if (width <= 0 || height <= 0)
+	{
+		m_logger->WriteError(QString("Wrong synthetic frame size %1x%2\r\n").arg(width).arg(height));
+		return;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_eyes = stereo ? 2 : 1;
+	m_row_pitch = static_cast<size_t>(width) * 4 * m_eyes;
+
+	const size_t patternLength = m_width + m_pattern_period + Disparity;
+	const size_t barWidth = m_pattern_period / (sizeof(BarColors) / sizeof(BarColors[0]));
+	m_pattern = std::make_unique<uint8_t[]>(patternLength * 4);
+	for (size_t x = 0; x < patternLength; ++x)
+	{
+		const auto color = BarColors[(x % m_pattern_period) / barWidth];
+		//Gentle ramp inside each bar so the encoder has gradients to work on
+		const uint8_t ramp = static_cast<uint8_t>((x % barWidth) * 32 / barWidth);
+		uint8_t* px = m_pattern.get() + x * 4;
+		px[0] = color[0] > 128 ? color[0] - ramp : color[0] + ramp;
+		px[1] = color[1] > 128 ? color[1] - ramp : color[1] + ramp;
+		px[2] = color[2] > 128 ? color[2] - ramp : color[2] + ramp;
+		px[3] = color[3];
+	}
+
+	m_frame_number = 0;
+	m_timestamp = 0;
+
+	m_logger->WriteInfo(QString("Synthetic frame source %1x%2 RGBA%3\r\n")
+		.arg(m_width * m_eyes).arg(m_height).arg(stereo ? ", two eyes side by side" : ""));
+
+	m_initialized = true;
+}
+
+void SyntheticFrameSource::Release()
+{
+	m_initialized = false;
+
+	m_pattern.reset();
+}
+
+bool SyntheticFrameSource::CaptureFrame(AVFrame* frame)
+{
+	if (!m_initialized)
+		return false;
+
+	const size_t linesize = frame->linesize[0];
+	const size_t phase = static_cast<size_t>(m_frame_number) * ScrollStep;
+	const size_t eyePitch = static_cast<size_t>(m_width) * 4;
+	uint8_t* dptr = frame->data[0];
+	for (size_t y = 0; y < static_cast<size_t>(m_height); ++y)
+	{
+		const size_t offset = (phase + y) % m_pattern_period;
+		for (int eye = 0; eye < m_eyes; ++eye)
+			memcpy(dptr + eye * eyePitch, m_pattern.get() + (offset + eye * Disparity) * 4, eyePitch);
+		dptr += linesize;
+	}
+
+	//Frame number as StampBits black/white squares, most significant bit first
+	if (static_cast<size_t>(m_width) >= StampBits * StampSize && static_cast<size_t>(m_height) >= StampSize)
+	{
+		for (size_t bit = 0; bit < StampBits * m_eyes; ++bit)
+		{
+			const size_t eyeBit = bit % StampBits;
+			const uint8_t value = (static_cast<uint64_t>(m_frame_number) >> (StampBits - 1 - eyeBit)) & 1 ? 255 : 0;
+			for (size_t y = 0; y < StampSize; ++y)
+			{
+				uint8_t* px = frame->data[0] + y * linesize + (bit / StampBits) * eyePitch + eyeBit * StampSize * 4;
+				for (size_t x = 0; x < StampSize; ++x, px += 4)
+				{
+					px[0] = px[1] = px[2] = value;
+					px[3] = 255;
+				}
+			}
+		}
+	}
+
+	m_timestamp = Now();
+	++m_frame_number;
+
+	return true;
+}
+
+int64_t SyntheticFrameSource::ReadFrameNumber(const AVFrame* frame, const int x)
+{
+	if (frame->format != AV_PIX_FMT_RGBA || x < 0 || x > frame->width
+		|| static_cast<size_t>(frame->width - x) < StampBits * StampSize || static_cast<size_t>(frame->height) < StampSize)
+		return -1;
+
+	//Centre of each square, so a little filtering does not matter
+	const uint8_t* row = frame->data[0] + (StampSize / 2) * frame->linesize[0] + static_cast<size_t>(x) * 4;
+	int64_t number = 0;
+	for (size_t bit = 0; bit < StampBits; ++bit)
+	{
+		const uint8_t* px = row + (bit * StampSize + StampSize / 2) * 4;
+		number = (number << 1) | (px[0] > 128 ? 1 : 0);
+	}
+
+	return number;
+}
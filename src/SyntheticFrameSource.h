@@ -0,0 +1,60 @@
+#ifndef __SYNTHETIC_FRAME_SOURCE_H__
+#define __SYNTHETIC_FRAME_SOURCE_H__
+
+#include "Logger.h"
+#include "FrameSource.h"
+
+#include <memory>
+
+//Deterministic RGBA test pattern: diagonal colour bars scrolling a few pixels
+//per frame with the frame number stamped as a binary strip in the top-left
+//corner. Frame N is always identical for the same size, so runs are comparable
+//between machines and dropped frames can be found in the output. In stereo
+//both eyes are packed side by side, left first, the right one with the bars
+//shifted a little and both stamped with the same frame number.
+class SyntheticFrameSource : public FrameSource
+{
+public:
+	SyntheticFrameSource(Logger* logger);
+	~SyntheticFrameSource();
+
+	//width and height of one eye
+	void Initialize(int width, int height, bool stereo = false);
+	void Release() override;
+
+	bool IsInitialized() const override { return m_initialized; }
+
+	int GetWidth() const override { return m_width * m_eyes; }
+	int GetHeight() const override { return m_height; }
+	AVPixelFormat GetPixelFormat() const override { return AV_PIX_FMT_RGBA; }
+
+	size_t GetBufferRowCount() const override { return m_height; }
+	size_t GetBufferRowPitch() const override { return m_row_pitch; }
+	int64_t GetTimestamp() const override { return m_timestamp; }
+
+	bool CaptureFrame(AVFrame* frame) override;
+
+	int64_t GetFrameNumber() const { return m_frame_number; }
+	int GetEyeCount() const { return m_eyes; }
+
+	//Frame number stamped at column x of an RGBA frame, -1 if there is no
+	//stamp; x is 0 for the left eye and the eye width for the right one
+	static int64_t ReadFrameNumber(const AVFrame* frame, int x);
+
+private:
+	Logger* m_logger;
+
+	bool m_initialized;
+	int m_width;
+	int m_height;
+	int m_eyes;
+	size_t m_row_pitch;
+	int64_t m_frame_number;
+	int64_t m_timestamp;
+
+	//One row of bars long enough to be read at any phase without wrapping
+	std::unique_ptr<uint8_t[]> m_pattern;
+	size_t m_pattern_period;
+};
+
+#endif	//__SYNTHETIC_FRAME_SOURCE_H__
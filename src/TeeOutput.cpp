@@ -0,0 +1,195 @@
+#include "TeeOutput.h"
+
+#include <algorithm>
+
+TeeOutput::TeeOutput(Logger* logger, const std::string& name)
+	: m_logger(logger), m_name(name), m_owned(std::make_unique<XVideoWriter>(logger)), m_writer(m_owned.get()),
+	m_stop(false), m_stats(), m_finished(false), m_encode_seconds(0)
+{
+}
+
+TeeOutput::TeeOutput(Logger* logger, const std::string& name, XVideoWriter* writer)
+	: m_logger(logger), m_name(name), m_writer(writer), m_stop(false), m_stats(), m_finished(false), m_encode_seconds(0)
+{
+}
+
+TeeOutput::~TeeOutput()
+{
+	Finish();
+}
+
+bool TeeOutput::Initialize(const VideoWriterConfig& config, const AVPixelFormat captureFormat)
+{
+	if (!m_owned)
+		return m_writer->IsInitialized();
+
+	m_owned->Initialize(config, XVideoWriter::GetEncoderFormat(config, captureFormat), config.width, config.height);
+	if (!m_owned->IsInitialized())
+	{
+		m_logger->WriteError(QString("Output %1 failed initialization\r\n").arg(m_name.c_str()));
+		return false;
+	}
+	return true;
+}
+
+void TeeOutput::Start(const size_t capacity)
+{
+	Finish();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = false;
+		m_finished = false;
+		m_stats = TeeOutputStats();
+		m_stats.name = m_name;
+		m_stats.capacity = std::max<size_t>(capacity, 1);
+		m_encode_seconds = 0;
+		m_start = std::chrono::steady_clock::now();
+	}
+
+	m_thread = std::thread(&TeeOutput::EncodeLoop, this);
+}
+
+void TeeOutput::Finish()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+
+	const auto stats = GetStats();
+	m_logger->WriteInfo(QString("Output %1: encoded %2, dropped %3, queue high-water %4/%5, %6 fps, %7% busy\r\n")
+		.arg(m_name.c_str()).arg(static_cast<qulonglong>(stats.encoded)).arg(static_cast<qulonglong>(stats.dropped))
+		.arg(stats.high_water).arg(stats.capacity).arg(stats.fps, 0, 'f', 1).arg(stats.busy * 100, 0, 'f', 0));
+}
+
+bool TeeOutput::Push(const AVFrame* frame, const int64_t pts, const int64_t timestamp)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_thread.joinable() || m_queue.size() >= m_stats.capacity)
+		{
+			++m_stats.dropped;
+			AddDropped(pts, timestamp, DropReason::QueueFull);
+			return false;
+		}
+	}
+
+	//Referenced outside the lock; pooled buffers make this a count, not a copy
+	auto queued = av_frame_clone(frame);
+	if (!queued)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_stats.dropped;
+		AddDropped(pts, timestamp, DropReason::QueueFull);
+		return false;
+	}
+	queued->pts = pts;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(tee_frame{ queued, timestamp });
+		++m_stats.queued;
+		m_stats.depth = m_queue.size();
+		m_stats.high_water = std::max(m_stats.high_water, m_stats.depth);
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+size_t TeeOutput::GetDepth() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_queue.size();
+}
+
+size_t TeeOutput::GetCapacity() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats.capacity;
+}
+
+std::vector<int64_t> TeeOutput::DropOldest(const size_t keep)
+{
+	std::vector<int64_t> dropped;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	while (m_queue.size() > keep)
+	{
+		auto queued = m_queue.front();
+		m_queue.pop_front();
+		dropped.push_back(queued.frame->pts);
+		AddDropped(queued.frame->pts, queued.timestamp, DropReason::Overload);
+		av_frame_free(&queued.frame);
+		++m_stats.dropped;
+	}
+	m_stats.depth = m_queue.size();
+	return dropped;
+}
+
+TeeOutputStats TeeOutput::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto stats = m_stats;
+	const auto end = m_finished ? m_end : std::chrono::steady_clock::now();
+	const auto elapsed = std::chrono::duration<double>(end - m_start).count();
+	if (elapsed > 0)
+	{
+		stats.fps = stats.encoded / elapsed;
+		stats.busy = std::min(m_encode_seconds / elapsed, 1.0);
+	}
+	return stats;
+}
+
+void TeeOutput::EncodeLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [&]() { return m_stop || !m_queue.empty(); });
+		if (m_queue.empty())
+		{
+			m_end = std::chrono::steady_clock::now();
+			m_finished = true;
+			break;
+		}
+
+		auto queued = m_queue.front();
+		m_queue.pop_front();
+		m_stats.depth = m_queue.size();
+		lock.unlock();
+
+		const auto start = std::chrono::steady_clock::now();
+		m_writer->WriteFrame(queued.frame, queued.timestamp);
+		av_frame_free(&queued.frame);
+		const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		lock.lock();
+		++m_stats.encoded;
+		m_encode_seconds += seconds;
+	}
+}
+
+void TeeOutput::AddDropped(const int64_t pts, const int64_t timestamp, const DropReason reason)
+{
+	const auto timing = m_writer->GetTimingLog();
+	if (!timing)
+		return;
+
+	frame_timing_record record = {};
+	record.pts = pts;
+	if (timestamp != AV_NOPTS_VALUE)
+	{
+		record.capture_time = timestamp;
+		record.capture_utc = FrameTimingLog::ToUtc(timestamp);
+	}
+	record.status = static_cast<uint8_t>(FrameTimingStatus::Dropped);
+	record.drop_reason = static_cast<uint8_t>(reason);
+	timing->Append(record);
+}
@@ -0,0 +1,102 @@
+#ifndef __TEE_OUTPUT_H__
+#define __TEE_OUTPUT_H__
+
+#include "Logger.h"
+#include "XVideoWriter.h"
+#include "DropCounter.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//One more encoder and file the capture is recorded to
+struct TeeOutputConfig
+{
+	std::string name;	//Shown in statistics and logs
+	VideoWriterConfig writer;
+};
+
+struct TeeOutputStats
+{
+	std::string name;
+	size_t capacity;
+	size_t depth;		//Frames waiting
+	size_t high_water;
+	uint64_t queued;
+	uint64_t encoded;
+	uint64_t dropped;	//Queue was full, the other outputs still got them
+	double fps;			//Encoded frames per second since Start()
+	double busy;		//Share of the time spent encoding
+};
+
+//An encoder behind a queue of its own. Frames come already converted to the
+//encoder's format and size, by reference; an output that falls behind drops
+//its own frames and holds up neither the capture nor the other outputs
+class TeeOutput
+{
+public:
+	//Owns a writer, set up by Initialize()
+	TeeOutput(Logger* logger, const std::string& name);
+	//Feeds a writer set up and closed elsewhere
+	TeeOutput(Logger* logger, const std::string& name, XVideoWriter* writer);
+	~TeeOutput();
+
+	//Frames given to Push() are then in the encoder's format and size
+	bool Initialize(const VideoWriterConfig& config, AVPixelFormat captureFormat);
+
+	const std::string& GetName() const { return m_name; }
+	XVideoWriter* GetWriter() const { return m_writer; }
+
+	void Start(size_t capacity);
+	//Encodes what is still queued and stops; the writer stays open
+	void Finish();
+
+	//Takes a reference to frame, sent with pts and its capture timestamp.
+	//False when the queue is full
+	bool Push(const AVFrame* frame, int64_t pts, int64_t timestamp = AV_NOPTS_VALUE);
+
+	//Frames waiting and room for them, what the overload policy goes by
+	size_t GetDepth() const;
+	size_t GetCapacity() const;
+	//Frees the oldest queued frames until keep are left and returns their
+	//pts; they count as dropped by the overload policy
+	std::vector<int64_t> DropOldest(size_t keep);
+
+	TeeOutputStats GetStats() const;
+
+private:
+	Logger* m_logger;
+	std::string m_name;
+
+	std::unique_ptr<XVideoWriter> m_owned;
+	XVideoWriter* m_writer;
+
+	std::thread m_thread;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	struct tee_frame
+	{
+		AVFrame* frame;
+		int64_t timestamp;
+	};
+
+	std::deque<tee_frame> m_queue;
+	bool m_stop;
+
+	TeeOutputStats m_stats;
+	std::chrono::steady_clock::time_point m_start;
+	std::chrono::steady_clock::time_point m_end;	//Set once the queue is drained after Finish()
+	bool m_finished;
+	double m_encode_seconds;
+
+	void EncodeLoop();
+	//In the writer's timing sidecar, if it keeps one
+	void AddDropped(int64_t pts, int64_t timestamp, DropReason reason);
+};
+
+#endif	//__TEE_OUTPUT_H__
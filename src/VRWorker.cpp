@@ -7,14 +7,18 @@
 #pragma comment(lib, "win64/openvr_api.lib")
 
 VRWorker::VRWorker(Logger* logger)
-	: m_logger(logger), m_initialized(false)
+	: m_logger(logger), m_initialized(false), bufferRowCount(0), bufferRowPitch(0), m_timestamp(0), m_refresh_rate(0), m_format(DXGI_FORMAT_UNKNOWN)
 {
 	m_vr_context = std::make_unique<openvr_context>();
 
 	m_vr_context->ctx11 = nullptr;
 	m_vr_context->dev11 = nullptr;
-	m_vr_context->mirrorSrv = nullptr;
-	m_vr_context->tex = nullptr;
+	for (int i = 0; i < 2; ++i)
+	{
+		m_vr_context->mirrorSrv[i] = nullptr;
+		m_vr_context->tex[i] = nullptr;
+	}
+	m_vr_context->eyes = 1;
 	m_vr_context->width = 0;
 	m_vr_context->height = 0;
 }
@@ -24,7 +28,7 @@ VRWorker::~VRWorker()
 	Release();
 }
 
-void VRWorker::Initalize(const vr::EVREye eye)
+void VRWorker::Initalize(const vr::EVREye eye, const bool stereo)
 {
 	if (m_initialized)
 		Release();
@@ -33,7 +37,7 @@ void VRWorker::Initalize(const vr::EVREye eye)
 
 	// Init OpenVR, create D3D11 device and get shared mirror texture
 	vr::EVRInitError err = vr::VRInitError_None;
-	vr::VR_Init(&err, vr::VRApplication_Background);
+	const auto system = vr::VR_Init(&err, vr::VRApplication_Background);
 
 	if (err != vr::VRInitError_None)
 	{
@@ -41,6 +45,9 @@ void VRWorker::Initalize(const vr::EVREye eye)
 		return;
 	}
 
+	//The compositor renders new mirror pictures at this rate, VFR captures at it
+	m_refresh_rate = system ? system->GetFloatTrackedDeviceProperty(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_DisplayFrequency_Float) : 0;
+
 	D3D_FEATURE_LEVEL featureLevel;
 	if (!SUCCEEDED(D3D11CreateDevice(NULL, D3D_DRIVER_TYPE_HARDWARE, 0, 0, 0, 0, D3D11_SDK_VERSION, &m_vr_context->dev11, &featureLevel, &m_vr_context->ctx11)))
 	{
@@ -48,32 +55,48 @@ void VRWorker::Initalize(const vr::EVREye eye)
 		return;
 	}
 
-	const auto err_comp = vr::VRCompositor()->GetMirrorTextureD3D11(eye, m_vr_context->dev11, reinterpret_cast<void**>(&m_vr_context->mirrorSrv));
-	if (err_comp != vr::EVRCompositorError::VRCompositorError_None || !m_vr_context->mirrorSrv)
-	{
-		m_logger->WriteError("GetMirrorTextureD3D11 failed\r\n");
-		return;
-	}
+	m_vr_context->eyes = stereo ? 2 : 1;
+	const vr::EVREye eyes[2] = { stereo ? vr::Eye_Left : eye, vr::Eye_Right };
 
-	// Get ID3D11Resource from shader resource view
-	m_vr_context->mirrorSrv->GetResource(&m_vr_context->tex);
-	if (!m_vr_context->tex)
+	D3D11_TEXTURE2D_DESC desc;
+	for (int i = 0; i < m_vr_context->eyes; ++i)
 	{
-		m_logger->WriteError("GetResource failed\r\n");
-		return;
-	}
+		const auto err_comp = vr::VRCompositor()->GetMirrorTextureD3D11(eyes[i], m_vr_context->dev11, reinterpret_cast<void**>(&m_vr_context->mirrorSrv[i]));
+		if (err_comp != vr::EVRCompositorError::VRCompositorError_None || !m_vr_context->mirrorSrv[i])
+		{
+			m_logger->WriteError("GetMirrorTextureD3D11 failed\r\n");
+			return;
+		}
 
-	// Get the size from Texture2D
-	ID3D11Texture2D* tex2D;
-	
-	if (!SUCCEEDED(m_vr_context->tex->QueryInterface<ID3D11Texture2D>(&tex2D)) || !tex2D)
-	{
-		m_logger->WriteError("QueryInterface failed\r\n");
-		return;
-	}
+		// Get ID3D11Resource from shader resource view
+		m_vr_context->mirrorSrv[i]->GetResource(&m_vr_context->tex[i]);
+		if (!m_vr_context->tex[i])
+		{
+			m_logger->WriteError("GetResource failed\r\n");
+			return;
+		}
 
-	D3D11_TEXTURE2D_DESC desc;
-	tex2D->GetDesc(&desc);
+		// Get the size from Texture2D
+		ID3D11Texture2D* tex2D;
+
+		if (!SUCCEEDED(m_vr_context->tex[i]->QueryInterface<ID3D11Texture2D>(&tex2D)) || !tex2D)
+		{
+			m_logger->WriteError("QueryInterface failed\r\n");
+			return;
+		}
+
+		D3D11_TEXTURE2D_DESC eyeDesc;
+		tex2D->GetDesc(&eyeDesc);
+		tex2D->Release();
+
+		//Both eyes go into one frame row by row
+		if (i > 0 && (eyeDesc.Width != desc.Width || eyeDesc.Height != desc.Height || eyeDesc.Format != desc.Format))
+		{
+			m_logger->WriteError("Eye mirror textures differ in size or format\r\n");
+			return;
+		}
+		desc = eyeDesc;
+	}
 
 	m_format = desc.Format;
 
@@ -86,13 +109,10 @@ void VRWorker::Initalize(const vr::EVREye eye)
 		return;
 	}
 
-	m_buffer = std::make_unique<uint8_t[]>(slicePitch);
 	bufferRowCount = rowCount;
-	bufferRowPitch = rowPitch;
-
-	tex2D->Release();
+	bufferRowPitch = rowPitch * m_vr_context->eyes;
 
-	m_logger->WriteInfo("Successful initalization OpenVR\r\n");
+	m_logger->WriteInfo(stereo ? "Successful initalization OpenVR, both eyes\r\n" : "Successful initalization OpenVR\r\n");
 
 	m_initialized = true;
 }
@@ -101,13 +121,19 @@ void VRWorker::Release()
 {
 	m_initialized = false;
 
-	if (m_vr_context->tex)
-		m_vr_context->tex->Release();
-
-	if (m_vr_context->mirrorSrv)
+	for (int i = 0; i < 2; ++i)
 	{
-		//vr::VRCompositor()->ReleaseMirrorTextureD3D11(m_vr_context->mirrorSrv);
-		m_vr_context->mirrorSrv->Release();
+		if (m_vr_context->tex[i])
+			m_vr_context->tex[i]->Release();
+
+		if (m_vr_context->mirrorSrv[i])
+		{
+			//vr::VRCompositor()->ReleaseMirrorTextureD3D11(m_vr_context->mirrorSrv[i]);
+			m_vr_context->mirrorSrv[i]->Release();
+		}
+
+		m_vr_context->mirrorSrv[i] = nullptr;
+		m_vr_context->tex[i] = nullptr;
 	}
 
 	if (m_vr_context->ctx11)
@@ -118,45 +144,58 @@ void VRWorker::Release()
 
 	m_vr_context->ctx11 = nullptr;
 	m_vr_context->dev11 = nullptr;
-	m_vr_context->mirrorSrv = nullptr;
-	m_vr_context->tex = nullptr;
 }
 
-bool VRWorker::CopyScreenToBuffer()
+bool VRWorker::CopyScreenToBuffer(uint8_t* buffer, const size_t bufferPitch)
 {
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> pStaging;
+	//Both staging copies are queued before either is mapped, so the eyes come
+	//from the same compositor frame and share one timestamp
+	const int eyes = m_vr_context->eyes;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> pStaging[2];
 	D3D11_TEXTURE2D_DESC desc = {};
-	CaptureTexture(m_vr_context->ctx11, m_vr_context->tex, desc, pStaging);
-
-	D3D11_MAPPED_SUBRESOURCE mapped;
-	auto hr = m_vr_context->ctx11->Map(pStaging.Get(), 0, D3D11_MAP_READ, 0, &mapped);
-	if (FAILED(hr))
-	{
-		return false;
-	}
-
-	auto sptr = static_cast<const char*>(mapped.pData);
-	if (!sptr)
+	for (int i = 0; i < eyes; ++i)
 	{
-		m_vr_context->ctx11->Unmap(pStaging.Get(), 0);
-		return false;
+		if (FAILED(CaptureTexture(m_vr_context->ctx11, m_vr_context->tex[i], desc, pStaging[i])))
+			return false;
 	}
 
 	size_t rowPitch, slicePitch, rowCount;
-	hr = GetSurfaceInfo(desc.Width, desc.Height, desc.Format, &slicePitch, &rowPitch, &rowCount);
+	auto hr = GetSurfaceInfo(desc.Width, desc.Height, desc.Format, &slicePitch, &rowPitch, &rowCount);
 	if (FAILED(hr))
 	{
-		m_vr_context->ctx11->Unmap(pStaging.Get(), 0);
 		return false;
 	}
+
+	m_timestamp = Now();
+
 	auto startTime = std::chrono::high_resolution_clock::now();
-	uint8_t* dptr = m_buffer.get();
-	size_t msize = std::min<size_t>(rowPitch, mapped.RowPitch);
-	for (size_t h = 0; h < rowCount; ++h)
+	for (int i = 0; i < eyes; ++i)
 	{
-		memcpy_s(dptr, rowPitch, sptr, msize);
-		sptr += mapped.RowPitch;
-		dptr += rowPitch;
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		hr = m_vr_context->ctx11->Map(pStaging[i].Get(), 0, D3D11_MAP_READ, 0, &mapped);
+		if (FAILED(hr))
+		{
+			return false;
+		}
+
+		auto sptr = static_cast<const char*>(mapped.pData);
+		if (!sptr)
+		{
+			m_vr_context->ctx11->Unmap(pStaging[i].Get(), 0);
+			return false;
+		}
+
+		//Each eye is its own column of the frame
+		uint8_t* dptr = buffer + i * rowPitch;
+		size_t msize = std::min<size_t>(rowPitch, mapped.RowPitch);
+		for (size_t h = 0; h < rowCount; ++h)
+		{
+			memcpy_s(dptr, bufferPitch - i * rowPitch, sptr, msize);
+			sptr += mapped.RowPitch;
+			dptr += bufferPitch;
+		}
+
+		m_vr_context->ctx11->Unmap(pStaging[i].Get(), 0);
 	}
 
 	auto endTime = std::chrono::high_resolution_clock::now();
@@ -164,11 +203,21 @@ bool VRWorker::CopyScreenToBuffer()
 	auto lastedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
 
 	//m_logger->WriteInfo(QString("Copy screen to buffer lasted %1 ms\r\n").arg(lastedTime));
-	m_vr_context->ctx11->Unmap(pStaging.Get(), 0);
 
 	return true;
 }
 
+AVPixelFormat VRWorker::ConvertDXGItoAV(const DXGI_FORMAT fmt)
+{
+	switch (fmt)
+	{
+	case DXGI_FORMAT::DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		return AVPixelFormat::AV_PIX_FMT_RGBA;
+	default:
+		return AVPixelFormat::AV_PIX_FMT_NONE;
+	}
+}
+
 HRESULT VRWorker::CaptureTexture(
 	_In_ ID3D11DeviceContext* pContext,
 	_In_ ID3D11Resource* pSource,
@@ -2,6 +2,7 @@
 #define __VRWORKER_H__
 
 #include "Logger.h"
+#include "FrameSource.h"
 
 #include <memory>
 
@@ -17,33 +18,43 @@ struct openvr_context
 {
 	ID3D11Device* dev11;
 	ID3D11DeviceContext* ctx11;
-	ID3D11Resource* tex;
-	ID3D11ShaderResourceView* mirrorSrv;
+	//One per captured eye, left first in stereo
+	ID3D11Resource* tex[2];
+	ID3D11ShaderResourceView* mirrorSrv[2];
+	int eyes;
 
-	int width;
+	int width;		//Of one eye
 	int height;
 };
 
-class VRWorker
+class VRWorker : public FrameSource
 {
+public:
+	static AVPixelFormat ConvertDXGItoAV(DXGI_FORMAT fmt);
+
 public:
 	VRWorker(Logger* logger);
 	~VRWorker();
 
-	void Initalize(vr::EVREye eye);
-	void Release();
+	//Stereo fetches both mirror textures and packs them side by side, left
+	//first, into one frame with one timestamp; eye is ignored then
+	void Initalize(vr::EVREye eye, bool stereo = false);
+	void Release() override;
 
-	bool IsInitialized() const { return m_initialized; }
+	bool IsInitialized() const override { return m_initialized; }
 
-	uint8_t* GetBuffer() const { return m_buffer.get(); }	
-	size_t GetBufferRowCount() const { return bufferRowCount; }
-	size_t GetBufferRowPitch() const { return bufferRowPitch; }
-	int GetWidth() const { return m_vr_context->width; }
-	int GetHeight() const { return m_vr_context->height; }
+	size_t GetBufferRowCount() const override { return bufferRowCount; }
+	size_t GetBufferRowPitch() const override { return bufferRowPitch; }
+	int GetWidth() const override { return m_vr_context->width * m_vr_context->eyes; }
+	int GetHeight() const override { return m_vr_context->height; }
+	int64_t GetTimestamp() const override { return m_timestamp; }
+	double GetRefreshRate() const override { return m_refresh_rate; }
 
 	DXGI_FORMAT GetFormat() const { return m_format; }
+	AVPixelFormat GetPixelFormat() const override { return ConvertDXGItoAV(m_format); }
 
-	bool CopyScreenToBuffer();
+	bool CopyScreenToBuffer(uint8_t* buffer, size_t bufferPitch);
+	bool CaptureFrame(AVFrame* frame) override { return CopyScreenToBuffer(frame->data[0], frame->linesize[0]); }
 
 private:
 	Logger* m_logger;
@@ -51,7 +62,8 @@ private:
 	bool m_initialized;
 	size_t bufferRowCount;
 	size_t bufferRowPitch;
-	std::unique_ptr<uint8_t[]> m_buffer;
+	int64_t m_timestamp;
+	double m_refresh_rate;	//Of the headset display
 
 	DXGI_FORMAT m_format;
 
@@ -0,0 +1,89 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+	: m_task(nullptr), m_count(0), m_next(0), m_active(0), m_generation(0), m_stop(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	Stop();
+}
+
+void WorkerPool::Start(const int threads)
+{
+	Stop();
+
+	//Workers start from the current generation, whenever they get scheduled
+	m_stop = false;
+	for (int i = 1; i < threads; ++i)
+		m_threads.emplace_back(&WorkerPool::WorkerLoop, this, m_generation);
+}
+
+void WorkerPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+
+	m_threads.clear();
+}
+
+void WorkerPool::Run(const int count, const std::function<void(int)>& task)
+{
+	if (m_threads.empty() || count <= 1)
+	{
+		for (int i = 0; i < count; ++i)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_count = count;
+		m_next = 0;
+		m_active = static_cast<int>(m_threads.size());
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	Drain();
+
+	//Every worker has to check in before task goes out of scope
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_active == 0; });
+	m_task = nullptr;
+}
+
+void WorkerPool::WorkerLoop(uint64_t seen)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [&]() { return m_stop || m_generation != seen; });
+		if (m_stop)
+			return;
+
+		seen = m_generation;
+		lock.unlock();
+
+		Drain();
+
+		lock.lock();
+		if (--m_active == 0)
+			m_done.notify_one();
+	}
+}
+
+void WorkerPool::Drain()
+{
+	int index;
+	while ((index = m_next++) < m_count)
+		(*m_task)(index);
+}
@@ -0,0 +1,48 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Small persistent thread pool for splitting one frame's work into bands.
+//Run() hands out task indices to the workers and the calling thread and
+//returns when all of them are finished, so there is no per-frame thread
+//creation and no queue
+class WorkerPool
+{
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	//threads counts the caller, so Start(1) runs everything inline
+	void Start(int threads);
+	void Stop();
+
+	int GetThreadCount() const { return static_cast<int>(m_threads.size()) + 1; }
+
+	//Calls task(i) for every i in [0, count) and waits for all of them
+	void Run(int count, const std::function<void(int)>& task);
+
+private:
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	const std::function<void(int)>* m_task;
+	int m_count;
+	std::atomic<int> m_next;
+	int m_active;
+	uint64_t m_generation;
+	bool m_stop;
+
+	void WorkerLoop(uint64_t seen);
+	void Drain();
+};
+
+#endif	//__WORKER_POOL_H__
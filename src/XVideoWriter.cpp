@@ -1,9 +1,20 @@
 #include "XVideoWriter.h"
+#include "FrameSource.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <thread>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 #include <libavdevice/avdevice.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #ifdef __cplusplus 
 }
 #endif
@@ -13,8 +24,70 @@ extern "C" {
 #pragma comment(lib, "avformat.lib")
 #pragma comment(lib, "swscale.lib")
 
+//Fine enough for capture timestamps, and the usual MPEG-TS clock
+const AVRational XVideoWriter::VfrTimeBase = { 1, 90000 };
+
+namespace
+{
+	//Smallest the overload policy takes a segment down to, of the configured size
+	const int MaxDivider = 4;
+
+	//FFV1 level 3 takes v x h slices with v <= h < 2v
+	const int Ffv1Slices[] = { 4, 6, 9, 12, 16, 20, 24, 30 };
+
+	//Work to get from the captured format to an encoder format, cheapest
+	//first; -1 if it is not worth considering
+	int GetFormatCost(const AVPixelFormat capture, const AVPixelFormat format, const bool exact)
+	{
+		if (FrameConverter::IsSameLayout(capture, format))
+			return 0;
+
+		const auto src = av_pix_fmt_desc_get(capture);
+		const auto dst = av_pix_fmt_desc_get(format);
+		if (!src || !dst || dst->comp[0].depth != 8)
+			return -1;
+
+		const bool rgb = (src->flags & AV_PIX_FMT_FLAG_RGB) && (dst->flags & AV_PIX_FMT_FLAG_RGB);
+		const bool planar = (dst->flags & AV_PIX_FMT_FLAG_PLANAR) != 0;
+		const bool alpha = (dst->flags & AV_PIX_FMT_FLAG_ALPHA) != 0;
+
+		//Bytes reordered, an alpha plane is only more to compress
+		if (rgb && !planar)
+			return alpha ? 2 : 1;
+		//The SIMD kernels; for anything but an exact encoder
+		if (!exact && format == AV_PIX_FMT_YUV420P && ColorConverter::IsSupported(capture, format))
+			return 3;
+		if (rgb)
+			return alpha ? 5 : 4;
+		return -1;
+	}
+
+	//Where the extension starts, or the end if there is none
+	size_t FindExtension(const std::string& filename)
+	{
+		const auto slash = filename.find_last_of("/\\");
+		const auto dot = filename.rfind('.');
+		return dot == std::string::npos || (slash != std::string::npos && dot < slash) ? filename.size() : dot;
+	}
+
+	QString DescribeSettings(const EncodeSettings& settings)
+	{
+		QString text;
+		if (settings.preset >= 0)
+			text = QString("preset %1, ").arg(EncodeBudget::GetPresetName(settings.preset));
+
+		if (settings.crf >= 0)
+			return text + QString("crf %1").arg(settings.crf);
+
+		return text + QString("%1 kb/s").arg(static_cast<qlonglong>(settings.bitrate / 1000));
+	}
+}
+
 XVideoWriter::XVideoWriter(Logger* logger)
-	: m_logger(logger), m_initialized(false)
+	: m_logger(logger), m_src_format(AV_PIX_FMT_NONE), m_src_width(0), m_src_height(0), m_frame_converted(false),
+	m_conversion(logger), m_checksum(logger), m_latency(nullptr), m_container(VideoContainer::Matroska), m_mux(logger), m_segmented(false), m_segment(0),
+	m_segment_start(AV_NOPTS_VALUE), m_segment_bytes(0), m_switch_pending(false), m_segment_list(nullptr),
+	m_downscale_requested(false), m_divider(1), m_failed(false), m_initialized(false)
 {
 	m_video_context = std::make_unique<ffmpeg_context>();
 }
@@ -35,61 +108,49 @@ void XVideoWriter::Release()
 	if (m_video_context->frame)
 		av_frame_free(&m_video_context->frame);
 
-	if (m_video_context->tmp_frame)
-		av_frame_free(&m_video_context->tmp_frame);
+	if (m_video_context->src_frame)
+		av_frame_free(&m_video_context->src_frame);
 
 	if (m_video_context->pkt)
 		av_packet_free(&m_video_context->pkt);
 
-	if (m_video_context->ftx && !(m_video_context->ftx->oformat->flags & AVFMT_NOFILE) && m_video_context->ftx->pb)
+	//Writes out what is queued, including the closing of finished segments.
+	//Whatever is still open was not finished, CloseFile() takes care of that
+	m_mux.Stop();
+	DiscardNextSegment();
+	m_output.reset();
+
+	if (m_segment_list)
 	{
-		avio_close(m_video_context->ftx->pb);
-		m_video_context->ftx->pb = nullptr;
+		fclose(m_segment_list);
+		m_segment_list = nullptr;
 	}
 
-	if (m_video_context->ftx)
-		avformat_free_context(m_video_context->ftx);
-
-	//if (m_video_context->file)
-	//	fclose(m_video_context->file);
-
-	if (m_video_context->sws_ctx)
-		sws_freeContext(m_video_context->sws_ctx);
+	m_budget.Stop();
+	m_conversion.Release();
+	if (m_checksum.IsOpen())
+		m_checksum.Close();
+	if (m_timing.IsOpen())
+		CloseTiming();
 
-	m_video_context->ftx = nullptr;
 	m_video_context->ctx = nullptr;
 	m_video_context->frame = nullptr;
-	m_video_context->tmp_frame = nullptr;
+	m_video_context->src_frame = nullptr;
 	m_video_context->pkt = nullptr;
-	m_video_context->file = nullptr;
-	m_video_context->sws_ctx = nullptr;
+	m_frame_converted = false;
+	m_segmented = false;
 
 	m_initialized = false;
 }
 
-void XVideoWriter::Initialize(const std::string& filename,
-	const std::string& codecName,
-	int videoBitrate,
-	int videoWidth,
-	int videoHeight,
-	int videoFramerate,
-	DXGI_FORMAT format,	
-	int width,
-	int height)
-{
-	Initialize(filename, codecName, videoBitrate, videoWidth, videoHeight, videoFramerate, ConvertDXGItoAV(format), width, height);
-}
-
-void XVideoWriter::Initialize(const std::string& filename,
-	const std::string& codecName,
-	int videoBitrate,
-	int videoWidth,
-	int videoHeight,
-	int videoFramerate,
+void XVideoWriter::Initialize(const VideoWriterConfig& config,
 	AVPixelFormat format,
 	int width,
 	int height)
 {
+	const auto& filename = config.filename;
+	const auto& codecName = config.codec_name;
+
 	if (format == AV_PIX_FMT_NONE)
 	{
 		m_logger->WriteError("Screen format unknown");
@@ -106,12 +167,12 @@ void XVideoWriter::Initialize(const std::string& filename,
 		m_logger->WriteError(QString("Codec %1 not found. Using uncompressed video\r\n").arg(codecName.c_str()));
 	}
 
-	avformat_alloc_output_context2(&m_video_context->ftx, NULL, "avi", filename.c_str());
-	if (!m_video_context->ftx)
+	//AVI stores a fixed frame rate, variable frame rate needs Matroska
+	auto container = config.container;
+	if (container == VideoContainer::Avi && config.variable_frame_rate)
 	{
-		m_logger->WriteError("Could not allocate output context");
-		Release();
-		return;
+		m_logger->WriteInfo("AVI cannot hold variable frame rate, writing Matroska\r\n");
+		container = VideoContainer::Matroska;
 	}
 
 	m_video_context->ctx = avcodec_alloc_context3(m_video_context->codec);
@@ -130,46 +191,12 @@ void XVideoWriter::Initialize(const std::string& filename,
 		return;
 	}
 
-	/* put sample parameters */
-	m_video_context->ctx->bit_rate = videoBitrate;
-	/* resolution must be a multiple of two */
-	m_video_context->ctx->width = videoWidth % 2 == 0 ? videoWidth : videoWidth + 1;
-	m_video_context->ctx->height = videoHeight %2 == 0 ? videoHeight : videoHeight + 1;
-	/* frames per second */
-	const AVRational tb = { 1, videoFramerate };
-	m_video_context->ctx->time_base = tb;
-	const AVRational fr = { videoFramerate, 1 };
-	m_video_context->ctx->framerate = fr;
-
-	/* emit one intra frame every ten frames
-	 * check frame pict_type before passing frame
-	 * to encoder, if frame->pict_type is AV_PICTURE_TYPE_I
-	 * then gop_size is ignored and the output of encoder
-	 * will always be I frame irrespective to gop_size
-	 */
-	m_video_context->ctx->gop_size = 10;
-	m_video_context->ctx->max_b_frames = 0;
-	m_video_context->ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-
-	if (m_video_context->codec->id == AV_CODEC_ID_H264)
-		av_opt_set(m_video_context->ctx->priv_data, "preset", "slow", 0);
+	SetupCodecContext(m_video_context->ctx, m_video_context->codec, config, GetEncoderFormat(config, format));
 
-	m_video_context->video_st = avformat_new_stream(m_video_context->ftx, m_video_context->codec);
-
-	m_video_context->video_st->time_base = tb;
-	if (!m_video_context->video_st)
-	{
-		Release();
-		m_logger->WriteError("Could not create stream to video file\r\n");
-		return;
-	}
-
-	if (avcodec_parameters_from_context(m_video_context->video_st->codecpar, m_video_context->ctx) < 0)
-	{
-		Release();
-		m_logger->WriteError("Could not get parameter from context\r\n");
-		return;
-	}
+	//Matroska and MP4 want SPS/PPS in the codec private data rather than
+	//in-band; has to be set before the encoder opens to take effect
+	if (OutputFile::NeedsGlobalHeader(container))
+		m_video_context->ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
 	/* open it */
 	auto ret = avcodec_open2(m_video_context->ctx, m_video_context->codec, nullptr);
@@ -182,34 +209,89 @@ void XVideoWriter::Initialize(const std::string& filename,
 		return;
 	}
 
-	if (m_video_context->ftx->oformat->flags & AVFMT_GLOBALHEADER)
-		m_video_context->ftx->oformat->flags |= AVFMT_GLOBALHEADER;
+	m_logger->WriteInfo(QString("Encoder %1: %2 threads, %3 threading\r\n")
+		.arg(m_video_context->codec->name)
+		.arg(m_video_context->ctx->thread_count)
+		.arg(m_video_context->ctx->active_thread_type == FF_THREAD_FRAME ? "frame"
+			: m_video_context->ctx->active_thread_type == FF_THREAD_SLICE ? "slice" : "no"));
 
-	av_dump_format(m_video_context->ftx, 0, filename.c_str(), 1);
+	m_config = config;
+	//Stepping quality would make a lossless recording lossy
+	if (config.encode_budget && !config.lossless)
+	{
+		const auto priv = m_video_context->ctx->priv_data;
+		const bool hasPreset = priv && av_opt_find(priv, "preset", nullptr, 0, 0);
+		const bool hasCrf = priv && av_opt_find(priv, "crf", nullptr, 0, 0);
+
+		EncodeSettings initial;
+		initial.preset = hasPreset ? EncodeBudget::FindPreset(config.preset) : -1;
+		initial.crf = hasCrf && config.crf >= 0 ? config.crf : -1;
+		initial.bitrate = m_video_context->ctx->bit_rate;
+
+		//An unknown fastest preset pins the preset where it starts. So does a
+		//single MP4 or Matroska file: its header holds the parameter sets of
+		//the first encoder, and a reopened one could not match them
+		EncodeBudgetLimits limits;
+		const int fastest = EncodeBudget::FindPreset(config.fastest_preset);
+		const bool segmented = config.segment_minutes > 0 || config.segment_bytes > 0;
+		const bool presetFree = segmented || !OutputFile::NeedsGlobalHeader(container);
+		limits.fastest_preset = fastest >= 0 && presetFree ? std::min(fastest, initial.preset) : initial.preset;
+		limits.max_crf = std::max(config.max_crf, initial.crf);
+		limits.min_bitrate = std::min<int64_t>(config.min_bitrate, initial.bitrate);
+
+		m_budget.Start(initial, limits, config.framerate);
+
+		m_logger->WriteInfo(QString("Encode budget: starting at %1, fastest preset %2, crf up to %3, bitrate down to %4 kb/s\r\n")
+			.arg(DescribeSettings(initial))
+			.arg(limits.fastest_preset >= 0 ? EncodeBudget::GetPresetName(limits.fastest_preset) : "-")
+			.arg(initial.crf >= 0 ? QString::number(limits.max_crf) : "-")
+			.arg(limits.min_bitrate > 0 && initial.crf < 0 ? QString::number(static_cast<qlonglong>(limits.min_bitrate / 1000)) : "-"));
+	}
 
-	m_video_context->file = fopen(filename.c_str(), "wb");
-	if (!m_video_context->file)
+	m_container = container;
+	m_comment.clear();
+	m_segmented = config.segment_minutes > 0 || config.segment_bytes > 0;
+	m_segment = 0;
+	m_segment_start = AV_NOPTS_VALUE;
+	m_segment_bytes = 0;
+	m_switch_pending = false;
+	m_downscale_requested = false;
+	m_divider = 1;
+	m_failed = false;
+
+	//After opening, so the stream gets the encoder's extradata
+	auto par = avcodec_parameters_alloc();
+	if (!par || avcodec_parameters_from_context(par, m_video_context->ctx) < 0)
 	{
+		avcodec_parameters_free(&par);
 		Release();
-		m_logger->WriteError(QString("Could not open file: %1\r\n").arg(filename.c_str()));
+		m_logger->WriteError("Could not get parameter from context\r\n");
 		return;
 	}
 
-	if (!(m_video_context->ftx->oformat->flags & AVFMT_NOFILE))
+	m_output = std::make_shared<OutputFile>(m_logger);
+	const bool opened = m_output->Open(m_segmented ? GetSegmentFilename(0) : filename, container, par,
+		m_video_context->ctx->time_base, m_video_context->ctx->framerate, GetOutputConfig());
+	avcodec_parameters_free(&par);
+	if (!opened)
 	{
-		if (avio_open(&m_video_context->ftx->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0)
-		{
-			Release();
-			m_logger->WriteError("Error avio open");
-			return;
-		}
+		Release();
+		return;
 	}
 
-	if (avformat_write_header(m_video_context->ftx, nullptr) < 0)
+	m_mux.Start(config.mux_queue_bytes, std::chrono::seconds(config.sync_interval), &m_timing);
+
+	if (m_segmented)
 	{
-		Release();
-		m_logger->WriteError("Error write header to file");
-		return;
+		//Lets the segments be joined again with the concat demuxer
+		const auto listName = filename.substr(0, FindExtension(filename)) + ".ffconcat";
+		m_segment_list = fopen(listName.c_str(), "w");
+		if (m_segment_list)
+			fputs("ffconcat version 1.0\n", m_segment_list);
+		else
+			m_logger->WriteError(QString("Could not create the segment list %1\r\n").arg(listName.c_str()));
+
+		PrepareNextSegment();
 	}
 
 	av_init_packet(m_video_context->pkt);
@@ -217,7 +299,8 @@ void XVideoWriter::Initialize(const std::string& filename,
 	m_video_context->pkt->size = 0;
 
 	m_video_context->frame = av_frame_alloc();
-	if (!m_video_context->frame)
+	m_video_context->src_frame = av_frame_alloc();
+	if (!m_video_context->frame || !m_video_context->src_frame)
 	{
 		Release();
 		m_logger->WriteError("Could not allocate video frame\r\n");
@@ -228,94 +311,317 @@ void XVideoWriter::Initialize(const std::string& filename,
 	m_video_context->frame->width = m_video_context->ctx->width;
 	m_video_context->frame->height = m_video_context->ctx->height;
 
-	ret = av_frame_get_buffer(m_video_context->frame, 0);
-	if (ret < 0)
+	m_src_format = format;
+	m_src_width = width;
+	m_src_height = height;
+	if (!InitializeConversion())
 	{
 		Release();
-		m_logger->WriteError("Could not allocate the video frame data\r\n");
 		return;
 	}
 
-	if (format != m_video_context->frame->format
-		|| width != m_video_context->frame->width
-		|| height != m_video_context->frame->height)
+	const auto encoderFormat = m_video_context->ctx->pix_fmt;
+	m_logger->WriteInfo(QString("Encoder input: %1 %2x%3 captured, %4 %5x%6 to %7, %8\r\n")
+		.arg(av_get_pix_fmt_name(format)).arg(width).arg(height)
+		.arg(av_get_pix_fmt_name(encoderFormat)).arg(m_video_context->ctx->width).arg(m_video_context->ctx->height)
+		.arg(m_video_context->codec ? m_video_context->codec->name : "-")
+		.arg(m_conversion.IsInitialized() ? "converted"
+			: format == encoderFormat ? "passed through without conversion" : "alpha taken as padding, no conversion"));
+
+	if (!config.frame_hash.empty() && !m_checksum.Open(filename.substr(0, FindExtension(filename)) + ".framehash",
+		config.frame_hash, m_video_context->ctx->pix_fmt, m_video_context->ctx->width, m_video_context->ctx->height,
+		m_video_context->ctx->time_base))
 	{
-		m_video_context->sws_ctx = sws_getContext(width, height, format,
-			m_video_context->frame->width, m_video_context->frame->height,
-			static_cast<AVPixelFormat>(m_video_context->frame->format), SWS_FAST_BILINEAR, NULL, NULL, NULL);
+		Release();
+		return;
+	}
 
-		if (!m_video_context->sws_ctx)
+	if (config.frame_timing)
+	{
+		const auto timingName = filename.substr(0, FindExtension(filename)) + ".timing";
+		if (!m_timing.Create(timingName, m_video_context->ctx->time_base, config.framerate))
 		{
-			m_logger->WriteError("Could not allocate the sws context\r\n");
+			m_logger->WriteError(QString("Could not create the timing file %1\r\n").arg(timingName.c_str()));
 			Release();
 			return;
 		}
+		m_logger->WriteInfo(QString("Frame timing to %1\r\n").arg(timingName.c_str()));
+	}
 
-		m_video_context->tmp_frame = av_frame_alloc();
-		if (!m_video_context->tmp_frame)
-		{
-			Release();
-			m_logger->WriteError("Could not allocate tmp video frame\r\n");
-			return;
-		}
+	m_video_context->frame_pts = 0;
+	m_initialized = true;
+}
 
-		m_video_context->tmp_frame->format = format;
-		m_video_context->tmp_frame->width = width;
-		m_video_context->tmp_frame->height = height;
+bool XVideoWriter::InitializeConversion()
+{
+	m_frame_converted = false;
+
+	//Captured frames in the encoder's format and size go to the encoder as is,
+	//everything else is converted straight from the captured buffer
+	return m_conversion.Initialize(m_src_format, m_src_width, m_src_height,
+		static_cast<AVPixelFormat>(m_video_context->frame->format),
+		m_video_context->frame->width, m_video_context->frame->height,
+		m_config.color_matrix, m_config.color_range, m_config.conversion_bands);
+}
 
-		ret = av_frame_get_buffer(m_video_context->tmp_frame, 0);
-		if (ret < 0)
+AVPixelFormat XVideoWriter::GetEncoderFormat(const VideoWriterConfig& config, const AVPixelFormat captureFormat)
+{
+	const auto codec = avcodec_find_encoder_by_name(config.codec_name.c_str());
+	if (!codec || !codec->pix_fmts)
+		return AV_PIX_FMT_YUV420P;
+
+	//FFV1, UT Video and the like are there to keep the picture as it is
+	const auto descriptor = avcodec_descriptor_get(codec->id);
+	const bool exact = config.lossless
+		|| (descriptor && (descriptor->props & AV_CODEC_PROP_LOSSLESS) && !(descriptor->props & AV_CODEC_PROP_LOSSY));
+
+	auto best = AV_PIX_FMT_NONE;
+	int bestCost = -1;
+	for (auto format = codec->pix_fmts; *format != AV_PIX_FMT_NONE; ++format)
+	{
+		const int cost = GetFormatCost(captureFormat, *format, exact);
+		if (cost >= 0 && (bestCost < 0 || cost < bestCost))
 		{
-			Release();
-			m_logger->WriteError("Could not allocate the tmp video frame data\r\n");
-			return;
+			best = *format;
+			bestCost = cost;
 		}
 	}
 
-	m_video_context->frame_pts = 0;
-	m_initialized = true;
+	if (best != AV_PIX_FMT_NONE)
+		return best;
+
+	//Nothing cheap: yuv420p as before where it is taken, else whatever
+	//libavcodec finds to lose the least
+	for (auto format = codec->pix_fmts; *format != AV_PIX_FMT_NONE; ++format)
+	{
+		if (*format == AV_PIX_FMT_YUV420P && !exact)
+			return AV_PIX_FMT_YUV420P;
+	}
+
+	return avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, captureFormat, 0, nullptr);
 }
 
-void XVideoWriter::CopyBufferWithSws(uint8_t* buf, size_t rowCount, size_t rowPitch)
+void XVideoWriter::SetupCodecContext(AVCodecContext* ctx, const AVCodec* codec, const VideoWriterConfig& config,
+	const AVPixelFormat format)
 {
-	uint8_t* sptr = buf;
-	uint8_t* dptr = m_video_context->tmp_frame->data[0];
+	/* put sample parameters */
+	ctx->bit_rate = config.bitrate;
+	/* resolution must be a multiple of two */
+	ctx->width = config.width % 2 == 0 ? config.width : config.width + 1;
+	ctx->height = config.height % 2 == 0 ? config.height : config.height + 1;
+	/* frames per second */
+	ctx->time_base = config.variable_frame_rate ? VfrTimeBase : AVRational{ 1, config.framerate };
+	ctx->framerate = AVRational{ config.framerate, 1 };
+
+	/* emit one intra frame every ten frames
+	 * check frame pict_type before passing frame
+	 * to encoder, if frame->pict_type is AV_PICTURE_TYPE_I
+	 * then gop_size is ignored and the output of encoder
+	 * will always be I frame irrespective to gop_size
+	 */
+	ctx->gop_size = 10;
+	ctx->max_b_frames = 0;
+	ctx->pix_fmt = format;
+
+	const auto desc = av_pix_fmt_desc_get(format);
+	if (desc && (desc->flags & AV_PIX_FMT_FLAG_RGB))
+	{
+		ctx->colorspace = AVCOL_SPC_RGB;
+		ctx->color_range = AVCOL_RANGE_JPEG;
+	}
+	else
+	{
+		ctx->colorspace = ColorConverter::GetColorSpace(config.color_matrix);
+		ctx->color_range = ColorConverter::GetColorRange(config.color_range);
+	}
+
+	//x264 and friends; codecs without the options keep their defaults
+	if (!config.preset.empty() && ctx->priv_data && av_opt_find(ctx->priv_data, "preset", nullptr, 0, 0))
+		av_opt_set(ctx->priv_data, "preset", config.preset.c_str(), 0);
+
+	if (config.crf >= 0 && !config.lossless && ctx->priv_data && av_opt_find(ctx->priv_data, "crf", nullptr, 0, 0))
+		av_opt_set_double(ctx->priv_data, "crf", config.crf, 0);
 
-	for (size_t h = 0; h < rowCount; ++h)
+	//0 threads lets the codec pick one per core. Frame threading adds one
+	//frame of latency per thread, slice threading splits every frame instead
+	ctx->thread_count = config.thread_count;
+	switch (config.threading)
 	{
-		memcpy(dptr, sptr, rowPitch);
-		sptr += rowPitch;
-		dptr += m_video_context->tmp_frame->linesize[0];
+	case EncoderThreading::Frame:
+		ctx->thread_type = FF_THREAD_FRAME;
+		break;
+	case EncoderThreading::Slice:
+		ctx->thread_type = FF_THREAD_SLICE;
+		break;
+	case EncoderThreading::Auto:
+	case EncoderThreading::AutoTune:
+	default:
+		ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+		break;
 	}
 
-	sws_scale(m_video_context->sws_ctx,
-		static_cast<const uint8_t * const *>(m_video_context->tmp_frame->data),
-		m_video_context->tmp_frame->linesize, 0, m_video_context->tmp_frame->height, m_video_context->frame->data,
-		m_video_context->frame->linesize);
+	//Row multithreading is a private option of the VP9 and AV1 wrappers
+	if (config.row_mt && ctx->priv_data && av_opt_find(ctx->priv_data, "row-mt", nullptr, 0, 0))
+		av_opt_set_int(ctx->priv_data, "row-mt", 1, 0);
+
+	if (config.lossless)
+	{
+		ctx->bit_rate = 0;
+
+		if (codec && strcmp(codec->name, "ffv1") == 0)
+		{
+			//Version 3 with a slice per thread, each slice CRC checked, and
+			//every frame a keyframe so a damaged one does not spoil the next
+			const int cores = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+			const int threads = config.thread_count > 0 ? config.thread_count : cores;
+			const auto slices = std::find_if(std::begin(Ffv1Slices), std::end(Ffv1Slices),
+				[threads](const int count) { return count >= threads; });
+			ctx->level = 3;
+			ctx->slices = slices != std::end(Ffv1Slices) ? *slices : Ffv1Slices[sizeof(Ffv1Slices) / sizeof(Ffv1Slices[0]) - 1];
+			ctx->gop_size = 1;
+			ctx->thread_type = FF_THREAD_SLICE;
+			if (ctx->priv_data && av_opt_find(ctx->priv_data, "slicecrc", nullptr, 0, 0))
+				av_opt_set_int(ctx->priv_data, "slicecrc", 1, 0);
+		}
+		else if (ctx->priv_data && av_opt_find(ctx->priv_data, "qp", nullptr, 0, 0))
+		{
+			//x264 is lossless at qp 0 and ignores crf then
+			av_opt_set_int(ctx->priv_data, "qp", 0, 0);
+		}
+	}
 }
 
-void XVideoWriter::WriteFrame(uint8_t* buf, size_t rowCount, size_t rowPitch)
+void XVideoWriter::WriteFrame(const AVFrame* src, const int64_t timestamp)
 {
 	if (!m_initialized)
 		return;
 
-	if (av_frame_make_writable(m_video_context->frame) < 0)
+	const auto start = std::chrono::steady_clock::now();
+
+	//A segment ending while the encoder cannot keep up ends here, before the
+	//frame is converted at a size the next one no longer has
+	if (m_downscale_requested && m_segmented && !m_switch_pending
+		&& IsSegmentFull(src->pts != AV_NOPTS_VALUE ? src->pts : m_video_context->frame_pts)
+		&& !StartSmallerSegment())
+		return;
+
+	AVFrame* frame;
+	if (m_conversion.IsInitialized())
 	{
-		m_logger->WriteError("Error write frame to file: frame unwritable");
-		Release();
+		//If the encoder still holds the previous frame the conversion takes
+		//another buffer from the pool rather than copying it
+		if (!m_conversion.Convert(src, m_video_context->frame))
+		{
+			m_logger->WriteError("Error write frame to file: frame unwritable");
+			Release();
+			return;
+		}
+		if (m_latency)
+			m_latency->Record(LatencyStage::Convert, std::chrono::steady_clock::now() - start);
+
+		frame = m_video_context->frame;
+		m_frame_converted = true;
+	}
+	else
+	{
+		//Pass the captured buffer by reference, the encoder keeps it alive as long as it needs
+		av_frame_unref(m_video_context->src_frame);
+		if (av_frame_ref(m_video_context->src_frame, src) < 0)
+		{
+			m_logger->WriteError("Error write frame to file: could not reference frame");
+			return;
+		}
+
+		//Same bytes, possibly with alpha now read as padding
+		m_video_context->src_frame->format = m_video_context->ctx->pix_fmt;
+		frame = m_video_context->src_frame;
 	}
 
-	if (m_video_context->sws_ctx)
+	SendFrame(frame, src->pts, timestamp, start);
+}
+
+void XVideoWriter::SetLatency(StageLatency* latency)
+{
+	m_latency = latency;
+	m_mux.SetLatency(latency);
+}
+
+bool XVideoWriter::WriteDuplicate(const int64_t pts, const int64_t timestamp)
+{
+	//Only a converted frame is still around once the encoder has it
+	if (!m_initialized || !m_frame_converted)
+		return false;
+
+	SendFrame(m_video_context->frame, pts, timestamp, std::chrono::steady_clock::now(), true);
+	return true;
+}
+
+void XVideoWriter::SendFrame(AVFrame* frame, const int64_t pts, const int64_t timestamp,
+	const std::chrono::steady_clock::time_point start, const bool duplicate)
+{
+	//Paced callers pass the tick number or capture time in pts, a gap there
+	//is a skipped tick. Encoders need pts strictly increasing
+	frame->pts = pts != AV_NOPTS_VALUE ? pts : m_video_context->frame_pts;
+	if (frame->pts < m_video_context->frame_pts)
+		frame->pts = m_video_context->frame_pts;
+	m_video_context->frame_pts = frame->pts + 1;
+
+	//Budget changes take effect on a forced keyframe
+	frame->pict_type = AV_PICTURE_TYPE_NONE;
+	if (m_budget.IsStarted())
 	{
-		CopyBufferWithSws(buf, rowCount, rowPitch);
+		const auto previous = m_budget.GetSettings();
+		EncodeSettings settings;
+		double load;
+		if (m_budget.Update(settings, load))
+		{
+			if (!ApplyEncodeSettings(previous, settings, load, frame->pts))
+				return;
+
+			frame->pict_type = AV_PICTURE_TYPE_I;
+		}
+	}
+
+	//Every segment starts on a keyframe of its own, the file changes when it comes out
+	if (m_segmented && !m_switch_pending && IsSegmentFull(frame->pts))
+	{
+		m_switch_pending = true;
+		frame->pict_type = AV_PICTURE_TYPE_I;
 	}
 
-	m_video_context->frame->pts = m_video_context->frame_pts++;
+	//Hashed from the very buffer the encoder reads
+	if (m_checksum.IsOpen())
+	{
+		if (duplicate)
+			m_checksum.PushDuplicate(frame->pts);
+		else
+			m_checksum.Push(frame, frame->pts);
+	}
 
-	auto ret = avcodec_send_frame(m_video_context->ctx, m_video_context->frame);
+	if (m_timing.IsOpen())
+	{
+		frame_timing_record record = {};
+		record.pts = frame->pts;
+		if (timestamp != AV_NOPTS_VALUE)
+		{
+			record.capture_time = timestamp;
+			record.capture_utc = FrameTimingLog::ToUtc(timestamp);
+		}
+		record.convert_time = FrameSource::Now();
+		record.status = static_cast<uint8_t>(duplicate ? FrameTimingStatus::Duplicate : FrameTimingStatus::Encoded);
+		m_timing_pending.push_back(record);
+	}
+
+	//Waits for room in the mux queue are the muxer's, not the encoder's
+	const auto encodeStart = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration writing(0);
+
+	auto ret = avcodec_send_frame(m_video_context->ctx, frame);
+	av_frame_unref(m_video_context->src_frame);
 	if (ret < 0)
 	{
 		m_logger->WriteError("Error sending a frame for encoding\r\n");
+		m_failed = true;
 		return;
 	}
 
@@ -323,35 +629,456 @@ void XVideoWriter::WriteFrame(uint8_t* buf, size_t rowCount, size_t rowPitch)
 	{
 		ret = avcodec_receive_packet(m_video_context->ctx, m_video_context->pkt);
 		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-			return;
+			break;
 		else if (ret < 0)
 		{
 			m_logger->WriteError("Error during encoding\r\n");
+			m_failed = true;
 			return;
 		}
 
-		if (m_video_context->pkt->pts != AV_NOPTS_VALUE)
-			m_video_context->pkt->pts = av_rescale_q(m_video_context->pkt->pts, m_video_context->ctx->time_base, m_video_context->video_st->time_base);
+		const auto writeStart = std::chrono::steady_clock::now();
+		if (!WritePacket())
+			return;
+		writing += std::chrono::steady_clock::now() - writeStart;
+	}
+
+	if (m_latency)
+		m_latency->Record(LatencyStage::Encode, std::chrono::steady_clock::now() - encodeStart - writing);
+
+	m_budget.AddFrame(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+bool XVideoWriter::ApplyEncodeSettings(const EncodeSettings& previous, const EncodeSettings& settings,
+	const double load, const int64_t pts)
+{
+	m_logger->WriteInfo(QString("Encode budget at %1 s (pts %2): load %3%, %4 -> %5\r\n")
+		.arg(pts * av_q2d(m_video_context->ctx->time_base), 0, 'f', 3)
+		.arg(pts)
+		.arg(load * 100, 0, 'f', 0)
+		.arg(DescribeSettings(previous))
+		.arg(DescribeSettings(settings)));
+
+	//A preset is only read when the encoder opens
+	if (settings.preset != previous.preset)
+	{
+		auto config = m_config;
+		config.preset = EncodeBudget::GetPresetName(settings.preset);
+		config.crf = settings.crf;
+		config.bitrate = static_cast<int>(settings.bitrate);
+
+		//Segments in MP4 or Matroska take the parameter sets from the encoder's
+		//extradata, so the new encoder gets a global header and starts a
+		//segment of its own. AVI has no such header and the new encoder repeats
+		//its parameter sets in-band; single MP4 and Matroska files never get
+		//here, their preset is pinned
+		const bool newSegment = m_segmented && OutputFile::NeedsGlobalHeader(m_container);
+		if (newSegment)
+		{
+			//The pre-opened file has the old extradata, and a keyframe the old
+			//encoder still flushes stays in the current segment
+			m_switch_pending = false;
+			DiscardNextSegment();
+		}
+
+		if (!ReopenEncoder(config, newSegment))
+			return false;
 
-		ret = av_interleaved_write_frame(m_video_context->ftx, m_video_context->pkt);
-		if (ret < 0)
+		if (newSegment)
 		{
-			m_logger->WriteError("Error during save\r\n");
-			return;
+			PrepareNextSegment();
+			m_switch_pending = true;
 		}
+		return true;
+	}
+
+	//libx264 reconfigures rate control on the next frame it gets
+	if (settings.crf != previous.crf)
+		av_opt_set_double(m_video_context->ctx->priv_data, "crf", settings.crf, 0);
+
+	if (settings.bitrate != previous.bitrate)
+		m_video_context->ctx->bit_rate = settings.bitrate;
+
+	return true;
+}
+
+bool XVideoWriter::ReopenEncoder(const VideoWriterConfig& config, const bool globalHeader)
+{
+	if (!FlushEncoder())
+	{
+		Release();
+		return false;
+	}
+
+	avcodec_free_context(&m_video_context->ctx);
+
+	m_video_context->ctx = avcodec_alloc_context3(m_video_context->codec);
+	if (!m_video_context->ctx)
+	{
+		m_logger->WriteError("Could not allocate video codec context\r\n");
+		Release();
+		return false;
+	}
+
+	//Same format as before, only the size or the settings change
+	SetupCodecContext(m_video_context->ctx, m_video_context->codec, config,
+		static_cast<AVPixelFormat>(m_video_context->frame->format));
+	if (globalHeader)
+		m_video_context->ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-		//fwrite(m_video_context->pkt->data, 1, m_video_context->pkt->size, m_video_context->file);
-		av_packet_unref(m_video_context->pkt);
+	const auto ret = avcodec_open2(m_video_context->ctx, m_video_context->codec, nullptr);
+	if (ret < 0)
+	{
+		m_logger->WriteError(QString("Could not reopen codec: %1\r\n").arg(ret));
+		Release();
+		return false;
 	}
+
+	return true;
 }
 
-void XVideoWriter::CloseFile()
+bool XVideoWriter::WritePacket()
+{
+	const auto pkt = m_video_context->pkt;
+	const auto tb = m_video_context->ctx->time_base;
+
+	if (m_switch_pending && (pkt->flags & AV_PKT_FLAG_KEY))
+		SwitchSegment();
+
+	const bool segments = m_config.segment_minutes > 0 || m_config.segment_bytes > 0;
+	if (m_segment_start == AV_NOPTS_VALUE)
+	{
+		m_segment_start = pkt->pts;
+		if (segments)
+		{
+			m_logger->WriteInfo(QString("Segment %1 from %2 s: %3\r\n")
+				.arg(m_segment).arg(m_segment_start * av_q2d(tb), 0, 'f', 3).arg(m_output->GetFilename().c_str()));
+			AddToSegmentList(m_output->GetFilename(), m_segment_start * av_q2d(tb));
+		}
+	}
+
+	//Taken before the pts is moved to the segment's start, pending records
+	//have the pts the frame was sent with
+	frame_timing_record timing;
+	const bool timed = m_timing.IsOpen() && TakeTiming(pkt, timing);
+
+	//Every segment starts at zero so each one plays on its own too
+	if (segments)
+	{
+		pkt->pts -= m_segment_start;
+		if (pkt->dts != AV_NOPTS_VALUE)
+			pkt->dts -= m_segment_start;
+	}
+
+	//Disk errors show up on the mux thread, here the packet is only queued
+	m_segment_bytes += pkt->size;
+	m_mux.Write(m_output, pkt, tb, timed ? &timing : nullptr);
+	return true;
+}
+
+bool XVideoWriter::TakeTiming(const AVPacket* pkt, frame_timing_record& record)
+{
+	//Packets come out in the order frames went in, there are no B-frames.
+	//Frames passed over were dropped by the encoder and have no packet
+	while (!m_timing_pending.empty() && m_timing_pending.front().pts < pkt->pts)
+	{
+		m_timing.Append(m_timing_pending.front());
+		m_timing_pending.pop_front();
+	}
+
+	if (m_timing_pending.empty() || m_timing_pending.front().pts != pkt->pts)
+		return false;
+
+	record = m_timing_pending.front();
+	m_timing_pending.pop_front();
+	record.encode_time = FrameSource::Now();
+	record.size = pkt->size;
+	record.keyframe = (pkt->flags & AV_PKT_FLAG_KEY) ? 1 : 0;
+
+	//Encoders that report quality give the picture type with it
+	int statsSize = 0;
+	const auto stats = av_packet_get_side_data(pkt, AV_PKT_DATA_QUALITY_STATS, &statsSize);
+	if (stats && statsSize >= 5)
+		record.picture_type = stats[4];
+	else
+		record.picture_type = static_cast<uint8_t>(record.keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P);
+	return true;
+}
+
+bool XVideoWriter::CloseTiming()
+{
+	for (const auto& record : m_timing_pending)
+		m_timing.Append(record);
+	m_timing_pending.clear();
+
+	const auto records = m_timing.GetAppended();
+	const bool complete = m_timing.Close();
+	m_logger->WriteInfo(QString("Frame timing: %1 records in %2\r\n")
+		.arg(static_cast<qulonglong>(records)).arg(m_timing.GetFilename().c_str()));
+	if (!complete)
+		m_logger->WriteError(QString("Frame timing in %1 is incomplete\r\n").arg(m_timing.GetFilename().c_str()));
+	return complete;
+}
+
+bool XVideoWriter::CloseFile()
 {
 	if (!m_initialized)
+		return false;
+
+	if (!FlushEncoder())
+		return false;
+
+	CloseInBackground(m_output);
+	m_output.reset();
+	m_mux.Stop();
+
+	const auto stats = m_mux.GetStats();
+	m_logger->WriteInfo(QString("Muxer: %1 packets, queue high-water %2, encoder waited %3 times, worst write %4 ms, worst sync %5 ms\r\n")
+		.arg(static_cast<qulonglong>(stats.written))
+		.arg(stats.high_water)
+		.arg(static_cast<qulonglong>(stats.waits))
+		.arg(stats.worst_write * 1000, 0, 'f', 1)
+		.arg(stats.worst_sync * 1000, 0, 'f', 1));
+	if (stats.failed)
+		m_logger->WriteError(QString("Muxer: %1 packets or files failed to write\r\n").arg(static_cast<qulonglong>(stats.failed)));
+
+	const bool hashed = !m_checksum.IsOpen() || m_checksum.Close();
+	const bool timed = !m_timing.IsOpen() || CloseTiming();
+	const bool complete = !m_failed && stats.failed == 0 && hashed && timed;
+
+	//Drops the pre-opened segment
+	Release();
+	return complete;
+}
+
+void XVideoWriter::SetComment(const std::string& text)
+{
+	std::lock_guard<std::mutex> lock(m_comment_mutex);
+	m_comment = text;
+}
+
+std::string XVideoWriter::GetComment()
+{
+	std::lock_guard<std::mutex> lock(m_comment_mutex);
+	return m_comment;
+}
+
+void XVideoWriter::RequestDownscale()
+{
+	if (!m_segmented || m_divider >= MaxDivider)
+		return;
+
+	if (!m_downscale_requested.exchange(true))
+		m_logger->WriteError("Encoder falling behind: next segment will be recorded at a lower resolution\r\n");
+}
+
+std::string XVideoWriter::GetSegmentFilename(const int segment) const
+{
+	const auto& filename = m_config.filename;
+	const auto extension = FindExtension(filename);
+
+	char number[16];
+	snprintf(number, sizeof(number), "_%03d", segment);
+	return filename.substr(0, extension) + number + filename.substr(extension);
+}
+
+bool XVideoWriter::IsSegmentFull(const int64_t pts) const
+{
+	//Nothing written yet, nothing to end
+	if (m_segment_start == AV_NOPTS_VALUE)
+		return false;
+
+	const auto tb = m_video_context->ctx->time_base;
+	if (m_config.segment_minutes > 0
+		&& pts - m_segment_start >= av_rescale(m_config.segment_minutes * 60LL, tb.den, tb.num))
+		return true;
+
+	//Container overhead is a fraction of a percent on top
+	return m_config.segment_bytes > 0 && m_segment_bytes >= m_config.segment_bytes;
+}
+
+void XVideoWriter::PrepareNextSegment()
+{
+	//The header is written from what the encoder has now; an encoder reopened
+	//after this prepares the next segment again
+	auto par = avcodec_parameters_alloc();
+	if (!par || avcodec_parameters_from_context(par, m_video_context->ctx) < 0)
+	{
+		avcodec_parameters_free(&par);
+		m_logger->WriteError("Could not get parameter from context\r\n");
+		return;
+	}
+
+	const auto logger = m_logger;
+	const auto filename = GetSegmentFilename(m_segment + 1);
+	const auto container = m_container;
+	const auto timeBase = m_video_context->ctx->time_base;
+	const auto frameRate = m_video_context->ctx->framerate;
+	const auto outputConfig = GetOutputConfig();
+
+	m_next_output = std::async(std::launch::async, [=]() mutable
+	{
+		std::unique_ptr<OutputFile> output(new OutputFile(logger));
+		output->Open(filename, container, par, timeBase, frameRate, outputConfig);
+		avcodec_parameters_free(&par);
+		return output;
+	});
+}
+
+void XVideoWriter::DiscardNextSegment()
+{
+	if (!m_next_output.valid())
+		return;
+
+	const auto next = m_next_output.get();
+	if (next)
+		next->Discard();
+}
+
+void XVideoWriter::SwitchSegment()
+{
+	m_switch_pending = false;
+
+	//Normally opened long ago, otherwise this is the one wait on the disk
+	auto next = m_next_output.valid() ? m_next_output.get() : nullptr;
+	if (!next || !next->IsOpen())
+	{
+		m_logger->WriteError(QString("Could not open segment %1, the rest goes to %2\r\n")
+			.arg(m_segment + 1).arg(m_output->GetFilename().c_str()));
+		m_segmented = false;
 		return;
+	}
+
+	CloseInBackground(std::move(m_output));
+	m_output = std::move(next);
+	++m_segment;
+	m_segment_start = AV_NOPTS_VALUE;
+	m_segment_bytes = 0;
+
+	PrepareNextSegment();
+}
+
+bool XVideoWriter::StartSmallerSegment()
+{
+	m_downscale_requested = false;
+
+	//Whatever the encode budget has settled on carries over
+	auto config = m_config;
+	config.width /= 2;
+	config.height /= 2;
+	if (m_budget.IsStarted())
+	{
+		const auto settings = m_budget.GetSettings();
+		config.preset = EncodeBudget::GetPresetName(settings.preset);
+		config.crf = settings.crf;
+		config.bitrate = static_cast<int>(settings.bitrate);
+	}
+
+	//The pre-opened file has the old size in its header
+	DiscardNextSegment();
+
+	//Flushes what is left into the segment ending here
+	if (!ReopenEncoder(config, OutputFile::NeedsGlobalHeader(m_container)))
+		return false;
+
+	m_config.width = config.width;
+	m_config.height = config.height;
+	m_divider = m_divider * 2;
+
+	CloseInBackground(std::move(m_output));
+
+	m_video_context->frame->width = m_video_context->ctx->width;
+	m_video_context->frame->height = m_video_context->ctx->height;
+	if (!InitializeConversion())
+	{
+		Release();
+		return false;
+	}
+
+	auto par = avcodec_parameters_alloc();
+	if (!par || avcodec_parameters_from_context(par, m_video_context->ctx) < 0)
+	{
+		avcodec_parameters_free(&par);
+		m_logger->WriteError("Could not get parameter from context\r\n");
+		Release();
+		return false;
+	}
 
-	const uint8_t endcode[] = { 0, 0, 1, 0xb7 };
-	std::fflush(stdout);
+	++m_segment;
+	m_segment_start = AV_NOPTS_VALUE;
+	m_segment_bytes = 0;
+	m_output = std::make_shared<OutputFile>(m_logger);
+	const bool opened = m_output->Open(GetSegmentFilename(m_segment), m_container, par,
+		m_video_context->ctx->time_base, m_video_context->ctx->framerate, GetOutputConfig());
+	avcodec_parameters_free(&par);
+	if (!opened)
+	{
+		Release();
+		return false;
+	}
+
+	m_logger->WriteInfo(QString("Overload: segment %1 recorded at %2x%3, 1/%4 of the configured size\r\n")
+		.arg(m_segment).arg(m_video_context->ctx->width).arg(m_video_context->ctx->height).arg(m_divider.load()));
+
+	PrepareNextSegment();
+	return true;
+}
+
+OutputFileConfig XVideoWriter::GetOutputConfig() const
+{
+	OutputFileConfig config;
+	config.comment_size = m_config.comment_size;
+	config.buffer_size = m_config.write_buffer;
+
+	//What one file is expected to grow to; in CRF mode the bitrate is only a
+	//guess, and the OS hands back whatever is left unused
+	config.preallocate = m_config.segment_bytes;
+	const int minutes = m_config.segment_minutes > 0 ? m_config.segment_minutes : m_config.expected_minutes;
+	if (minutes > 0 && m_video_context->ctx->bit_rate > 0)
+	{
+		const int64_t estimate = m_video_context->ctx->bit_rate / 8 * 60 * minutes;
+		config.preallocate = config.preallocate > 0 ? std::min(config.preallocate, estimate) : estimate;
+	}
+
+	return config;
+}
+
+void XVideoWriter::CloseInBackground(std::shared_ptr<OutputFile> output)
+{
+	//The trailer and the comment patch reread and write the file, which is
+	//not something to make the next frame wait for. The mux thread does it
+	//once the last packets of the file are out
+	m_mux.Close(output, GetComment());
+}
+
+void XVideoWriter::AddToSegmentList(const std::string& filename, const double start)
+{
+	if (!m_segment_list)
+		return;
+
+	//Relative to the list, which sits next to the segments; quotes are
+	//closed, escaped and reopened
+	const auto slash = filename.find_last_of("/\\");
+	std::string name;
+	for (const auto c : filename.substr(slash == std::string::npos ? 0 : slash + 1))
+	{
+		if (c == '\'')
+			name += "'\\''";
+		else
+			name += c;
+	}
+
+	//When the first packet went out, which trails capture by the queue
+	char utc[32];
+	const auto now = std::time(nullptr);
+	std::strftime(utc, sizeof(utc), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+	fprintf(m_segment_list, "# start %.3f %s\nfile '%s'\n", start, utc, name.c_str());
+	fflush(m_segment_list);
+}
+
+bool XVideoWriter::FlushEncoder()
+{
 	auto ret = avcodec_send_frame(m_video_context->ctx, nullptr);
 	while (ret >= 0)
 	{
@@ -361,42 +1088,19 @@ void XVideoWriter::CloseFile()
 		else if (ret < 0)
 		{
 			m_logger->WriteError("Error during encoding\r\n");
-			return;
+			return false;
 		}
 
-		ret = av_interleaved_write_frame(m_video_context->ftx, m_video_context->pkt);
-		if (ret < 0)
-		{
-			m_logger->WriteError("Error during save\r\n");
-			return;
-		}
-		//fwrite(m_video_context->pkt->data, 1, m_video_context->pkt->size, m_video_context->file);
-		av_packet_unref(m_video_context->pkt);
+		if (!WritePacket())
+			return false;
 	}
-	if (m_video_context->ftx)
-	{
-		ret = av_write_trailer(m_video_context->ftx);
-		if (ret < 0)
-		{
-			m_logger->WriteError("Error during save\r\n");
-			return;
-		}
-	}
-	//fwrite(endcode, 1, sizeof(endcode), m_video_context->file);
-	//fclose(m_video_context->file);
 
-	Release();
+	return true;
 }
 
-AVPixelFormat XVideoWriter::ConvertDXGItoAV(const DXGI_FORMAT fmt)
+std::vector<std::string> XVideoWriter::GetLosslessEncoders()
 {
-	switch (fmt)
-	{
-	case DXGI_FORMAT::DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
-		return AVPixelFormat::AV_PIX_FMT_RGBA;
-	default:
-		return AVPixelFormat::AV_PIX_FMT_NONE;
-	}
+	return { "ffv1", "utvideo", "libx264rgb" };
 }
 
 std::vector<std::string> XVideoWriter::GetAllEncoders()
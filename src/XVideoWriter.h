@@ -2,8 +2,23 @@
 #define __XVIDEO_WRITER_H__
 
 #include "Logger.h"
+#include "FrameConverter.h"
+#include "FrameChecksum.h"
+#include "FrameTimingLog.h"
+#include "LatencyHistogram.h"
+#include "EncodeBudget.h"
+#include "OutputFile.h"
+#include "MuxThread.h"
 
-#include "d3d11.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,22 +33,89 @@ extern "C" {
 //TODO: Add AVDictionary
 struct ffmpeg_context
 {
-	AVStream* video_st;
-	AVFormatContext* ftx;
 	AVCodec* codec;
 	AVFrame* frame;
-	AVFrame* tmp_frame;
+	AVFrame* src_frame;
 	AVCodecContext* ctx;
 	AVPacket* pkt;
-	int frame_pts;
-	FILE* file;
-	struct SwsContext* sws_ctx;
+	int64_t frame_pts;
+};
+
+enum class EncoderThreading
+{
+	Auto,		//Whatever the codec prefers
+	Frame,
+	Slice,
+	AutoTune	//Calibrated by EncoderTuner before recording
+};
+
+struct VideoWriterConfig
+{
+	std::string filename;
+	VideoContainer container;
+	std::string codec_name;
+	int bitrate;	//b/s
+	int width;
+	int height;
+	int framerate;
+	//Frame pts are capture times in VfrTimeBase instead of frame numbers
+	bool variable_frame_rate;
+	YuvMatrix color_matrix;
+	YuvRange color_range;
+	//Bands the conversion is split into, 0 picks one per core
+	int conversion_bands;
+	EncoderThreading threading;
+	int thread_count;	//0 - codec default
+	bool row_mt;
+	std::string preset;	//Also the slowest the encode budget steps back up to
+	int crf;			//-1 - rate control by bitrate
+	//Step preset and quality at keyframes to keep encoding real-time
+	bool encode_budget;
+	std::string fastest_preset;
+	int max_crf;
+	int min_bitrate;	//b/s, 0 - bitrate is never lowered
+	//Bytes kept in the header for a comment only known at the end, 0 - none
+	size_t comment_size;
+	//Start a new file on the first keyframe past either limit, 0 - no limit.
+	//Segments are named <name>_000.<ext>, ... and listed in <name>.ffconcat
+	int segment_minutes;
+	int64_t segment_bytes;
+	//Disk writes go through a buffer of this size on a thread of their own
+	size_t write_buffer;
+	int64_t mux_queue_bytes;	//Encoder waits for the disk beyond this
+	int sync_interval;			//Seconds between syncs to disk, 0 - left to the OS
+	//Unsegmented recordings reserve disk space for this long, 0 - none
+	int expected_minutes;
+	//RGB without chroma subsampling, bit exact, for one of GetLosslessEncoders();
+	//bitrate, crf and the encode budget do not apply
+	bool lossless;
+	//av_hash name of the checksums written to <name>.framehash for every
+	//frame given to the encoder, empty - none
+	std::string frame_hash;
+	//Capture, conversion, encoding and muxing time of every frame in
+	//<name>.timing, see FrameTimingLog
+	bool frame_timing;
 };
 
 class XVideoWriter
 {
 public:
 	static std::vector<std::string> GetAllEncoders();
+	//Encoders the lossless profile knows: ffv1, utvideo, libx264rgb
+	static std::vector<std::string> GetLosslessEncoders();
+
+	static const AVRational VfrTimeBase;
+
+	//Everything but the output: size, rate, colour, preset and threading, with
+	//format from GetEncoderFormat(). Shared with the encoder calibration
+	static void SetupCodecContext(AVCodecContext* ctx, const AVCodec* codec, const VideoWriterConfig& config,
+		AVPixelFormat format);
+
+	//What frames captured in captureFormat are converted to before they reach
+	//the encoder: the cheapest of the encoder's own formats to get to, never
+	//one that subsamples chroma or leaves RGB for a lossless encoder or profile.
+	//yuv420p for encoders that do not list their formats
+	static AVPixelFormat GetEncoderFormat(const VideoWriterConfig& config, AVPixelFormat captureFormat);
 
 public:
 	XVideoWriter(Logger* logger);
@@ -41,38 +123,122 @@ public:
 
 	bool IsInitialized() const { return m_initialized; }
 
-	void Initialize(const std::string& filename,
-		const std::string& codec_name,
-		int videoBitrate,
-		int videoWidth,
-		int videoHeight,
-		int videoFramerate,
-		DXGI_FORMAT format,
-		int width,
-		int height);
-	void Initialize(const std::string& filename,
-		const std::string& codec_name,
-		int videoBitrate,
-		int videoWidth,
-		int videoHeight,
-		int videoFramerate,
+	void Initialize(const VideoWriterConfig& config,
 		AVPixelFormat format,
 		int width,
 		int height);
 	void Release();
-	void WriteFrame(uint8_t* buf, size_t rowCount, size_t rowPitch);
-	void CloseFile();
+	//src->pts is in GetTimeBase() units; AV_NOPTS_VALUE numbers frames in order.
+	//timestamp is the capture time for the timing sidecar, see FrameSource::Now()
+	void WriteFrame(const AVFrame* src, int64_t timestamp = AV_NOPTS_VALUE);
+	//Sends the last converted frame again without converting anything; false
+	//if there is none, because frames go to the encoder unconverted or the
+	//size just changed, and the caller has to send the frame itself
+	bool WriteDuplicate(int64_t pts, int64_t timestamp = AV_NOPTS_VALUE);
+	//True if every frame given to the encoder made it into a finished file
+	bool CloseFile();
+
+	//Container comment of every file closed from now on, cut to comment_size.
+	//May be called from any thread
+	void SetComment(const std::string& text);
+
+	bool IsSegmented() const { return m_segmented; }
+	//The next segment starts at half the size, down to a quarter. May be
+	//called from any thread; ignored unless segmented
+	void RequestDownscale();
+
+	MuxStats GetMuxStats() const { return m_mux.GetStats(); }
+
+	//Conversion, encoding and muxing times go to latency; before Initialize()
+	void SetLatency(StageLatency* latency);
+
+	//For frames that never reach the writer, nullptr without a sidecar
+	FrameTimingLog* GetTimingLog() { return m_timing.IsOpen() ? &m_timing : nullptr; }
+
+	//As given to Initialize(), with the size of the current segment
+	const VideoWriterConfig& GetConfig() const { return m_config; }
+
+	AVRational GetTimeBase() const { return m_video_context->ctx ? m_video_context->ctx->time_base : AVRational{ 0, 1 }; }
+	//Negotiated by Initialize()
+	AVPixelFormat GetPixelFormat() const { return m_video_context->ctx ? m_video_context->ctx->pix_fmt : AV_PIX_FMT_NONE; }
 
 
 private:
 	Logger* m_logger;
 
 	std::unique_ptr<ffmpeg_context> m_video_context;
-	
+
+	//Captured format and size the conversion starts from
+	AVPixelFormat m_src_format;
+	int m_src_width;
+	int m_src_height;
+	//Whether frame holds a converted picture WriteDuplicate() can resend
+	bool m_frame_converted;
+
+	FrameConverter m_conversion;
+	FrameChecksum m_checksum;
+	StageLatency* m_latency;
+
+	//Records of frames sent to the encoder, completed when their packet
+	//comes out and appended once it is written
+	FrameTimingLog m_timing;
+	std::deque<frame_timing_record> m_timing_pending;
+
+	//Kept for reopening the encoder when the budget changes the preset
+	VideoWriterConfig m_config;
+	EncodeBudget m_budget;
+
+	std::mutex m_comment_mutex;
+	std::string m_comment;
+
+	VideoContainer m_container;
+	std::shared_ptr<OutputFile> m_output;
+	MuxThread m_mux;
+
+	//Segments: the next file is opened ahead of time so switching never waits
+	//for a header, and finished ones are closed on the mux thread
+	std::atomic<bool> m_segmented;
+	int m_segment;
+	int64_t m_segment_start;	//First pts of the segment, none before its first packet
+	int64_t m_segment_bytes;	//Packet data sent to the segment so far
+	bool m_switch_pending;	//A keyframe was forced, the file changes with it
+	std::future<std::unique_ptr<OutputFile>> m_next_output;
+	FILE* m_segment_list;
+
+	std::atomic<bool> m_downscale_requested;
+	std::atomic<int> m_divider;
+
+	//An error lost a frame or packet on the way to the muxer
+	bool m_failed;
+
 	bool m_initialized;
 
-	void CopyBufferWithSws(uint8_t* buf, size_t rowCount, size_t rowPitch);
-	AVPixelFormat ConvertDXGItoAV(DXGI_FORMAT fmt);
+	bool InitializeConversion();
+	//start is when work on the frame began, for the encode budget
+	void SendFrame(AVFrame* frame, int64_t pts, int64_t timestamp, std::chrono::steady_clock::time_point start,
+		bool duplicate = false);
+	bool WritePacket();
+	//Pending timing record of the packet, false if it has none
+	bool TakeTiming(const AVPacket* pkt, frame_timing_record& record);
+	//Records still waiting for a packet go out without one
+	bool CloseTiming();
+
+	std::string GetComment();
+	std::string GetSegmentFilename(int segment) const;
+	bool IsSegmentFull(int64_t pts) const;
+	void PrepareNextSegment();
+	void DiscardNextSegment();
+	void SwitchSegment();
+	//Ends the segment early with a smaller encoder; the next file is opened here
+	bool StartSmallerSegment();
+	OutputFileConfig GetOutputConfig() const;
+	void CloseInBackground(std::shared_ptr<OutputFile> output);
+	void AddToSegmentList(const std::string& filename, double start);
+	//Sends the end of stream and writes out whatever the encoder still holds
+	bool FlushEncoder();
+	bool ApplyEncodeSettings(const EncodeSettings& previous, const EncodeSettings& settings, double load, int64_t pts);
+	//globalHeader only when the next file's header is still to be written
+	bool ReopenEncoder(const VideoWriterConfig& config, bool globalHeader);
 };
 
 #endif	//__XVIDEO_WRITER_H__
\ No newline at end of file
@@ -2,14 +2,13 @@
 #include "ui_mainwindow.h"
 #include "SettingsWindow.h"
 #include "StressMonitor.h"
+#include "Benchmark.h"
 
-#include <boost/asio.hpp>
-
-#include <chrono>
-
+#include <QDir>
 #include <QFileDialog>
+#include <QLabel>
+#include <QTimer>
 #include <QNetworkDatagram>
-#include <QJsonDocument>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -27,10 +26,20 @@ MainWindow::MainWindow(QWidget *parent) :
 	connect(ui->actionStop, &QAction::triggered, this, &MainWindow::StopExpirement);
 	connect(ui->actionNew_Expirement, &QAction::triggered, this, &MainWindow::NewExpirement);
 	connect(ui->actionSettings, &QAction::triggered, this, &MainWindow::OpenSettingsWindow);
+	connect(ui->actionBenchmarkConversion, &QAction::triggered, this, &MainWindow::RunConversionBenchmark);
+	connect(ui->actionBenchmarkScaling, &QAction::triggered, this, &MainWindow::RunScalingBenchmark);
+	connect(ui->actionBenchmarkStereo, &QAction::triggered, this, &MainWindow::RunStereoBenchmark);
+	connect(ui->actionBenchmarkLossless, &QAction::triggered, this, &MainWindow::RunLosslessBenchmark);
 
 	logger = new Logger(this, "log.txt", ui->plainTextEdit);
-	vr = new VRWorker(logger);
-	vw = new XVideoWriter(logger);
+	session = std::make_unique<RecordingSession>(logger);
+
+	latencyLabel = new QLabel(this);
+	ui->statusBar->addPermanentWidget(latencyLabel);
+
+	statsTimer = new QTimer(this);
+	connect(statsTimer, &QTimer::timeout, this, &MainWindow::UpdatePipelineStats);
+	statsTimer->start(500);
 
 	const auto stress_monitor = new StressMonitor(QString("lrdx"), QString("stefan-08-02"));
 
@@ -51,18 +60,29 @@ void MainWindow::OpenSettingsWindow()
 
 void MainWindow::NewExpirement()
 {
-	StopThread();
+	if (IsPreparing())
+	{
+		logger->WriteError("Expirement is still being prepared");
+		return;
+	}
 
-#ifndef TEST_NO_VR
-	vr->Initalize(settings->GetVREye());
+	session->Stop();
 
-	if (!vr->IsInitialized())
+	QString filter;
+	switch (settings->GetContainer())
 	{
-		logger->WriteError("VR failed initialization");
-		return;
+	case VideoContainer::Avi:
+		filter = "AVI (*.avi)";
+		break;
+	case VideoContainer::Matroska:
+		filter = "Matroska (*.mkv)";
+		break;
+	case VideoContainer::FragmentedMp4:
+		filter = "Fragmented MP4 (*.mp4)";
+		break;
 	}
 
-	const auto filename = QFileDialog::getSaveFileName(this, "Save file", QDir::currentPath());
+	const auto filename = QFileDialog::getSaveFileName(this, "Save file", QDir::currentPath(), filter);
 
 	if(filename.isEmpty())
 	{
@@ -70,97 +90,53 @@ void MainWindow::NewExpirement()
 		return;
 	}
 
-	vw->Initialize(filename.toStdString(), settings->GetCodecName().toStdString(),
-		settings->GetVideoBitrate() * 1000,	//kb/s -> b/s
-		settings->GetVideoWidth(),
-		settings->GetVideoHeight(),
-		settings->GetVideoFramerate(),
-		vr->GetFormat(),
-		vr->GetWidth(),
-		vr->GetHeight());
+	//Start waits until the session is ready
+	ui->actionStart->setEnabled(false);
+	ui->actionNew_Expirement->setEnabled(false);
 
-	if (!vw->IsInitialized())
+	const auto prepareSettings = std::make_shared<SettingsHolder>(*settings);
+	const auto prepareFilename = filename.toStdString();
+	prepareThread = std::make_unique<std::thread>([this, prepareSettings, prepareFilename]()
 	{
-		logger->WriteError("VideoWriter failed initialization");
-		return;
-	}
-#endif
-
-	logger->WriteInfo("All successfully initialized. Waiting...");
+		const bool prepared = session->Prepare(*prepareSettings, prepareFilename);
+		QMetaObject::invokeMethod(this, "PrepareFinished", Qt::QueuedConnection, Q_ARG(bool, prepared));
+	});
 }
 
-void MainWindow::StartThread()
+void MainWindow::PrepareFinished(const bool prepared)
 {
-	thread_worked = true;
-
-	pWatchdogThread.reset(std::make_unique<std::thread>([&]()
+	if (prepareThread)
 	{
-		const auto framerate = settings->GetVideoFramerate();
-
-		logger->WriteInfo("Thread successfully started");
-
-		boost::asio::io_context io;
-		boost::asio::serial_port serial_port(io);
-
-		try
-		{
-			serial_port.set_option(boost::asio::serial_port_base::parity(settings->GetPortParity()));
-			serial_port.set_option(boost::asio::serial_port_base::baud_rate(settings->GetPortRate()));
-			serial_port.set_option(boost::asio::serial_port_base::character_size(settings->GetPortDataBits()));
-			serial_port.set_option(boost::asio::serial_port_base::stop_bits(settings->GetPortStopbits()));
-
-			serial_port.open(settings->GetPortName().toStdString());
+		prepareThread->join();
+		prepareThread.reset();
+	}
 
-			serial_port.write_some(boost::asio::buffer("1"));
-			serial_port.close();
-		}
-		catch (const boost::system::system_error& ex)
-		{
-			logger->WriteError(QString("Error initialization serial port %1: %2").arg(settings->GetPortName()).arg(ex.what()));
-		}
+	ui->actionStart->setEnabled(true);
+	ui->actionNew_Expirement->setEnabled(true);
 
-		while (thread_worked)
-		{
-			const auto startTime = std::chrono::high_resolution_clock::now();
-#ifndef TEST_NO_VR
-			vr->CopyScreenToBuffer();
-			vw->WriteFrame(vr->GetBuffer(), vr->GetBufferRowCount(), vr->GetBufferRowPitch());
-#endif
-			const auto endTime = std::chrono::high_resolution_clock::now();
-			auto lastedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
-			const auto sleepTime = std::chrono::milliseconds(static_cast<int>(std::round(1000 / framerate - lastedTime)));
-			//logger->WriteInfo(QString("sleeptime: %1").arg(sleepTime.count()));
-			std::this_thread::sleep_for(sleepTime);
-		}
-#ifndef TEST_NO_VR
-		vw->CloseFile();
-		logger->WriteInfo("Write file..");
-#endif
-		thread_worked = false;
-	}).release());
+	if (!prepared)
+		logger->WriteError("Expirement could not be prepared");
 }
 
 void MainWindow::StartExpirement()
 {
-	if (thread_worked)
+	if (IsPreparing())
 	{
-		logger->WriteError("Stop current expirement first");
+		logger->WriteError("Expirement is still being prepared");
 		return;
 	}
 
-#ifndef TEST_NO_VR
-	if (!vr->IsInitialized())
+	if (session->IsRunning())
 	{
-		logger->WriteError("VR uninitialized");
+		logger->WriteError("Stop current expirement first");
 		return;
 	}
 
-	if (!vw->IsInitialized())
+	if (!session->IsPrepared())
 	{
-		logger->WriteError("Videowriter uninitialized");
+		logger->WriteError("Expirement uninitialized");
 		return;
 	}
-#endif
 
 	if (settings->GetGoProSync())
 	{
@@ -172,13 +148,10 @@ void MainWindow::StartExpirement()
 		{
 			while (udpSocket->hasPendingDatagrams()) {
 				QNetworkDatagram datagram = udpSocket->receiveDatagram();
-				QByteArray replyData = datagram.data();
-				const auto tt = QJsonDocument::fromBinaryData(replyData);
-				const auto ff = tt.toJson();
 
-				if (tt["state"].toInt() == 1 && !tt["url"].toString().isEmpty())
+				if (RecordingSession::IsGoProRecording(datagram.data()))
 				{
-					StartThread();
+					session->Start();
 					disconnect(udpSocket.get(), &QUdpSocket::readyRead, this, nullptr);
 					return;
 				}
@@ -189,23 +162,100 @@ void MainWindow::StartExpirement()
 	}
 	else
 	{
-		StartThread();		
+		session->Start();
 	}
 }
 
 void MainWindow::StopExpirement()
 {
+	if (IsPreparing())
+		return;
+
 	disconnect(udpSocket.get(), &QUdpSocket::readyRead, this, nullptr);
-	StopThread();
+	session->Stop();
 }
 
-void MainWindow::StopThread()
+void MainWindow::UpdatePipelineStats()
 {
-	if (thread_worked)
+	if (!session->IsRunning())
+		return;
+
+	const auto pipeline = session->GetPipeline();
+	const auto stats = pipeline->GetQueueStats();
+	const auto mux = session->GetMuxStats();
+	auto message = QString("Queue %1/%2, high-water %3, overflows %4, encoded %5, mux queue %6 (max %7), worst write %8 ms")
+		.arg(stats.depth).arg(stats.capacity).arg(stats.high_water).arg(stats.overflows).arg(pipeline->GetEncodedFrames())
+		.arg(mux.depth).arg(mux.high_water).arg(mux.worst_write * 1000, 0, 'f', 1);
+
+	for (const auto& output : session->GetOutputStats())
+	{
+		message += QString("; %1 %2/%3, %4 fps, dropped %5")
+			.arg(output.name.c_str()).arg(output.depth).arg(output.capacity)
+			.arg(output.fps, 0, 'f', 1).arg(static_cast<qulonglong>(output.dropped));
+	}
+
+	ui->statusBar->showMessage(message);
+
+	QStringList latency;
+	for (int i = 0; i < static_cast<int>(LatencyStage::Count); ++i)
 	{
-		thread_worked = false;
-		pWatchdogThread->join();
+		const auto stage = static_cast<LatencyStage>(i);
+		const auto stats = session->GetLatency(stage);
+		if (stats.count == 0)
+			continue;
+
+		latency << QString("%1 %2/%3/%4").arg(StageLatency::GetStageName(stage))
+			.arg(stats.p50 / 1000.0, 0, 'f', 1).arg(stats.p99 / 1000.0, 0, 'f', 1).arg(stats.max / 1000.0, 0, 'f', 1);
 	}
+	latencyLabel->setText(latency.isEmpty() ? QString() : "p50/p99/max ms: " + latency.join(", "));
+}
+
+void MainWindow::RunConversionBenchmark()
+{
+	if (session->IsRunning())
+	{
+		logger->WriteError("Stop current expirement first");
+		return;
+	}
+
+	Benchmark benchmark(logger);
+	benchmark.RunColorConversion();
+}
+
+void MainWindow::RunScalingBenchmark()
+{
+	if (session->IsRunning())
+	{
+		logger->WriteError("Stop current expirement first");
+		return;
+	}
+
+	Benchmark benchmark(logger);
+	benchmark.RunBandedScaling();
+}
+
+void MainWindow::RunStereoBenchmark()
+{
+	if (session->IsRunning())
+	{
+		logger->WriteError("Stop current expirement first");
+		return;
+	}
+
+	Benchmark benchmark(logger);
+	benchmark.RunStereoCapture();
+}
+
+void MainWindow::RunLosslessBenchmark()
+{
+	if (session->IsRunning())
+	{
+		logger->WriteError("Stop current expirement first");
+		return;
+	}
+
+	Benchmark benchmark(logger);
+	benchmark.RunLosslessRecording(QDir::tempPath().toStdString());
 }
 
 void MainWindow::showEvent(QShowEvent* e)
@@ -215,19 +265,23 @@ void MainWindow::showEvent(QShowEvent* e)
 
 void MainWindow::closeEvent(QCloseEvent* e)
 {
-	if(thread_worked)
+	//Tuning cannot be cancelled, the session has to outlive it
+	if (prepareThread)
 	{
-		thread_worked = false;
-		pWatchdogThread->join();
+		prepareThread->join();
+		prepareThread.reset();
 	}
 
+	session->Stop();
+
 	QWidget::closeEvent(e);
 }
 
 MainWindow::~MainWindow()
 {
-	delete vr;
-	delete vw;
+	if (prepareThread)
+		prepareThread->join();
+	session.reset();
 	delete logger;
     delete ui;
 }
@@ -2,18 +2,22 @@
 #define __MAIN_WINDOW_H__
 
 #include "Logger.h"
-#include "VRWorker.h"
-#include "XVideoWriter.h"
+#include "RecordingSession.h"
 #include "SettingsHolder.h"
 
 #include <QMainWindow>
 #include <QUdpSocket>
 
+#include <memory>
+#include <thread>
+
 QT_BEGIN_NAMESPACE
 class QAction;
+class QLabel;
 class QMenu;
 class QPlainTextEdit;
 class QSessionManager;
+class QTimer;
 QT_END_NAMESPACE
 
 namespace boost {
@@ -45,22 +49,31 @@ private:
 	std::vector<std::string> encoders;
 
 	Logger* logger;
-	VRWorker* vr;
-	XVideoWriter* vw;
+	std::unique_ptr<RecordingSession> session;
 
-	std::unique_ptr<std::thread> pWatchdogThread;
-	bool thread_worked = false;
+	QTimer* statsTimer;
+	//p50/p99/max of every stage while recording
+	QLabel* latencyLabel;
 
 	std::unique_ptr<QUdpSocket> udpSocket;
 
-	void StopThread();
-	void StartThread();
+	//Prepare() opens the source and may tune the encoder for a while, so it
+	//runs here rather than on the GUI thread
+	std::unique_ptr<std::thread> prepareThread;
+
+	bool IsPreparing() const { return prepareThread != nullptr; }
 
 public slots:
 	void StartExpirement();
 	void StopExpirement();
 	void NewExpirement();
 	void OpenSettingsWindow();
+	void UpdatePipelineStats();
+	void PrepareFinished(bool prepared);
+	void RunConversionBenchmark();
+	void RunScalingBenchmark();
+	void RunStereoBenchmark();
+	void RunLosslessBenchmark();
 };
 
 #endif // __MAIN_WINDOW_H__
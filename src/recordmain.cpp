@@ -0,0 +1,263 @@
+#include "RecordingSession.h"
+#include "SettingsHolder.h"
+
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <string>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkDatagram>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+#include <QUdpSocket>
+
+namespace
+{
+	std::atomic<bool> interrupted(false);
+
+	void OnSignal(int)
+	{
+		interrupted = true;
+	}
+
+	QJsonObject ToJson(const SessionSummary& summary, const SettingsHolder& settings)
+	{
+		const auto perSecond = [&](const uint64_t count) { return summary.seconds > 0 ? count / summary.seconds : 0.0; };
+
+		QJsonObject queue;
+		queue["capacity"] = static_cast<qint64>(summary.queue.capacity);
+		queue["high_water"] = static_cast<qint64>(summary.queue.high_water);
+		queue["overflows"] = static_cast<qint64>(summary.queue.overflows);
+
+		QJsonObject pacer;
+		pacer["ticks"] = static_cast<qint64>(summary.pacer.ticks);
+		pacer["late"] = static_cast<qint64>(summary.pacer.late);
+		pacer["skipped"] = static_cast<qint64>(summary.pacer.skipped);
+		pacer["duplicated"] = static_cast<qint64>(summary.pacer.duplicated);
+		pacer["mean_jitter_us"] = summary.pacer.mean_jitter;
+		pacer["max_jitter_us"] = static_cast<qint64>(summary.pacer.max_jitter);
+
+		QJsonObject mux;
+		mux["packets"] = static_cast<qint64>(summary.mux.written);
+		mux["failed"] = static_cast<qint64>(summary.mux.failed);
+		mux["high_water"] = static_cast<qint64>(summary.mux.high_water);
+		mux["waits"] = static_cast<qint64>(summary.mux.waits);
+		mux["worst_write_ms"] = summary.mux.worst_write * 1000;
+		mux["worst_sync_ms"] = summary.mux.worst_sync * 1000;
+
+		QJsonArray outputs;
+		for (const auto& output : summary.outputs)
+		{
+			QJsonObject entry;
+			entry["name"] = output.name.c_str();
+			entry["encoded"] = static_cast<qint64>(output.encoded);
+			entry["dropped"] = static_cast<qint64>(output.dropped);
+			entry["high_water"] = static_cast<qint64>(output.high_water);
+			entry["capacity"] = static_cast<qint64>(output.capacity);
+			entry["fps"] = output.fps;
+			entry["busy"] = output.busy;
+			outputs.append(entry);
+		}
+
+		//Milliseconds per stage, see StageLatency
+		QJsonObject latency;
+		for (int i = 0; i < static_cast<int>(LatencyStage::Count); ++i)
+		{
+			const auto& stats = summary.latency[i];
+			QJsonObject stage;
+			stage["count"] = static_cast<qint64>(stats.count);
+			stage["mean"] = stats.mean / 1000;
+			stage["p50"] = stats.p50 / 1000.0;
+			stage["p90"] = stats.p90 / 1000.0;
+			stage["p99"] = stats.p99 / 1000.0;
+			stage["max"] = stats.max / 1000.0;
+			latency[StageLatency::GetStageName(static_cast<LatencyStage>(i))] = stage;
+		}
+
+		QJsonObject result;
+		result["output"] = summary.filename.c_str();
+		result["complete"] = summary.complete;
+		result["codec"] = settings.GetCodecName();
+		result["container"] = OutputFile::GetContainerName(settings.GetContainer());
+		result["width"] = settings.GetVideoWidth() * (settings.GetStereo() ? 2 : 1) / summary.divider;
+		result["height"] = settings.GetVideoHeight() / summary.divider;
+		result["framerate"] = settings.GetVideoFramerate();
+		result["stereo"] = settings.GetStereo();
+		result["seconds"] = summary.seconds;
+		result["captured"] = static_cast<qint64>(summary.captured);
+		result["encoded"] = static_cast<qint64>(summary.encoded);
+		result["dropped"] = static_cast<qint64>(summary.dropped);
+		result["static"] = static_cast<qint64>(summary.static_frames);
+		result["capture_fps"] = perSecond(summary.captured);
+		result["encode_fps"] = perSecond(summary.encoded);
+		result["queue"] = queue;
+		result["pacer"] = pacer;
+		result["mux"] = mux;
+		result["outputs"] = outputs;
+		result["latency_ms"] = latency;
+		return result;
+	}
+}
+
+//Records one experiment from xtgn.ini without the window, for lab automation
+//and benchmark rigs, and prints a JSON summary when it ends
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("XTgnRecord");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Records with the settings of xtgn.ini and prints a JSON performance summary");
+	parser.addHelpOption();
+
+	const QCommandLineOption outputOption(QStringList() << "o" << "output", "File to record to", "file");
+	const QCommandLineOption iniOption("ini", "Settings file", "file", "xtgn.ini");
+	const QCommandLineOption setOption("set", "Overrides any setting of the ini file, repeatable", "key=value");
+	const QCommandLineOption codecOption("codec", "Encoder, overrides video_codec", "name");
+	const QCommandLineOption containerOption("container", "avi, matroska or mp4, overrides container", "name");
+	const QCommandLineOption durationOption("duration", "Seconds to record, 0 - until interrupted", "seconds", "0");
+	const QCommandLineOption triggerOption("trigger",
+		"immediate, gopro (wait for the camera to start) or stdin (wait for a line); default follows gopro_sync", "mode");
+	const QCommandLineOption summaryOption("summary", "Write the summary to a file instead of stdout", "file");
+	const QCommandLineOption logOption("log", "Log file", "file", "log.txt");
+	parser.addOptions({ outputOption, iniOption, setOption, codecOption, containerOption, durationOption,
+		triggerOption, summaryOption, logOption });
+
+	parser.process(a);
+
+	if (!parser.isSet(outputOption))
+		parser.showHelp(1);
+
+	Logger logger(nullptr, parser.value(logOption));
+
+	//Overrides go to a copy, the ini file itself is left as it is
+	QTemporaryDir temp;
+	QSettings ini(parser.value(iniOption), QSettings::Format::IniFormat);
+	QSettings overridden(temp.filePath("xtgn.ini"), QSettings::Format::IniFormat);
+	for (const auto& key : ini.allKeys())
+		overridden.setValue(key, ini.value(key));
+
+	for (const auto& assignment : parser.values(setOption))
+	{
+		const auto separator = assignment.indexOf('=');
+		if (separator <= 0)
+		{
+			logger.WriteError(QString("Setting override %1 is not key=value\r\n").arg(assignment));
+			return 1;
+		}
+		overridden.setValue(assignment.left(separator), assignment.mid(separator + 1));
+	}
+	if (parser.isSet(codecOption))
+		overridden.setValue("video_codec", parser.value(codecOption));
+	if (parser.isSet(containerOption))
+		overridden.setValue("container", parser.value(containerOption));
+
+	SettingsHolder settings;
+	settings.Load(&overridden);
+
+	QString trigger = parser.value(triggerOption);
+	if (trigger.isEmpty())
+		trigger = settings.GetGoProSync() ? "gopro" : "immediate";
+	if (trigger.compare("immediate", Qt::CaseInsensitive) != 0 && trigger.compare("gopro", Qt::CaseInsensitive) != 0
+		&& trigger.compare("stdin", Qt::CaseInsensitive) != 0)
+	{
+		logger.WriteError(QString("Unknown trigger %1\r\n").arg(trigger));
+		return 1;
+	}
+
+	RecordingSession session(&logger);
+	if (!session.Prepare(settings, parser.value(outputOption).toStdString()))
+		return 1;
+
+	std::signal(SIGINT, OnSignal);
+	std::signal(SIGTERM, OnSignal);
+
+	const auto duration = parser.value(durationOption).toInt();
+	QTimer stopTimer;
+	stopTimer.setSingleShot(true);
+	QObject::connect(&stopTimer, &QTimer::timeout, &a, &QCoreApplication::quit);
+
+	const auto start = [&]()
+	{
+		if (!session.Start())
+		{
+			a.exit(1);
+			return;
+		}
+		if (duration > 0)
+			stopTimer.start(duration * 1000);
+	};
+
+	//Signals only set a flag; the event loop notices it here
+	QTimer signalTimer;
+	QObject::connect(&signalTimer, &QTimer::timeout, [&]()
+	{
+		if (interrupted)
+			a.quit();
+	});
+	signalTimer.start(100);
+
+	QUdpSocket udpSocket;
+	if (trigger.compare("gopro", Qt::CaseInsensitive) == 0)
+	{
+		udpSocket.bind(QHostAddress::LocalHost, settings.GetGoProPort());
+		QObject::connect(&udpSocket, &QUdpSocket::readyRead, [&]()
+		{
+			while (udpSocket.hasPendingDatagrams())
+			{
+				if (RecordingSession::IsGoProRecording(udpSocket.receiveDatagram().data()) && !session.IsRunning())
+				{
+					udpSocket.close();
+					start();
+					return;
+				}
+			}
+		});
+		logger.WriteInfo(QString("Waiting for the GoPro on port %1\r\n").arg(settings.GetGoProPort()));
+	}
+	else
+	{
+		if (trigger.compare("stdin", Qt::CaseInsensitive) == 0)
+		{
+			logger.WriteInfo("Waiting for a line on stdin\r\n");
+			std::string line;
+			std::getline(std::cin, line);
+		}
+		QTimer::singleShot(0, start);
+	}
+
+	const int code = a.exec();
+	const bool started = session.IsRunning();
+	session.Stop();
+
+	if (!started)
+	{
+		logger.WriteError("Recording never started\r\n");
+		return code != 0 ? code : 1;
+	}
+
+	const auto summary = session.GetSummary();
+	const auto json = QJsonDocument(ToJson(summary, settings)).toJson(QJsonDocument::Compact);
+
+	if (parser.isSet(summaryOption))
+	{
+		QFile file(parser.value(summaryOption));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json + "\n") < 0)
+			logger.WriteError(QString("Could not write summary to %1\r\n").arg(parser.value(summaryOption)));
+	}
+	else
+	{
+		QTextStream out(stdout);
+		out << json << "\n";
+	}
+
+	return summary.complete ? 0 : 2;
+}
@@ -0,0 +1,100 @@
+#include "FrameTimingLog.h"
+#include "DropCounter.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+//Turns the .timing sidecar of a recording into CSV, one row per frame, and
+//tells what happened to the frames on the way to the file
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("XTgnTiming");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Exports the per-frame timing sidecar of a recording as CSV");
+	parser.addHelpOption();
+	parser.addPositionalArgument("input", ".timing file");
+	parser.addPositionalArgument("output", "CSV file, stdout if left out");
+	parser.process(a);
+
+	const auto args = parser.positionalArguments();
+	if (args.isEmpty() || args.size() > 2)
+		parser.showHelp(1);
+
+	QTextStream err(stderr);
+
+	FrameTimingReader reader;
+	if (!reader.Open(args[0].toStdString()))
+	{
+		err << "Not a timing file: " << args[0] << "\n";
+		return 1;
+	}
+
+	FILE* out = stdout;
+	if (args.size() == 2)
+	{
+		out = fopen(args[1].toLocal8Bit().constData(), "w");
+		if (!out)
+		{
+			err << "Could not create " << args[1] << "\n";
+			return 1;
+		}
+	}
+
+	const auto rows = reader.ExportCsv(out);
+	const bool written = rows >= 0 && fflush(out) == 0;
+	if (out != stdout && fclose(out) != 0)
+		return 1;
+	if (!written)
+	{
+		err << "Could not write the CSV\n";
+		return 1;
+	}
+
+	//Where the frames went, and how long capture to file took
+	const int statuses = static_cast<int>(FrameTimingStatus::Static) + 1;
+	qulonglong counts[statuses] = {};
+	qulonglong drops[static_cast<int>(DropReason::Count)] = {};
+	uint64_t muxed = 0;
+	double totalLatency = 0;
+	double maxLatency = 0;
+	frame_timing_record record;
+	for (uint64_t i = 0; i < reader.GetSlotCount(); ++i)
+	{
+		if (!reader.GetRecord(i, record) || record.status >= statuses)
+			continue;
+
+		++counts[record.status];
+		if (record.status == static_cast<uint8_t>(FrameTimingStatus::Dropped) && record.drop_reason < static_cast<uint8_t>(DropReason::Count))
+			++drops[record.drop_reason];
+
+		if (record.capture_time && record.mux_time)
+		{
+			const double latency = (record.mux_time - record.capture_time) / 1000.0;
+			totalLatency += latency;
+			maxLatency = std::max(maxLatency, latency);
+			++muxed;
+		}
+	}
+
+	err << static_cast<qlonglong>(rows) << " frames" << (reader.GetHeader().closed ? "" : " (recording did not finish, file cut short)") << ": "
+		<< counts[static_cast<int>(FrameTimingStatus::Encoded)] << " encoded, "
+		<< counts[static_cast<int>(FrameTimingStatus::Duplicate)] << " duplicates, "
+		<< counts[static_cast<int>(FrameTimingStatus::Static)] << " static, "
+		<< counts[static_cast<int>(FrameTimingStatus::Dropped)] << " dropped ("
+		<< drops[static_cast<int>(DropReason::QueueFull)] << " " << DropCounter::GetReasonName(DropReason::QueueFull) << ", "
+		<< drops[static_cast<int>(DropReason::PacerSkip)] << " " << DropCounter::GetReasonName(DropReason::PacerSkip) << ", "
+		<< drops[static_cast<int>(DropReason::Overload)] << " " << DropCounter::GetReasonName(DropReason::Overload) << ")\n";
+	if (muxed)
+	{
+		err << "Capture to file: mean " << QString::number(totalLatency / muxed, 'f', 1)
+			<< " ms, max " << QString::number(maxLatency, 'f', 1) << " ms\n";
+	}
+
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include "ChunkedTranscoder.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+//Re-encodes a recording or a kept spool on every core, see ChunkedTranscoder
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("XTgnTranscode");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Encodes a recording or a .spool file in parallel chunks and joins them");
+	parser.addHelpOption();
+	parser.addPositionalArgument("input", "Recording or .spool file");
+	parser.addPositionalArgument("output", "File to write");
+
+	const QCommandLineOption jobsOption("jobs", "Chunks encoded at once, 0 - one per core", "n", "0");
+	const QCommandLineOption chunkOption("chunk-frames", "Smallest chunk, 0 - picked from the input", "frames", "0");
+	const QCommandLineOption containerOption("container", "matroska, mp4 or avi", "name", "matroska");
+	const QCommandLineOption codecOption("codec", "Encoder", "name", "libx264");
+	const QCommandLineOption bitrateOption("bitrate", "kb/s", "rate", "2500");
+	const QCommandLineOption crfOption("crf", "Constant quality, -1 - rate control by bitrate", "crf", "-1");
+	const QCommandLineOption presetOption("preset", "Encoder preset", "name", "slow");
+	const QCommandLineOption widthOption("width", "0 - input width", "pixels", "0");
+	const QCommandLineOption heightOption("height", "0 - input height", "pixels", "0");
+	const QCommandLineOption fullRangeOption("full-range", "Full range YUV for RGB input");
+	const QCommandLineOption bt709Option("bt709", "BT.709 matrix for RGB input");
+	const QCommandLineOption noBaselineOption("no-baseline", "Skip the single encoder comparison");
+	const QCommandLineOption keepOption("keep-chunks", "Leave the chunk files next to the output");
+	const QCommandLineOption losslessOption("lossless", "RGB, bit exact, with ffv1, utvideo or libx264rgb (ffv1 unless --codec)");
+	const QCommandLineOption logOption("log", "Log file", "file", "transcode.log");
+	parser.addOptions({ jobsOption, chunkOption, containerOption, codecOption, bitrateOption, crfOption, presetOption,
+		widthOption, heightOption, fullRangeOption, bt709Option, noBaselineOption, keepOption, losslessOption, logOption });
+
+	parser.process(a);
+
+	const auto args = parser.positionalArguments();
+	if (args.size() != 2)
+		parser.showHelp(1);
+
+	TranscodeConfig config;
+	config.input = args[0].toStdString();
+	config.output = args[1].toStdString();
+	config.jobs = parser.value(jobsOption).toInt();
+	config.chunk_frames = parser.value(chunkOption).toInt();
+	config.baseline = !parser.isSet(noBaselineOption);
+	config.keep_chunks = parser.isSet(keepOption);
+
+	const auto container = parser.value(containerOption);
+	if (container.compare("avi", Qt::CaseInsensitive) == 0)
+		config.writer.container = VideoContainer::Avi;
+	else if (container.compare("mp4", Qt::CaseInsensitive) == 0)
+		config.writer.container = VideoContainer::FragmentedMp4;
+	else
+		config.writer.container = VideoContainer::Matroska;
+
+	config.writer.codec_name = parser.value(codecOption).toStdString();
+	config.writer.bitrate = parser.value(bitrateOption).toInt() * 1000;	//kb/s -> b/s
+	config.writer.width = parser.value(widthOption).toInt();
+	config.writer.height = parser.value(heightOption).toInt();
+	config.writer.framerate = 0;
+	config.writer.variable_frame_rate = true;
+	config.writer.color_matrix = parser.isSet(bt709Option) ? YuvMatrix::BT709 : YuvMatrix::BT601;
+	config.writer.color_range = parser.isSet(fullRangeOption) ? YuvRange::Full : YuvRange::Limited;
+	config.writer.conversion_bands = 0;
+	config.writer.threading = EncoderThreading::Auto;
+	config.writer.thread_count = 0;
+	config.writer.row_mt = false;
+	config.writer.preset = parser.value(presetOption).toStdString();
+	config.writer.crf = parser.value(crfOption).toInt();
+	config.writer.encode_budget = false;
+	config.writer.fastest_preset = config.writer.preset;
+	config.writer.max_crf = config.writer.crf;
+	config.writer.min_bitrate = 0;
+	config.writer.comment_size = 0;
+	config.writer.segment_minutes = 0;
+	config.writer.segment_bytes = 0;
+	config.writer.write_buffer = 4 * 1024 * 1024;
+	config.writer.mux_queue_bytes = 64 * 1024 * 1024;
+	config.writer.sync_interval = 0;
+	config.writer.expected_minutes = 0;
+	config.writer.lossless = parser.isSet(losslessOption);
+	config.writer.frame_hash.clear();
+	config.writer.frame_timing = false;
+	if (config.writer.lossless && !parser.isSet(codecOption))
+		config.writer.codec_name = "ffv1";
+
+	Logger logger(nullptr, parser.value(logOption));
+	ChunkedTranscoder transcoder(&logger);
+
+	TranscodeReport report;
+	const bool ok = transcoder.Run(config, report);
+
+	//One line for scripts comparing runs
+	QTextStream out(stdout);
+	out << QString("frames=%1 chunks=%2 jobs=%3 seconds=%4 fps=%5 baseline_fps=%6 speedup=%7 ok=%8\n")
+		.arg(static_cast<qlonglong>(report.frames)).arg(report.chunks).arg(report.jobs)
+		.arg(report.seconds, 0, 'f', 3).arg(report.fps, 0, 'f', 2)
+		.arg(report.baseline_fps, 0, 'f', 2).arg(report.speedup, 0, 'f', 3).arg(ok ? 1 : 0);
+
+	return ok ? 0 : 1;
+}